@@ -239,9 +239,9 @@ struct IncomingMessage {
     bool     repliedMessageFetchDoneOrFailed;
     bool     inlineDownloadComplete;
     bool     inlineDownloadTimeout;
-    bool     animatedStickerConverted;
-    bool     animatedStickerConvertSuccess;
-    int      animatedStickerImageId;
+    bool     stickerConverted;
+    bool     stickerConvertSuccess;
+    int      stickerImageId;
 };
 
 class PendingMessageQueue {
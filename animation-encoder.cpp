@@ -0,0 +1,393 @@
+#include "animation-encoder.h"
+#include "buildopt.h"
+#include "gif.h"
+#include <zlib.h>
+#include <algorithm>
+
+#ifndef NoWebpAnimation
+#include <webp/encode.h>
+#include <webp/mux.h>
+#endif
+
+namespace {
+
+class GifEncoder: public AnimationEncoder {
+public:
+    GifEncoder(unsigned width, unsigned height)
+    : m_width(width), m_height(height)
+    {
+        GifBegin(&m_writer, -1, width, height, 2);
+    }
+    ~GifEncoder()
+    {
+        GifEnd(&m_writer);
+    }
+
+    void writeFrame(const uint8_t *rgba, unsigned delay, const FrameRect *changed) override
+    {
+        GifRect rect;
+        if (changed)
+            rect = {changed->left, changed->top, changed->width, changed->height};
+        GifWriteFrame(&m_writer, rgba, m_width, m_height, delay, false, 8, false,
+                      changed ? &rect : nullptr);
+    }
+    size_t size() const override { return m_writer.out.size(); }
+    bool finish(std::vector<uint8_t> &output, std::string &errorMessage) override
+    {
+        GifEnd(&m_writer);
+        output = std::move(m_writer.out);
+        return true;
+    }
+
+private:
+    GifWriter m_writer;
+    unsigned  m_width;
+    unsigned  m_height;
+};
+
+// APNG is written by hand because stock libpng doesn't support it. Like GIF, each frame only
+// covers the rectangle that changed, drawn over the previous frame, and identical frames only
+// extend the previous frame's delay. Pixels are stored losslessly as RGB.
+class ApngEncoder: public AnimationEncoder {
+public:
+    ApngEncoder(unsigned width, unsigned height);
+    ~ApngEncoder();
+
+    void   writeFrame(const uint8_t *rgba, unsigned delay, const FrameRect *changed) override;
+    size_t size() const override { return m_out.size(); }
+    bool   finish(std::vector<uint8_t> &output, std::string &errorMessage) override;
+
+private:
+    std::vector<uint8_t> m_out;
+    std::vector<uint8_t> m_previous;
+    std::vector<uint8_t> m_filtered;
+    z_stream             m_zstream;
+    bool                 m_zstreamOk;
+    unsigned             m_width;
+    unsigned             m_height;
+    unsigned             m_frameCount = 0;
+    uint32_t             m_sequenceNo = 0;
+    size_t               m_frameCountPos = 0;  // first field of acTL chunk
+    size_t               m_lastControlPos = 0; // start of last fcTL chunk
+    unsigned             m_lastDelay = 0;
+
+    void   put32(uint32_t value);
+    size_t beginChunk(const char *type);
+    void   endChunk(size_t start);
+    void   updateCrc(size_t chunkStart);
+    bool   extendLastFrame(unsigned delay);
+    void   compress(const uint8_t *rgba, const GifRect &rect);
+};
+
+ApngEncoder::ApngEncoder(unsigned width, unsigned height)
+: m_width(width), m_height(height)
+{
+    // Level 6 is only 4% smaller but 60% slower
+    m_zstream.zalloc = Z_NULL;
+    m_zstream.zfree  = Z_NULL;
+    m_zstream.opaque = Z_NULL;
+    m_zstreamOk = (deflateInit(&m_zstream, 4) == Z_OK);
+
+    static const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    m_out.assign(signature, signature + sizeof(signature));
+
+    size_t start = beginChunk("IHDR");
+    put32(width);
+    put32(height);
+    m_out.push_back(8); // bits per sample
+    m_out.push_back(2); // RGB
+    m_out.push_back(0); // deflate
+    m_out.push_back(0); // adaptive filtering
+    m_out.push_back(0); // no interlace
+    endChunk(start);
+
+    start = beginChunk("acTL");
+    m_frameCountPos = m_out.size();
+    put32(0); // frame count, filled in at the end
+    put32(0); // loop forever
+    endChunk(start);
+}
+
+ApngEncoder::~ApngEncoder()
+{
+    if (m_zstreamOk)
+        deflateEnd(&m_zstream);
+}
+
+void ApngEncoder::put32(uint32_t value)
+{
+    m_out.push_back(value >> 24);
+    m_out.push_back((value >> 16) & 0xff);
+    m_out.push_back((value >> 8) & 0xff);
+    m_out.push_back(value & 0xff);
+}
+
+size_t ApngEncoder::beginChunk(const char *type)
+{
+    size_t start = m_out.size();
+    put32(0); // length, filled in by endChunk
+    m_out.insert(m_out.end(), type, type + 4);
+    return start;
+}
+
+void ApngEncoder::updateCrc(size_t chunkStart)
+{
+    // Covers chunk type and data, but not the length
+    const uint8_t *chunk  = &m_out[chunkStart];
+    uint32_t       length = (chunk[0] << 24) | (chunk[1] << 16) | (chunk[2] << 8) | chunk[3];
+    uLong          crc    = crc32(0, chunk + 4, length + 4);
+    for (unsigned i = 0; i < 4; i++)
+        m_out[chunkStart + 8 + length + i] = (crc >> (24 - 8 * i)) & 0xff;
+}
+
+void ApngEncoder::endChunk(size_t start)
+{
+    uint32_t length = m_out.size() - start - 8;
+    for (unsigned i = 0; i < 4; i++)
+        m_out[start + i] = (length >> (24 - 8 * i)) & 0xff;
+    put32(0);
+    updateCrc(start);
+}
+
+bool ApngEncoder::extendLastFrame(unsigned delay)
+{
+    unsigned newDelay = m_lastDelay + delay;
+    if (newDelay > 0xffff)
+        return false;
+
+    // delay_num follows sequence number, width, height, x and y offset
+    size_t delayPos = m_lastControlPos + 8 + 20;
+    m_out[delayPos]     = newDelay >> 8;
+    m_out[delayPos + 1] = newDelay & 0xff;
+    m_lastDelay = newDelay;
+    updateCrc(m_lastControlPos);
+    return true;
+}
+
+void ApngEncoder::compress(const uint8_t *rgba, const GifRect &rect)
+{
+    // Filter byte, then RGB samples for each row. Rendered stickers are mostly flat colors, which
+    // deflate handles better unfiltered: sub, up, Paeth and per-row adaptive filtering all came
+    // out 15-25% bigger.
+    const size_t rowSize = 1 + (size_t)rect.width * 3;
+    m_filtered.resize(rowSize * rect.height);
+    for (uint32_t y = 0; y < rect.height; y++) {
+        uint8_t       *out   = &m_filtered[y * rowSize];
+        const uint8_t *pixel = rgba + ((size_t)(rect.top + y) * m_width + rect.left) * 4;
+        *out++ = 0;
+        for (uint32_t x = 0; x < rect.width; x++, pixel += 4, out += 3) {
+            out[0] = pixel[0];
+            out[1] = pixel[1];
+            out[2] = pixel[2];
+        }
+    }
+
+    deflateReset(&m_zstream);
+    m_zstream.next_in  = m_filtered.data();
+    m_zstream.avail_in = m_filtered.size();
+    size_t written = m_out.size();
+    m_out.resize(written + deflateBound(&m_zstream, m_filtered.size()));
+    m_zstream.next_out  = &m_out[written];
+    m_zstream.avail_out = m_out.size() - written;
+    deflate(&m_zstream, Z_FINISH);
+    m_out.resize(m_out.size() - m_zstream.avail_out);
+}
+
+void ApngEncoder::writeFrame(const uint8_t *rgba, unsigned delay, const FrameRect *changed)
+{
+    if (!m_zstreamOk)
+        return;
+
+    GifRect rect = {0, 0, m_width, m_height};
+    if (!m_previous.empty() && changed)
+        rect = {changed->left, changed->top, changed->width, changed->height};
+    if (!m_previous.empty() &&
+        (!rect.width || !rect.height ||
+         !GifFindChangedRect(m_previous.data(), rgba, m_width, &rect))) {
+        if (extendLastFrame(delay))
+            return;
+        rect = {0, 0, 1, 1};
+    }
+
+    m_lastControlPos = beginChunk("fcTL");
+    put32(m_sequenceNo++);
+    put32(rect.width);
+    put32(rect.height);
+    put32(rect.left);
+    put32(rect.top);
+    m_out.push_back(delay >> 8);
+    m_out.push_back(delay & 0xff);
+    m_out.push_back(0); // delay denominator 100
+    m_out.push_back(100);
+    m_out.push_back(0); // dispose: none
+    m_out.push_back(0); // blend: source
+    endChunk(m_lastControlPos);
+    m_lastDelay = delay;
+
+    // First frame doubles as the default image
+    size_t start = beginChunk(m_frameCount ? "fdAT" : "IDAT");
+    if (m_frameCount)
+        put32(m_sequenceNo++);
+    compress(rgba, rect);
+    endChunk(start);
+
+    if (m_previous.empty())
+        m_previous.assign(rgba, rgba + (size_t)m_width * m_height * 4);
+    else
+        // The rest is the same already
+        for (unsigned y = rect.top; y < rect.top + rect.height; y++) {
+            size_t offset = ((size_t)y * m_width + rect.left) * 4;
+            std::copy(rgba + offset, rgba + offset + rect.width * 4, &m_previous[offset]);
+        }
+    m_frameCount++;
+}
+
+bool ApngEncoder::finish(std::vector<uint8_t> &output, std::string &errorMessage)
+{
+    if (!m_zstreamOk || !m_frameCount) {
+        // Unlikely error message not worth translating
+        errorMessage = m_zstreamOk ? "No frames" : "Failed to initialize compression";
+        return false;
+    }
+
+    for (unsigned i = 0; i < 4; i++)
+        m_out[m_frameCountPos + i] = (m_frameCount >> (24 - 8 * i)) & 0xff;
+    updateCrc(m_frameCountPos - 8);
+    endChunk(beginChunk("IEND"));
+
+    output = std::move(m_out);
+    return true;
+}
+
+#ifndef NoWebpAnimation
+
+class WebpEncoder: public AnimationEncoder {
+public:
+    WebpEncoder(unsigned width, unsigned height);
+    ~WebpEncoder();
+
+    void   writeFrame(const uint8_t *rgba, unsigned delay, const FrameRect *changed) override;
+    size_t size() const override { return 0; }
+    bool   finish(std::vector<uint8_t> &output, std::string &errorMessage) override;
+
+private:
+    WebPAnimEncoder *m_encoder;
+    WebPConfig       m_config;
+    unsigned         m_width;
+    unsigned         m_height;
+    int              m_timestamp = 0; // milliseconds
+    bool             m_failed = false;
+};
+
+WebpEncoder::WebpEncoder(unsigned width, unsigned height)
+: m_width(width), m_height(height)
+{
+    WebPAnimEncoderOptions options;
+    WebPAnimEncoderOptionsInit(&options);
+    options.anim_params.loop_count = 0;
+    m_encoder = WebPAnimEncoderNew(width, height, &options);
+
+    // Lossy at fairly high quality, favouring encoding speed
+    WebPConfigInit(&m_config);
+    m_config.quality = 80;
+    m_config.method  = 2;
+    m_failed = !m_encoder || !WebPValidateConfig(&m_config);
+}
+
+WebpEncoder::~WebpEncoder()
+{
+    if (m_encoder)
+        WebPAnimEncoderDelete(m_encoder);
+}
+
+void WebpEncoder::writeFrame(const uint8_t *rgba, unsigned delay, const FrameRect *)
+{
+    if (m_failed)
+        return;
+
+    WebPPicture picture;
+    if (!WebPPictureInit(&picture)) {
+        m_failed = true;
+        return;
+    }
+    picture.use_argb = 1;
+    picture.width    = m_width;
+    picture.height   = m_height;
+    // Unchanged and identical frames are taken care of by WebPAnimEncoder
+    if (!WebPPictureImportRGBX(&picture, rgba, m_width * 4) ||
+        !WebPAnimEncoderAdd(m_encoder, &picture, m_timestamp, &m_config))
+    {
+        m_failed = true;
+    }
+    WebPPictureFree(&picture);
+    m_timestamp += delay * 10;
+}
+
+bool WebpEncoder::finish(std::vector<uint8_t> &output, std::string &errorMessage)
+{
+    WebPData data;
+    WebPDataInit(&data);
+    if (m_failed || !WebPAnimEncoderAdd(m_encoder, NULL, m_timestamp, NULL) ||
+        !WebPAnimEncoderAssemble(m_encoder, &data))
+    {
+        // Unlikely error message not worth translating
+        errorMessage = m_encoder ? WebPAnimEncoderGetError(m_encoder) : "Failed to create encoder";
+        WebPDataClear(&data);
+        return false;
+    }
+
+    output.assign(data.bytes, data.bytes + data.size);
+    WebPDataClear(&data);
+    return true;
+}
+
+#endif
+
+}
+
+bool isAnimationFormatSupported(AnimationFormat format)
+{
+    switch (format) {
+    case AnimationFormat::Gif:
+    case AnimationFormat::Apng:
+        return true;
+    case AnimationFormat::Webp:
+#ifndef NoWebpAnimation
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+const char *getAnimationFormatName(AnimationFormat format)
+{
+    switch (format) {
+    case AnimationFormat::Gif:
+        return "gif";
+    case AnimationFormat::Webp:
+        return "webp";
+    case AnimationFormat::Apng:
+        return "apng";
+    }
+    return "";
+}
+
+std::unique_ptr<AnimationEncoder> createAnimationEncoder(AnimationFormat format, unsigned width,
+                                                         unsigned height)
+{
+    switch (format) {
+    case AnimationFormat::Gif:
+        return std::unique_ptr<AnimationEncoder>(new GifEncoder(width, height));
+    case AnimationFormat::Apng:
+        return std::unique_ptr<AnimationEncoder>(new ApngEncoder(width, height));
+    case AnimationFormat::Webp:
+#ifndef NoWebpAnimation
+        return std::unique_ptr<AnimationEncoder>(new WebpEncoder(width, height));
+#else
+        break;
+#endif
+    }
+    return nullptr;
+}
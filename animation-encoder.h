@@ -0,0 +1,50 @@
+#ifndef _ANIMATION_ENCODER_H
+#define _ANIMATION_ENCODER_H
+
+// Encoders for animated images made from rendered sticker frames. Like the rest of sticker
+// conversion, nothing here touches libpurple or tdlib.
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+enum class AnimationFormat {
+    Gif,
+    Webp,
+    Apng
+};
+
+// Area of a frame, in pixels
+struct FrameRect {
+    unsigned left;
+    unsigned top;
+    unsigned width;
+    unsigned height;
+};
+
+// Receives frames in order and produces the contents of an animated image file
+class AnimationEncoder {
+public:
+    virtual ~AnimationEncoder() {}
+    // Frame is width*height RGBA pixels, alpha is ignored. Delay is in hundredths of a second.
+    // If changed isn't null, frame is the same as the previous one outside of that area, which
+    // spares encoders that look for changes the trouble.
+    virtual void   writeFrame(const uint8_t *rgba, unsigned delay, const FrameRect *changed) = 0;
+    void           writeFrame(const uint8_t *rgba, unsigned delay) { writeFrame(rgba, delay, nullptr); }
+    // Output size so far, or 0 for formats that only produce output at the end
+    virtual size_t size() const = 0;
+    // Completes the output, after which no more frames can be written
+    virtual bool   finish(std::vector<uint8_t> &output, std::string &errorMessage) = 0;
+};
+
+// Whether the format is available in this build
+bool        isAnimationFormatSupported(AnimationFormat format);
+const char *getAnimationFormatName(AnimationFormat format);
+
+// Returns nullptr if the format isn't supported
+std::unique_ptr<AnimationEncoder> createAnimationEncoder(AnimationFormat format, unsigned width,
+                                                         unsigned height);
+
+#endif
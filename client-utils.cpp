@@ -1,9 +1,11 @@
 #include "client-utils.h"
+#include "worker-pool.h"
 #include "purple-info.h"
 #include "config.h"
 #include "format.h"
 #include "receiving.h"
 #include "file-transfer.h"
+#include "html-text.h"
 #include <string.h>
 #include <stdlib.h>
 #include <algorithm>
@@ -729,13 +731,19 @@ static void appendText(std::vector<MessagePart> &parts, const char *s, size_t le
         if (parts.empty())
             parts.emplace_back();
 
-        std::string sourceText(s, len);
-        char *halfNewText = purple_markup_strip_html(sourceText.c_str());
-        char *newText = purple_unescape_html(halfNewText);
-        g_free(halfNewText);
+        // Most messages have no markup at all, and need no copying to find that out
+        char       *newText      = NULL;
+        const char *remaining    = s;
+        size_t      lenRemaining = len;
+        if (!isPlainHtml(s, len)) {
+            std::string sourceText(s, len);
+            char *halfNewText = purple_markup_strip_html(sourceText.c_str());
+            newText = purple_unescape_html(halfNewText);
+            g_free(halfNewText);
+            remaining    = newText;
+            lenRemaining = strlen(newText);
+        }
 
-        const char *remaining    = newText;
-        size_t      lenRemaining = strlen(newText);
         while (lenRemaining) {
             size_t chunkLength = splitTextChunk(parts.back(), remaining, lenRemaining, account);
             lenRemaining -= chunkLength;
@@ -924,6 +932,7 @@ void populateGroupChatList(PurpleRoomlist *roomlist, const std::vector<const td:
 }
 
 AccountThread::AccountThread(PurpleAccount* purpleAccount)
+: m_cancellation(std::make_shared<CancellationToken>())
 {
     m_accountUserName   = purple_account_get_username(purpleAccount);
     m_accountProtocolId = purple_account_get_protocol_id(purpleAccount);
@@ -931,7 +940,9 @@ AccountThread::AccountThread(PurpleAccount* purpleAccount)
 
 void AccountThread::threadFunc()
 {
+    m_startedAt = Clock::now();
     run();
+    m_finishedAt = Clock::now();
     g_idle_add(&AccountThread::mainThreadCallback, this);
 }
 
@@ -947,11 +958,47 @@ bool AccountThread::isSingleThread()
     return g_singleThread;
 }
 
+void AccountThread::setThreadCount(unsigned threadCount)
+{
+    WorkerPool::instance().setThreadCount(threadCount);
+}
+
+std::string AccountThread::getOwnerId(const char *userName, const char *protocolId)
+{
+    return std::string(protocolId) + '\n' + userName;
+}
+
+std::string AccountThread::jobOwner() const
+{
+    return getOwnerId(m_accountUserName.c_str(), m_accountProtocolId.c_str());
+}
+
+void AccountThread::cancelJobs(PurpleAccount *purpleAccount)
+{
+    unsigned cancelled = WorkerPool::instance().cancel(getOwnerId(purple_account_get_username(purpleAccount),
+                                                                  purple_account_get_protocol_id(purpleAccount)));
+    if (cancelled)
+        purple_debug_misc(config::pluginId, "Cancelled %u queued jobs for account %s\n", cancelled,
+                          purple_account_get_username(purpleAccount));
+}
+
 void AccountThread::startThread()
 {
     if (!g_singleThread) {
-        if (!m_thread.joinable())
-            m_thread = std::thread(std::bind(&AccountThread::threadFunc, this));
+        WorkerPool::Job job;
+        job.owner        = jobOwner();
+        job.run          = std::bind(&AccountThread::threadFunc, this);
+        job.discard      = [this]() { delete this; };
+        job.cancellation = m_cancellation;
+        m_queuedAt       = Clock::now();
+        if (!WorkerPool::instance().submit(std::move(job))) {
+            purple_debug_warning(config::pluginId, "Worker queue is full, dropping job for account %s\n",
+                                 m_accountUserName.c_str());
+            // Unlikely error message not worth translating
+            reject("Too many tasks in progress");
+            m_startedAt = m_finishedAt = m_queuedAt;
+            g_idle_add(&AccountThread::mainThreadCallback, this);
+        }
     } else {
         run();
         mainThreadCallback(this);
@@ -960,15 +1007,29 @@ void AccountThread::startThread()
 
 gboolean AccountThread::mainThreadCallback(gpointer data)
 {
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+
     AccountThread  *self     = static_cast<AccountThread *>(data);
     PurpleAccount  *account  = purple_accounts_find(self->m_accountUserName.c_str(),
                                                     self->m_accountProtocolId.c_str());
     PurpleTdClient *tdClient = account ? getTdClient(account) : nullptr;
-    if (self->m_thread.joinable())
-        self->m_thread.join();
+
+    if (!g_singleThread) {
+        WorkerPool::Stats stats = WorkerPool::instance().getStats();
+        purple_debug_misc(config::pluginId,
+                          "Worker job for %s done: waited %.1f ms, ran %.1f ms; %u jobs queued, "
+                          "average wait %.1f ms, max wait %.1f ms\n",
+                          self->m_accountUserName.c_str(),
+                          Milliseconds(self->m_startedAt - self->m_queuedAt).count(),
+                          Milliseconds(self->m_finishedAt - self->m_startedAt).count(),
+                          stats.queueDepth, stats.averageWaitMs, stats.maxWaitMs);
+    }
 
     if (tdClient)
         self->callback(tdClient);
+    else
+        // Callback would have taken ownership
+        delete self;
 
     return FALSE; // this idle callback will not be called again
 }
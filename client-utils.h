@@ -2,8 +2,10 @@
 #define _CLIENT_UTILS_H
 
 #include "account-data.h"
+#include "worker-pool.h"
 #include <purple.h>
-#include <thread>
+#include <chrono>
+#include <memory>
 
 const char *errorCodeMessage();
 
@@ -62,24 +64,39 @@ void updateOption(const td::td_api::updateOption &option, TdAccountData &account
 void populateGroupChatList(PurpleRoomlist *roomlist, const std::vector<const td::td_api::chat *> &chats,
                            const TdAccountData &account);
 
+// Work done off main thread on behalf of an account. Jobs from all accounts share WorkerPool.
 class AccountThread {
 public:
     using Callback = void (PurpleTdClient::*)(AccountThread *thread);
     static void setSingleThread();
     static bool isSingleThread();
+    static void setThreadCount(unsigned threadCount);
+    // Deletes jobs of given account that haven't started running yet, and asks running ones to stop
+    static void cancelJobs(PurpleAccount *purpleAccount);
 
     AccountThread(PurpleAccount *purpleAccount);
     virtual ~AccountThread() {}
     void startThread();
 private:
-    std::thread m_thread;
-    std::string m_accountUserName;
-    std::string m_accountProtocolId;
+    using Clock = std::chrono::steady_clock;
+    std::string       m_accountUserName;
+    std::string       m_accountProtocolId;
+    Clock::time_point m_queuedAt;
+    Clock::time_point m_startedAt;
+    Clock::time_point m_finishedAt;
+    std::shared_ptr<CancellationToken> m_cancellation;
 
-    void            threadFunc();
-    static gboolean mainThreadCallback(gpointer data);
+    static std::string getOwnerId(const char *userName, const char *protocolId);
+    void               threadFunc();
+    static gboolean    mainThreadCallback(gpointer data);
 protected:
+    // Signalled when account disconnects while run() is in progress, for jobs that can give up early
+    const CancellationToken &cancellation() const { return *m_cancellation; }
+    // WorkerPool owner of this job, for any helper jobs it submits itself
+    std::string              jobOwner() const;
     virtual void run() = 0;
+    // Called on main thread instead of run() if the job could not be queued
+    virtual void reject(const char *reason) = 0;
     virtual void callback(PurpleTdClient *tdClient) = 0;
 };
 
@@ -190,15 +190,16 @@ static void inlineDownloadResponse(uint64_t requestId,
             const td::td_api::file *replacementFile = nullptr;
 
             if (pendingMessage->message && pendingMessage->message->content_ &&
-                (pendingMessage->message->content_->get_id() == td::td_api::messageSticker::ID) &&
-                isStickerAnimated(path))
+                (pendingMessage->message->content_->get_id() == td::td_api::messageSticker::ID))
             {
-                if (shouldConvertAnimatedSticker(pendingMessage->messageInfo, account.purpleAccount)) {
+                if (shouldConvertSticker(pendingMessage->messageInfo, path, account.purpleAccount)) {
                     StickerConversionThread *thread;
-                    thread = new StickerConversionThread(account.purpleAccount, path, getChatId(*pendingMessage->message),
+                    thread = new StickerConversionThread(account.purpleAccount, path, request->fileDescription,
+                                                         getChatId(*pendingMessage->message),
                                                          &pendingMessage->messageInfo);
+                    thread->setThumbnail(pendingMessage->thumbnail.get());
                     thread->startThread();
-                } else
+                } else if (isStickerAnimated(path))
                     replacementFile = pendingMessage->thumbnail.get();
             }
 
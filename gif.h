@@ -11,6 +11,12 @@
 // dithering. (It does at least use delta encoding - only the changed portions of each
 // frame are saved.)
 //
+// Local changes: frames are cropped to the rectangle that changed since the previous frame,
+// identical frames only extend the previous frame's delay, and a palette is only rebuilt when
+// the previous one (or the global one, taken from the first frame) no longer fits changed pixels.
+// Palette lookups go through a per-palette color cache, and misses are resolved by brute force
+// SIMD search where available.
+//
 // So resulting files are often quite large. The hope is that it will be handy nonetheless
 // as a quick and easily-integrated way for programs to spit out animations.
 //
@@ -32,6 +38,12 @@
 #include <stdio.h>   // for FILE*
 #include <string.h>  // for memcpy and bzero
 #include <stdint.h>  // for integer typedefs
+#include <memory>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 // Define these macros to hook into a custom memory allocator.
 // TEMP_MALLOC and TEMP_FREE will only be called in stack fashion - frees in the reverse order of mallocs
@@ -76,6 +88,18 @@ struct GifPalette
     uint8_t treeSplit[255];
 };
 
+struct GifRect
+{
+    uint32_t left, top, width, height;
+};
+
+// Palette is reused for a frame if mean error over sampled changed pixels (sum of absolute
+// differences of r, g and b) is within this limit...
+const int kGifReuseMaxMeanError = 6;
+// ...and at most 1/kGifReuseBadFraction of the samples are off by more than kGifReuseBadError
+const int kGifReuseBadError     = 24;
+const int kGifReuseBadFraction  = 25;
+
 // max, min, and abs functions
 static int GifIMax(int l, int r) { return l>r?l:r; }
 static int GifIMin(int l, int r) { return l<r?l:r; }
@@ -133,6 +157,115 @@ static void GifGetClosestPaletteColor(GifPalette* pPal, int r, int g, int b, int
     }
 }
 
+#ifdef __SSE2__
+// Brute force search over the whole palette, 16 entries at a time. Differences saturate at 255,
+// so if no entry is closer than that the result would be unreliable; false is returned then and
+// bestInd and bestDiff are left alone. Ties go to the lowest index rather than the one found first
+// in the tree, otherwise the result is the same as GifGetClosestPaletteColor.
+static bool GifGetClosestPaletteColorSse2(const GifPalette* pPal, int r, int g, int b, int& bestInd, int& bestDiff)
+{
+    const int numEntries = 1 << pPal->bitDepth;
+    const __m128i vr = _mm_set1_epi8((char)r);
+    const __m128i vg = _mm_set1_epi8((char)g);
+    const __m128i vb = _mm_set1_epi8((char)b);
+    const __m128i lanes = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    // unsigned 16-bit minimum is SSE4.1, so compare biased values as signed instead
+    const __m128i bias = _mm_set1_epi16((short)0x8000);
+    __m128i best = _mm_set1_epi16(0x7fff);
+
+    for(int i = 0; i < numEntries; i += 16)
+    {
+        __m128i pr = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPal->r + i));
+        __m128i pg = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPal->g + i));
+        __m128i pb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pPal->b + i));
+        __m128i dr = _mm_or_si128(_mm_subs_epu8(pr, vr), _mm_subs_epu8(vr, pr));
+        __m128i dg = _mm_or_si128(_mm_subs_epu8(pg, vg), _mm_subs_epu8(vg, pg));
+        __m128i db = _mm_or_si128(_mm_subs_epu8(pb, vb), _mm_subs_epu8(vb, pb));
+        __m128i diff = _mm_adds_epu8(_mm_adds_epu8(dr, dg), db);
+
+        // transparent entry and entries past the end of a small palette never match
+        if(i == 0)
+            diff = _mm_or_si128(diff, _mm_cvtsi32_si128(0xff));
+        if(numEntries - i < 16)
+            diff = _mm_or_si128(diff, _mm_cmpgt_epi8(lanes, _mm_set1_epi8((char)(numEntries - i - 1))));
+
+        // difference in the high byte, index in the low one
+        __m128i index = _mm_add_epi8(lanes, _mm_set1_epi8((char)i));
+        __m128i lo = _mm_xor_si128(_mm_unpacklo_epi8(index, diff), bias);
+        __m128i hi = _mm_xor_si128(_mm_unpackhi_epi8(index, diff), bias);
+        best = _mm_min_epi16(best, _mm_min_epi16(lo, hi));
+    }
+
+    best = _mm_min_epi16(best, _mm_shuffle_epi32(best, _MM_SHUFFLE(1, 0, 3, 2)));
+    best = _mm_min_epi16(best, _mm_shuffle_epi32(best, _MM_SHUFFLE(2, 3, 0, 1)));
+    best = _mm_min_epi16(best, _mm_shufflelo_epi16(best, _MM_SHUFFLE(2, 3, 0, 1)));
+    int result = (_mm_cvtsi128_si32(best) & 0xffff) ^ 0x8000;
+    if((result >> 8) == 0xff) return false;
+
+    bestInd = result & 0xff;
+    bestDiff = result >> 8;
+    return true;
+}
+#endif
+
+// Sticker frames have few distinct colors, repeated across frames, so results of palette lookups
+// are remembered in a direct-mapped cache that stays valid for as long as the palette does.
+// Entries are tagged with a generation number, which is bumped when the palette changes.
+// With about 97% hit rate on real stickers, misses are rare enough that the cache is used
+// regardless of frame size.
+struct GifColorCache
+{
+    enum {
+        kSlotBits = 12,
+        kSlots = 1 << kSlotBits
+    };
+
+    uint32_t keys[kSlots];     // generation << 24 | r << 16 | g << 8 | b
+    uint8_t indices[kSlots];
+    uint32_t generation;
+};
+
+static void GifColorCacheReset( GifColorCache& cache )
+{
+    cache.generation = (cache.generation + 1) & 0xff;
+    if(cache.generation == 0)
+    {
+        memset(cache.keys, 0, sizeof(cache.keys));
+        cache.generation = 1;
+    }
+}
+
+// Picks the palette entry for a desired color: the one with the least sum of absolute differences
+// of r, g and b, which is returned in diff
+static int GifFindPaletteColor( GifPalette* pPal, int r, int g, int b, int& diff )
+{
+    int bestInd = 1;
+    diff = 1000000;
+#ifdef __SSE2__
+    if(GifGetClosestPaletteColorSse2(pPal, r, g, b, bestInd, diff)) return bestInd;
+#endif
+    GifGetClosestPaletteColor(pPal, r, g, b, bestInd, diff);
+    return bestInd;
+}
+
+// Same, going through the palette's cache
+static int GifMapColor( GifPalette* pPal, GifColorCache* cache, int r, int g, int b, int& diff )
+{
+    uint32_t key = (cache->generation << 24) | ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
+    uint32_t slot = (key * 2654435761u) >> (32 - GifColorCache::kSlotBits);
+    if(cache->keys[slot] == key)
+    {
+        int ind = cache->indices[slot];
+        diff = GifIAbs(r - pPal->r[ind]) + GifIAbs(g - pPal->g[ind]) + GifIAbs(b - pPal->b[ind]);
+        return ind;
+    }
+
+    int ind = GifFindPaletteColor(pPal, r, g, b, diff);
+    cache->keys[slot] = key;
+    cache->indices[slot] = (uint8_t)ind;
+    return ind;
+}
+
 static void GifSwapPixels(uint8_t* image, int pixA, int pixB)
 {
     uint32_t *pA = reinterpret_cast<uint32_t *>(image) + pixA;
@@ -335,10 +468,97 @@ static int GifPickChangedPixels( const uint8_t* lastFrame, uint8_t* frame, int n
     return numChanged;
 }
 
+static bool GifPixelChanged( const uint8_t* lastFrame, const uint8_t* frame )
+{
+    return (lastFrame[0] != frame[0]) || (lastFrame[1] != frame[1]) || (lastFrame[2] != frame[2]);
+}
+
+// Computes bounding box of pixels whose color differs from previous frame, looking only
+// within the area rect holds on entry. Returns false if there are none.
+static bool GifFindChangedRect( const uint8_t* lastFrame, const uint8_t* frame, uint32_t width, GifRect* rect )
+{
+    const uint32_t x1 = rect->left;
+    const uint32_t x2 = rect->left + rect->width;
+    const uint32_t y2 = rect->top + rect->height;
+    uint32_t top = 0;
+    uint32_t left = x2;
+    uint32_t right = x1;
+    uint32_t bottom = 0;
+    bool found = false;
+
+    for(uint32_t y = rect->top; y < y2; ++y)
+    {
+        const uint8_t* last = lastFrame + (size_t)y*width*4;
+        const uint8_t* next = frame + (size_t)y*width*4;
+        uint32_t x = x1;
+        while(x < x2 && !GifPixelChanged(last + x*4, next + x*4)) ++x;
+        if(x == x2) continue;
+
+        if(!found) top = y;
+        found = true;
+        bottom = y;
+        if(x < left) left = x;
+
+        // only the part right of what's already known to have changed needs looking at
+        uint32_t xr = x2-1;
+        while(xr > right && !GifPixelChanged(last + xr*4, next + xr*4)) --xr;
+        if(xr > right) right = xr;
+        if(x > right) right = x;
+    }
+
+    if(!found) return false;
+
+    rect->left = left;
+    rect->top = top;
+    rect->width = right - left + 1;
+    rect->height = bottom - top + 1;
+    return true;
+}
+
+// Checks a sample of the pixels changed within rect against an existing palette,
+// to see if it can be used for the frame instead of building a new one
+static bool GifPaletteFits( GifPalette* pPal, GifColorCache* cache, const uint8_t* lastFrame, const uint8_t* nextFrame, uint32_t width, const GifRect& rect )
+{
+    int64_t totalError = 0;
+    int numSamples = 0;
+    int numBad = 0;
+    // upper bound on the number of samples, for giving up early
+    const int maxSamples = (int)(((rect.width+1)/2) * ((rect.height+1)/2));
+
+    // every other pixel of every other row
+    for(uint32_t y = rect.top; y < rect.top+rect.height; y += 2)
+    {
+        size_t offset = ((size_t)y*width + rect.left)*4;
+        for(uint32_t x = 0; x < rect.width; x += 2, offset += 8)
+        {
+            const uint8_t* next = nextFrame + offset;
+            if(lastFrame && !GifPixelChanged(lastFrame + offset, next)) continue;
+
+            int bestDiff;
+            GifMapColor(pPal, cache, next[0], next[1], next[2], bestDiff);
+            totalError += bestDiff;
+            ++numSamples;
+            if(bestDiff > kGifReuseBadError)
+            {
+                ++numBad;
+                // bail out as soon as the answer is known
+                if(numBad*kGifReuseBadFraction > maxSamples)
+                    return false;
+            }
+        }
+    }
+
+    if(numSamples == 0) return true;
+    return (totalError <= (int64_t)kGifReuseMaxMeanError*numSamples) && (numBad*kGifReuseBadFraction <= numSamples);
+}
+
 // Creates a palette by placing all the image pixels in a k-d tree and then averaging the blocks at the bottom.
 // This is known as the "modified median split" technique
 static void GifMakePalette( const uint8_t* lastFrame, const uint8_t* nextFrame, uint32_t width, uint32_t height, int bitDepth, bool transparent, bool buildForDither, GifPalette* pPal )
 {
+    // Entries and tree nodes with no pixels left to split are never filled in, and they
+    // still end up in the output
+    memset(pPal, 0, sizeof(GifPalette));
     pPal->bitDepth = bitDepth;
 
     // SplitPalette is destructive (it sorts the pixels by color) so
@@ -475,212 +695,242 @@ static void GifDitherImage( const uint8_t* lastFrame, const uint8_t* nextFrame,
     GIF_TEMP_FREE(quantPixels);
 }
 
-// The LZW dictionary is a 256-ary tree constructed as the file is encoded,
-// this is one node
-struct GifLzwNode
+// Output is collected in memory and written out in one go by GifEnd
+typedef std::vector<uint8_t> GifBuffer;
+
+static void GifPut( GifBuffer& out, uint8_t byte )
 {
-    uint16_t m_next[256];
-};
+    out.push_back(byte);
+}
 
-// write a 256-color (8-bit) image palette to the file
-static void GifWritePalette( const GifPalette* pPal, FILE* f )
+static void GifPut16( GifBuffer& out, uint32_t value )
 {
-    fputc(0, f);  // first color: transparency
-    fputc(0, f);
-    fputc(0, f);
+    out.push_back(value & 0xff);
+    out.push_back((value >> 8) & 0xff);
+}
 
-    for(int ii=1; ii<(1 << pPal->bitDepth); ++ii)
-    {
-        uint32_t r = pPal->r[ii];
-        uint32_t g = pPal->g[ii];
-        uint32_t b = pPal->b[ii];
+static void GifPutString( GifBuffer& out, const char* str )
+{
+    out.insert(out.end(), str, str + strlen(str));
+}
+
+// The LZW dictionary maps (prefix code, next palette index) to a code.
+// It is an open addressing hash table that lives as long as the writer. Entries are tagged with
+// a generation number, so clearing the dictionary, which happens at least once per frame, is
+// just a matter of bumping the generation.
+struct GifLzwDict
+{
+    enum {
+        kCodeBits = 12,   // codes never exceed DICT_SIZE, which is below 4096
+        kGenerationBits = 32 - kCodeBits - 8,
+        kSlotBits = 12,   // 4096 slots for at most ~760 entries
+        kSlots = 1 << kSlotBits
+    };
+
+    uint32_t keys[kSlots];     // generation << 20 | prefix << 8 | next
+    uint16_t codes[kSlots];
+    uint32_t generation;
+};
 
-        fputc((int)r, f);
-        fputc((int)g, f);
-        fputc((int)b, f);
+static void GifLzwReset( GifLzwDict& dict )
+{
+    dict.generation = (dict.generation + 1) & ((1u << GifLzwDict::kGenerationBits) - 1);
+    if(dict.generation == 0)
+    {
+        // wrapped around, stale entries could now match
+        memset(dict.keys, 0, sizeof(dict.keys));
+        dict.generation = 1;
     }
 }
 
-// Simple structure to write out the LZW-compressed portion of the image
-// one bit at a time
-struct GifBitStatus
+static uint32_t GifLzwKey( const GifLzwDict& dict, uint32_t prefix, uint32_t next )
 {
-    uint8_t bitIndex;  // how many bits in the partial byte written so far
-    uint8_t byte;      // current partial byte
-
-    uint32_t chunkIndex;
-    uint8_t chunk[256];   // bytes are written in here until we have 256 of them, then written to the file
-};
+    return (dict.generation << (GifLzwDict::kCodeBits + 8)) | (prefix << 8) | next;
+}
 
-// insert a single bit
-static void GifWriteBit( GifBitStatus& stat, uint32_t bit )
+static uint32_t GifLzwSlot( uint32_t key )
 {
-    bit = bit & 1;
-    bit = bit << stat.bitIndex;
-    stat.byte |= bit;
+    return (key * 2654435761u) >> (32 - GifLzwDict::kSlotBits);
+}
 
-    ++stat.bitIndex;
-    if( stat.bitIndex > 7 )
+// Returns code for the prefix followed by next, or 0 if not in the dictionary, in which case
+// slot receives the position for inserting it
+static uint32_t GifLzwFind( const GifLzwDict& dict, uint32_t key, uint32_t& slot )
+{
+    const uint32_t mask = GifLzwDict::kSlots - 1;
+    for(slot = GifLzwSlot(key); ; slot = (slot + 1) & mask)
     {
-        // move the newly-finished byte to the chunk buffer
-        stat.chunk[stat.chunkIndex++] = stat.byte;
-        // and start a new byte
-        stat.bitIndex = 0;
-        stat.byte = 0;
+        uint32_t found = dict.keys[slot];
+        if(found == key) return dict.codes[slot];
+        // anything from an older generation counts as empty
+        if((found >> (GifLzwDict::kCodeBits + 8)) != dict.generation) return 0;
     }
 }
 
-// write all bytes so far to the file
-static void GifWriteChunk( FILE* f, GifBitStatus& stat )
+// write a 256-color (8-bit) image palette to the file
+static void GifWritePalette( const GifPalette* pPal, GifBuffer& out )
 {
-    fputc((int)stat.chunkIndex, f);
-    fwrite(stat.chunk, 1, stat.chunkIndex, f);
-    stat.chunkIndex = 0;
+    GifPut(out, 0);  // first color: transparency
+    GifPut(out, 0);
+    GifPut(out, 0);
+
+    for(int ii=1; ii<(1 << pPal->bitDepth); ++ii)
+    {
+        GifPut(out, pPal->r[ii]);
+        GifPut(out, pPal->g[ii]);
+        GifPut(out, pPal->b[ii]);
+    }
 }
 
-static void GifWriteCode( FILE* f, GifBitStatus& stat, uint32_t code, uint32_t length )
+// Packs LZW codes into bytes, least significant bit first, and groups the bytes into sub-blocks
+// of at most 255 bytes prefixed with their length. Bytes go directly to the output buffer, with
+// the length byte filled in once the sub-block is complete.
+struct GifBitStatus
 {
-    uint8_t value = code << stat.bitIndex;
-    if (stat.bitIndex + length < 8) {
-        stat.byte |= value;
-    } else {
-        stat.chunk[stat.chunkIndex++] = stat.byte | value;
+    uint64_t bits;         // pending bits, not yet written out as bytes
+    uint32_t bitCount;
+    size_t chunkStart;     // position of current sub-block's length byte
+};
 
-        uint8_t part = 8-stat.bitIndex;
-        length -= part;
-        code = code >> part;
-        while (length >= 8) {
-            stat.chunk[stat.chunkIndex++] = code;
+static void GifStartChunk( GifBuffer& out, GifBitStatus& stat )
+{
+    stat.chunkStart = out.size();
+    out.push_back(0);
+}
 
-            code = code >> 8;
-            length -= 8;
-        }
-        stat.byte = code;
-        stat.bitIndex = length;
+static void GifEndChunk( GifBuffer& out, GifBitStatus& stat )
+{
+    out[stat.chunkStart] = (uint8_t)(out.size() - stat.chunkStart - 1);
+}
+
+static void GifWriteCode( GifBuffer& out, GifBitStatus& stat, uint32_t code, uint32_t length )
+{
+    stat.bits |= (uint64_t)code << stat.bitCount;
+    stat.bitCount += length;
+    while(stat.bitCount >= 8)
+    {
+        out.push_back((uint8_t)stat.bits);
+        stat.bits >>= 8;
+        stat.bitCount -= 8;
     }
 
-    if (stat.chunkIndex >= 250)
-        GifWriteChunk(f, stat);
+    // sub-blocks are cut at the same places as the original bit by bit writer did
+    if(out.size() - stat.chunkStart - 1 >= 250)
+    {
+        GifEndChunk(out, stat);
+        GifStartChunk(out, stat);
+    }
 }
 
-// Picks palette colors for the image using simple thresholding, no dithering
-static void GifThresholdImageAndWrite(FILE* f, const uint8_t* lastFrame, const uint8_t* nextFrame, uint8_t* outFrame, uint32_t width, uint32_t height, uint32_t delay, bool transparent, GifPalette* pPal )
+// Picks palette colors for the image using simple thresholding, no dithering.
+// Only the part of the image within rect is written.
+static void GifThresholdImageAndWrite(GifBuffer& out, GifLzwDict& dict, const uint8_t* lastFrame, const uint8_t* nextFrame, uint32_t width, const GifRect& rect, uint32_t delay, bool transparent, GifPalette* pPal, GifColorCache* cache, bool localPalette, size_t* delayPos )
 {
-    enum {left = 0, top = 0};
     // graphics control extension
-    fputc(0x21, f);
-    fputc(0xf9, f);
-    fputc(0x04, f);
+    GifPut(out, 0x21);
+    GifPut(out, 0xf9);
+    GifPut(out, 0x04);
     if (transparent)
-        fputc((2 << 2) + 1, f); // restore to background colour, this frame has transparency
+        GifPut(out, (2 << 2) + 1); // restore to background colour, this frame has transparency
     else
-        fputc(0x05, f); // leave prev frame in place, this frame has transparency
-    fputc(delay & 0xff, f);
-    fputc((delay >> 8) & 0xff, f);
-    fputc(kGifTransIndex, f); // transparent color index
-    fputc(0, f);
-
-    fputc(0x2c, f); // image descriptor block
+        GifPut(out, 0x05); // leave prev frame in place, this frame has transparency
+    *delayPos = out.size();
+    GifPut16(out, delay);
+    GifPut(out, kGifTransIndex); // transparent color index
+    GifPut(out, 0);
 
-    fputc(left & 0xff, f);           // corner of image in canvas space
-    fputc((left >> 8) & 0xff, f);
-    fputc(top & 0xff, f);
-    fputc((top >> 8) & 0xff, f);
+    GifPut(out, 0x2c); // image descriptor block
 
-    fputc(width & 0xff, f);          // width and height of image
-    fputc((width >> 8) & 0xff, f);
-    fputc(height & 0xff, f);
-    fputc((height >> 8) & 0xff, f);
+    GifPut16(out, rect.left);           // corner of image in canvas space
+    GifPut16(out, rect.top);
+    GifPut16(out, rect.width);          // width and height of image
+    GifPut16(out, rect.height);
 
-    //fputc(0, f); // no local color table, no transparency
-    //fputc(0x80, f); // no local color table, but transparency
-
-    fputc(0x80 + pPal->bitDepth-1, f); // local color table present, 2 ^ bitDepth entries
-    GifWritePalette(pPal, f);
+    if(localPalette)
+    {
+        GifPut(out, 0x80 + pPal->bitDepth-1); // local color table present, 2 ^ bitDepth entries
+        GifWritePalette(pPal, out);
+    }
+    else
+        GifPut(out, 0); // no local color table, global one is used
 
     const int minCodeSize = pPal->bitDepth;
     const uint32_t clearCode = 1 << pPal->bitDepth;
 
-    fputc(minCodeSize, f); // min code size 8 bits
+    GifPut(out, minCodeSize); // min code size 8 bits
 
     enum {DICT_SIZE = 1024};
-    GifLzwNode* codetree = (GifLzwNode*)GIF_TEMP_MALLOC(sizeof(GifLzwNode)*DICT_SIZE);
 
-    memset(codetree, 0, sizeof(GifLzwNode)*DICT_SIZE);
+    GifLzwReset(dict);
     int32_t curCode = -1;
     uint32_t codeSize = (uint32_t)minCodeSize + 1;
     uint32_t maxCode = clearCode+1;
 
     GifBitStatus stat;
-    stat.byte = 0;
-    stat.bitIndex = 0;
-    stat.chunkIndex = 0;
-
-    GifWriteCode(f, stat, clearCode, codeSize);  // start with a fresh LZW dictionary
-
-    uint32_t numPixels = width*height;
-    for( uint32_t ii=0; ii<numPixels; ++ii )
+    stat.bits = 0;
+    stat.bitCount = 0;
+    GifStartChunk(out, stat);
+
+    GifWriteCode(out, stat, clearCode, codeSize);  // start with a fresh LZW dictionary
+
+    const uint32_t numPixels = rect.width*rect.height;
+    const size_t rowStart = ((size_t)rect.top*width + rect.left)*4;
+    const size_t rowSkip = (size_t)(width - rect.width)*4;
+    if(lastFrame) lastFrame += rowStart;
+    nextFrame += rowStart;
+    for( uint32_t ii=0, x=0; ii<numPixels; ++ii )
     {
         uint8_t nextValue;
         if (transparent && (nextFrame[3] == 0))
         {
-            outFrame[0] = nextFrame[0];
-            outFrame[1] = nextFrame[1];
-            outFrame[2] = nextFrame[2];
             nextValue = kGifTransIndex;
         }
         // For non-transparet background:
         // if a previous color is available, and it matches the current color,
         // set the pixel to transparent
-        else if(!transparent && lastFrame &&
-           lastFrame[0] == nextFrame[0] &&
-           lastFrame[1] == nextFrame[1] &&
-           lastFrame[2] == nextFrame[2])
+        else if(!transparent && lastFrame && !GifPixelChanged(lastFrame, nextFrame))
         {
-            outFrame[0] = lastFrame[0];
-            outFrame[1] = lastFrame[1];
-            outFrame[2] = lastFrame[2];
             nextValue = kGifTransIndex;
         }
         else
         {
             // palettize the pixel
-            int32_t bestDiff = 1000000;
-            int32_t bestInd = 1;
-            GifGetClosestPaletteColor(pPal, nextFrame[0], nextFrame[1], nextFrame[2], bestInd, bestDiff);
-
-            // Write the resulting color to the output buffer
-            outFrame[0] = pPal->r[bestInd];
-            outFrame[1] = pPal->g[bestInd];
-            outFrame[2] = pPal->b[bestInd];
-            nextValue = bestInd;
+            int bestDiff;
+            nextValue = (uint8_t)GifMapColor(pPal, cache, nextFrame[0], nextFrame[1], nextFrame[2], bestDiff);
         }
 
         if(lastFrame) lastFrame += 4;
-        outFrame += 4;
         nextFrame += 4;
-
-        // "loser mode" - no compression, every single code is followed immediately by a clear
-        //WriteCode( f, stat, nextValue, codeSize );
-        //WriteCode( f, stat, 256, codeSize );
+        if(++x == rect.width)
+        {
+            x = 0;
+            if(lastFrame) lastFrame += rowSkip;
+            nextFrame += rowSkip;
+        }
 
         if( curCode < 0 )
         {
             // first value in a new run
             curCode = nextValue;
+            continue;
         }
-        else if( codetree[curCode].m_next[nextValue] )
+
+        uint32_t slot;
+        uint32_t key = GifLzwKey(dict, (uint32_t)curCode, nextValue);
+        uint32_t code = GifLzwFind(dict, key, slot);
+        if( code )
         {
             // current run already in the dictionary
-            curCode = codetree[curCode].m_next[nextValue];
+            curCode = (int32_t)code;
         }
         else
         {
             // finish the current run, write a code
-            GifWriteCode(f, stat, (uint32_t)curCode, codeSize);
+            GifWriteCode(out, stat, (uint32_t)curCode, codeSize);
 
             // insert the new run into the dictionary
-            codetree[curCode].m_next[nextValue] = (uint16_t)++maxCode;
+            dict.keys[slot] = key;
+            dict.codes[slot] = (uint16_t)++maxCode;
 
             if( maxCode >= (1ul << codeSize) )
             {
@@ -691,9 +941,9 @@ static void GifThresholdImageAndWrite(FILE* f, const uint8_t* lastFrame, const u
             if( maxCode == DICT_SIZE-1 )
             {
                 // the dictionary is full, clear it out and begin anew
-                GifWriteCode(f, stat, clearCode, codeSize); // clear tree
+                GifWriteCode(out, stat, clearCode, codeSize); // clear tree
 
-                memset(codetree, 0, sizeof(GifLzwNode)*DICT_SIZE);
+                GifLzwReset(dict);
                 codeSize = (uint32_t)(minCodeSize + 1);
                 maxCode = clearCode+1;
             }
@@ -703,78 +953,147 @@ static void GifThresholdImageAndWrite(FILE* f, const uint8_t* lastFrame, const u
     }
 
     // compression footer
-    GifWriteCode(f, stat, (uint32_t)curCode, codeSize);
-    GifWriteCode(f, stat, clearCode, codeSize);
-    GifWriteCode(f, stat, clearCode + 1, (uint32_t)minCodeSize + 1);
-
-    // write out the last partial chunk
-    while( stat.bitIndex ) GifWriteBit(stat, 0);
-    if( stat.chunkIndex ) GifWriteChunk(f, stat);
+    GifWriteCode(out, stat, (uint32_t)curCode, codeSize);
+    GifWriteCode(out, stat, clearCode, codeSize);
+    GifWriteCode(out, stat, clearCode + 1, (uint32_t)minCodeSize + 1);
 
-    fputc(0, f); // image block terminator
-
-    GIF_TEMP_FREE(codetree);
+    // write out the last partial byte and sub-block
+    if(stat.bitCount) out.push_back((uint8_t)stat.bits);
+    if(out.size() - stat.chunkStart > 1)
+    {
+        GifEndChunk(out, stat);
+        GifPut(out, 0); // image block terminator
+    }
+    else
+        out.back() = 0; // empty sub-block is the image block terminator
 }
 
 struct GifWriter
 {
+    // NULL if the GIF is only built in memory
     FILE* f;
+    bool open;
+    GifBuffer out;
+    // previous frame as given, not as displayed: pixels that haven't changed in the source are
+    // left alone even if they were approximated by the palette in effect at the time
     std::unique_ptr<uint8_t[]> oldImage;
+    std::unique_ptr<GifLzwDict> dict;
+    // lookup caches for globalPal and lastPal
+    std::unique_ptr<GifColorCache> globalCache;
+    std::unique_ptr<GifColorCache> lastCache;
     bool firstFrame;
+
+    uint32_t width, height, loopDelay;
+    GifPalette globalPal;
+    GifPalette lastPal;
+    bool lastPalIsGlobal;
+
+    // where to patch the delay of last frame if the next one turns out identical
+    size_t lastDelayPos;
+    uint32_t lastDelay;
 };
 
+static void GifWriteHeader( GifWriter* writer, const GifPalette* globalPal )
+{
+    GifBuffer& out = writer->out;
+    GifPutString(out, "GIF89a");
+
+    // screen descriptor
+    GifPut16(out, writer->width);
+    GifPut16(out, writer->height);
+
+    if(globalPal)
+    {
+        GifPut(out, 0xf0 + globalPal->bitDepth-1);  // global color table of 2 ^ bitDepth entries
+        GifPut(out, 0);     // background color
+        GifPut(out, 0);     // pixels are square (we need to specify this because it's 1989)
+        GifWritePalette(globalPal, out);
+    }
+    else
+    {
+        GifPut(out, 0xf0);  // there is an unsorted global color table of 2 entries
+        GifPut(out, 0);     // background color
+        GifPut(out, 0);     // pixels are square (we need to specify this because it's 1989)
+
+        // now the "global" palette (really just a dummy palette)
+        // color 0: black
+        GifPut(out, 0);
+        GifPut(out, 0);
+        GifPut(out, 0);
+        // color 1: also black
+        GifPut(out, 0);
+        GifPut(out, 0);
+        GifPut(out, 0);
+    }
+
+    if( writer->loopDelay != 0 )
+    {
+        // animation header
+        GifPut(out, 0x21); // extension
+        GifPut(out, 0xff); // application specific
+        GifPut(out, 11); // length 11
+        GifPutString(out, "NETSCAPE2.0"); // yes, really
+        GifPut(out, 3); // 3 bytes of NETSCAPE2.0 data
+
+        GifPut(out, 1); // JUST BECAUSE
+        GifPut(out, 0); // loop infinitely (byte 0)
+        GifPut(out, 0); // loop infinitely (byte 1)
+
+        GifPut(out, 0); // block terminator
+    }
+}
+
 // Creates a gif file.
 // The input GIFWriter is assumed to be uninitialized.
 // The delay value is the time between frames in hundredths of a second - note that not all viewers pay much attention to this value.
+// Header is only written together with the first frame, because first frame's palette becomes the global one.
+// With fd < 0, nothing is written out and the result is left in writer->out after GifEnd.
 static bool GifBegin( GifWriter* writer, int fd, uint32_t width, uint32_t height, uint32_t delay, int32_t bitDepth = 8, bool dither = false )
 {
     (void)bitDepth; (void)dither; // Mute "Unused argument" warnings
-    writer->f = fdopen(fd, "wb");
-    if(!writer->f) return false;
+    writer->f = NULL;
+    if(fd >= 0)
+    {
+        writer->f = fdopen(fd, "wb");
+        if(!writer->f) return false;
+    }
 
+    writer->open = true;
     writer->firstFrame = true;
+    writer->width = width;
+    writer->height = height;
+    writer->loopDelay = delay;
+    writer->lastPalIsGlobal = false;
+    writer->lastDelayPos = 0;
+    writer->lastDelay = 0;
 
     // allocate
     writer->oldImage = std::unique_ptr<uint8_t[]>(new uint8_t[width*height*4]);
+    writer->dict = std::unique_ptr<GifLzwDict>(new GifLzwDict);
+    memset(writer->dict->keys, 0, sizeof(writer->dict->keys));
+    writer->dict->generation = 0;
+    writer->globalCache = std::unique_ptr<GifColorCache>(new GifColorCache);
+    writer->lastCache = std::unique_ptr<GifColorCache>(new GifColorCache);
+    memset(writer->globalCache.get(), 0, sizeof(GifColorCache));
+    memset(writer->lastCache.get(), 0, sizeof(GifColorCache));
+    GifColorCacheReset(*writer->globalCache);
+    GifColorCacheReset(*writer->lastCache);
+    writer->out.clear();
+    // typical sticker frame compresses into about 5 KB
+    writer->out.reserve(65536);
 
-    fputs("GIF89a", writer->f);
-
-    // screen descriptor
-    fputc(width & 0xff, writer->f);
-    fputc((width >> 8) & 0xff, writer->f);
-    fputc(height & 0xff, writer->f);
-    fputc((height >> 8) & 0xff, writer->f);
-
-    fputc(0xf0, writer->f);  // there is an unsorted global color table of 2 entries
-    fputc(0, writer->f);     // background color
-    fputc(0, writer->f);     // pixels are square (we need to specify this because it's 1989)
-
-    // now the "global" palette (really just a dummy palette)
-    // color 0: black
-    fputc(0, writer->f);
-    fputc(0, writer->f);
-    fputc(0, writer->f);
-    // color 1: also black
-    fputc(0, writer->f);
-    fputc(0, writer->f);
-    fputc(0, writer->f);
-
-    if( delay != 0 )
-    {
-        // animation header
-        fputc(0x21, writer->f); // extension
-        fputc(0xff, writer->f); // application specific
-        fputc(11, writer->f); // length 11
-        fputs("NETSCAPE2.0", writer->f); // yes, really
-        fputc(3, writer->f); // 3 bytes of NETSCAPE2.0 data
-
-        fputc(1, writer->f); // JUST BECAUSE
-        fputc(0, writer->f); // loop infinitely (byte 0)
-        fputc(0, writer->f); // loop infinitely (byte 1)
+    return true;
+}
 
-        fputc(0, writer->f); // block terminator
-    }
+// Makes the last written frame last longer. Returns false if that's not possible.
+static bool GifExtendLastFrame( GifWriter* writer, uint32_t delay )
+{
+    uint32_t newDelay = writer->lastDelay + delay;
+    if(newDelay > 0xffff) return false;
 
+    writer->out[writer->lastDelayPos] = newDelay & 0xff;
+    writer->out[writer->lastDelayPos+1] = (newDelay >> 8) & 0xff;
+    writer->lastDelay = newDelay;
     return true;
 }
 
@@ -782,40 +1101,114 @@ static bool GifBegin( GifWriter* writer, int fd, uint32_t width, uint32_t height
 // The GIFWriter should have been created by GIFBegin.
 // AFAIK, it is legal to use different bit depths for different frames of an image -
 // this may be handy to save bits in animations that don't change much.
-static bool GifWriteFrame( GifWriter* writer, const uint8_t* image, uint32_t width, uint32_t height, uint32_t delay, bool transparent, int bitDepth = 8, bool dither = false )
+// If changed isn't NULL, image is known to be the same as the previous one outside of it.
+static bool GifWriteFrame( GifWriter* writer, const uint8_t* image, uint32_t width, uint32_t height, uint32_t delay, bool transparent, int bitDepth = 8, bool dither = false, const GifRect* changed = NULL )
 {
-    if(!writer->f) return false;
+    if(!writer->open) return false;
 
     const uint8_t* oldImage = writer->firstFrame? NULL : writer->oldImage.get();
-    writer->firstFrame = false;
-
-    GifPalette pal;
-    GifMakePalette((dither? NULL : oldImage), image, width, height, bitDepth, transparent, dither, &pal);
 
     if(dither) {
         // Broken - no output
+        GifPalette pal;
+        GifMakePalette(NULL, image, width, height, bitDepth, transparent, dither, &pal);
         GifDitherImage(oldImage, image, writer->oldImage.get(), width, height, &pal);
         return false;
-    } else
-        GifThresholdImageAndWrite(writer->f, oldImage, image, writer->oldImage.get(), width, height, delay, transparent, &pal);
+    }
+
+    GifRect rect = {0, 0, width, height};
+    if(oldImage && !transparent && changed) rect = *changed;
+    if(oldImage && !transparent && (!rect.width || !rect.height || !GifFindChangedRect(oldImage, image, width, &rect)))
+    {
+        if(GifExtendLastFrame(writer, delay)) return true;
+        // Can't extend previous frame, so write a single unchanged pixel instead
+        rect.left = rect.top = 0;
+        rect.width = rect.height = 1;
+    }
+
+    GifColorCache* globalCache = writer->globalCache.get();
+    GifColorCache* lastCache = writer->lastCache.get();
+
+    GifPalette* pal;
+    GifColorCache* cache;
+    bool localPalette = true;
+    GifPalette newPal;
+    if(writer->firstFrame)
+    {
+        GifMakePalette(NULL, image, width, height, bitDepth, transparent, false, &writer->globalPal);
+        GifWriteHeader(writer, &writer->globalPal);
+        pal = &writer->globalPal;
+        cache = globalCache;
+        localPalette = false;
+        writer->lastPalIsGlobal = true;
+    }
+    else
+    {
+        // Last palette is the likeliest to fit, global one is only tried once that stops working
+        const uint8_t* lastFrame = transparent ? NULL : oldImage;
+        if(!writer->lastPalIsGlobal && writer->lastPal.bitDepth == bitDepth &&
+           GifPaletteFits(&writer->lastPal, lastCache, lastFrame, image, width, rect))
+        {
+            pal = &writer->lastPal;
+            cache = lastCache;
+        }
+        else if(writer->globalPal.bitDepth == bitDepth && GifPaletteFits(&writer->globalPal, globalCache, lastFrame, image, width, rect))
+        {
+            pal = &writer->globalPal;
+            cache = globalCache;
+            localPalette = false;
+            writer->lastPalIsGlobal = true;
+        }
+        else
+        {
+            GifMakePalette(lastFrame, image, width, height, bitDepth, transparent, false, &newPal);
+            writer->lastPal = newPal;
+            writer->lastPalIsGlobal = false;
+            GifColorCacheReset(*writer->lastCache);
+            pal = &writer->lastPal;
+            cache = lastCache;
+        }
+    }
+
+    GifThresholdImageAndWrite(writer->out, *writer->dict, transparent ? NULL : oldImage, image, width, rect, delay, transparent, pal, cache, localPalette, &writer->lastDelayPos);
+    writer->lastDelay = delay;
+    writer->firstFrame = false;
+    // the rest is the same already
+    if(!transparent)
+        for(uint32_t y = rect.top; y < rect.top + rect.height; ++y)
+            memcpy(writer->oldImage.get() + ((size_t)y*width + rect.left)*4,
+                   image + ((size_t)y*width + rect.left)*4, (size_t)rect.width*4);
 
     return true;
 }
 
-// Writes the EOF code, closes the file handle, and frees temp memory used by a GIF.
+// Writes the EOF code, writes everything out, closes the file handle, and frees temp memory used by a GIF.
 // Many if not most viewers will still display a GIF properly if the EOF code is missing,
 // but it's still a good idea to write it out.
 static bool GifEnd( GifWriter* writer )
 {
-    if(!writer->f) return false;
+    if(!writer->open) return false;
 
-    fputc(0x3b, writer->f); // end of file
-    fclose(writer->f);
+    if(writer->firstFrame)
+        GifWriteHeader(writer, NULL);
+    GifPut(writer->out, 0x3b); // end of file
 
-    writer->f = NULL;
+    bool success = true;
+    if(writer->f)
+    {
+        success = (fwrite(writer->out.data(), 1, writer->out.size(), writer->f) == writer->out.size());
+        if(fclose(writer->f) != 0) success = false;
+        writer->f = NULL;
+        GifBuffer().swap(writer->out);
+    }
+
+    writer->open = false;
     writer->oldImage.reset();
+    writer->dict.reset();
+    writer->globalCache.reset();
+    writer->lastCache.reset();
 
-    return true;
+    return success;
 }
 
 #endif
@@ -0,0 +1,147 @@
+#include "html-text.h"
+#include <algorithm>
+#include <string.h>
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#define HTML_TEXT_SSE2
+#include <emmintrin.h>
+#endif
+
+static inline bool isEscapeCandidate(unsigned char c)
+{
+    return (c == '&') || (c == '<') || (c == '>') || (c == '"');
+}
+
+static inline bool isMarkupCandidate(unsigned char c)
+{
+    return (c < 0x20) || (c == '&') || (c == '<');
+}
+
+#ifdef HTML_TEXT_SSE2
+
+// Bytes no greater than limit, as unsigned
+static inline __m128i atMost(__m128i bytes, char limit)
+{
+    return _mm_cmpeq_epi8(_mm_min_epu8(bytes, _mm_set1_epi8(limit)), bytes);
+}
+
+static inline __m128i equal(__m128i bytes, char c)
+{
+    return _mm_cmpeq_epi8(bytes, _mm_set1_epi8(c));
+}
+
+// Both scanners check 16 bytes at a time and leave the rest, and whatever they stop at, to
+// scalar code
+static const char *skipEscapeFree(const char *p, const char *end)
+{
+    for (; end - p >= 16; p += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i found = _mm_or_si128(_mm_or_si128(equal(bytes, '&'), equal(bytes, '<')),
+                                     _mm_or_si128(equal(bytes, '>'), equal(bytes, '"')));
+        int mask = _mm_movemask_epi8(found);
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return p;
+}
+
+static const char *skipMarkupFree(const char *p, const char *end)
+{
+    for (; end - p >= 16; p += 16) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i found = _mm_or_si128(atMost(bytes, 0x1f),
+                                     _mm_or_si128(equal(bytes, '&'), equal(bytes, '<')));
+        int mask = _mm_movemask_epi8(found);
+        if (mask)
+            return p + __builtin_ctz(mask);
+    }
+    return p;
+}
+
+#else
+
+static const char *skipEscapeFree(const char *p, const char *end)
+{
+    return p;
+}
+
+static const char *skipMarkupFree(const char *p, const char *end)
+{
+    return p;
+}
+
+#endif
+
+static inline char *writeEntity(char *out, const char *entity, size_t length)
+{
+    memcpy(out, entity, length);
+    return out + length;
+}
+
+// No byte takes more than this once escaped: " is &quot;
+constexpr size_t MAX_ESCAPED_LENGTH = 6;
+
+void appendEscapedHtml(std::string &output, const char *text, size_t length)
+{
+    // Output is written through a pointer rather than appended to piece by piece, making room in
+    // advance for the next run of bytes and one escaped character. Escaping rarely grows text by
+    // much, so the first guess normally does.
+    size_t written = output.size();
+    output.resize(written + length + length / 8 + MAX_ESCAPED_LENGTH);
+    char *out = &output[written];
+    auto makeRoom = [&output, &out](size_t bytes) {
+        size_t written = out - output.data();
+        if (output.size() - written < bytes) {
+            output.resize(std::max(output.size() * 2, written + bytes));
+            out = &output[written];
+        }
+    };
+
+    const char *end = text + length;
+    const char *p   = text;
+    while (p != end) {
+        const char *runEnd = skipEscapeFree(p, end);
+        while ((runEnd != end) && !isEscapeCandidate(*runEnd))
+            runEnd++;
+        makeRoom(runEnd - p + MAX_ESCAPED_LENGTH);
+        memcpy(out, p, runEnd - p);
+        out += runEnd - p;
+        if (runEnd == end)
+            break;
+
+        p = runEnd;
+        switch (*p) {
+        case '&':
+            out = writeEntity(out, "&amp;", 5);
+            break;
+        case '<':
+            out = writeEntity(out, "&lt;", 4);
+            break;
+        case '>':
+            out = writeEntity(out, "&gt;", 4);
+            break;
+        case '"':
+            out = writeEntity(out, "&quot;", 6);
+            break;
+        }
+        p++;
+    }
+
+    output.resize(out - output.data());
+}
+
+std::string escapeHtml(const char *text, size_t length)
+{
+    std::string result;
+    appendEscapedHtml(result, text, length);
+    return result;
+}
+
+bool isPlainHtml(const char *text, size_t length)
+{
+    const char *end = text + length;
+    for (const char *p = skipMarkupFree(text, end); p != end; p++)
+        if (isMarkupCandidate(*p))
+            return false;
+    return true;
+}
@@ -0,0 +1,21 @@
+#ifndef _HTML_TEXT_H
+#define _HTML_TEXT_H
+
+// Conversion between plain message text, as Telegram has it, and HTML, as libpurple has it.
+// Nothing here touches libpurple, so these can be tested and benchmarked on their own.
+
+#include <string>
+#include <stddef.h>
+
+// Appends text, which must be valid UTF-8, escaped exactly like purple_markup_escape_text does:
+// &, <, > and " become entities and everything else, control characters included, is left as it
+// is. Runs of bytes that need no escaping are copied in one go.
+void        appendEscapedHtml(std::string &output, const char *text, size_t length);
+std::string escapeHtml(const char *text, size_t length);
+
+// Whether text comes out of purple_markup_strip_html followed by purple_unescape_html unchanged,
+// so that both can be skipped. Holds for text without tags, entities or control characters
+// (stripping turns line breaks and tabs into spaces).
+bool        isPlainHtml(const char *text, size_t length);
+
+#endif
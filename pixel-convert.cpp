@@ -0,0 +1,192 @@
+#include "pixel-convert.h"
+
+// Vector kernels must reproduce scalar float arithmetic bit for bit, which only holds when scalar
+// code uses SSE rather than x87 as well
+#if defined(__x86_64__) && defined(__GNUC__)
+#define PIXEL_CONVERT_X86
+#include <immintrin.h>
+#endif
+
+static void argbToRgbaScalar(uint32_t *pixels, size_t count, RgbColor background, bool transparent)
+{
+    uint8_t *buffer = reinterpret_cast<uint8_t *>(pixels);
+    size_t totalBytes = count * 4;
+
+    for (size_t i = 0; i < totalBytes; i += 4) {
+        unsigned char a = buffer[i+3];
+        // compute only if alpha is non zero
+        if (a) {
+            unsigned char r = buffer[i+2];
+            unsigned char g = buffer[i+1];
+            unsigned char b = buffer[i];
+
+            if (!transparent && (a != 255)) { //un premultiply
+                unsigned char r2 = (unsigned char) ((float) background.r * ((float) (255 - a) / 255));
+                unsigned char g2 = (unsigned char) ((float) background.g * ((float) (255 - a) / 255));
+                unsigned char b2 = (unsigned char) ((float) background.b * ((float) (255 - a) / 255));
+                buffer[i] = r + r2;
+                buffer[i+1] = g + g2;
+                buffer[i+2] = b + b2;
+            } else {
+                // only swizzle r and b
+                buffer[i] = r;
+                buffer[i+2] = b;
+            }
+        } else {
+            buffer[i+2] = background.b;
+            buffer[i+1] = background.g;
+            buffer[i] = background.r;
+        }
+    }
+}
+
+#ifdef PIXEL_CONVERT_X86
+
+static inline uint32_t packBackground(RgbColor background)
+{
+    return background.r | (background.g << 8) | (background.b << 16);
+}
+
+// Processes 4 pixels at a time. Per pixel:
+//   alpha == 0: background
+//   otherwise:  swizzled pixel + background * (255 - alpha) / 255 (wrapping byte-wise add, like
+//               scalar code), where the second term is zero for alpha == 255 or if transparent
+static void argbToRgbaSse2(uint32_t *pixels, size_t count, RgbColor background, bool transparent)
+{
+    const __m128i lowByte    = _mm_set1_epi32(0xff);
+    const __m128i greenAlpha = _mm_set1_epi32(0xff00ff00);
+    const __m128i opaque     = _mm_set1_epi32(0xff);
+    const __m128i bgPacked   = _mm_set1_epi32(packBackground(background));
+    const __m128  bgR        = _mm_set1_ps(background.r);
+    const __m128  bgG        = _mm_set1_ps(background.g);
+    const __m128  bgB        = _mm_set1_ps(background.b);
+    const __m128  divisor    = _mm_set1_ps(255);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i *p     = reinterpret_cast<__m128i *>(pixels + i);
+        __m128i  argb  = _mm_loadu_si128(p);
+        __m128i  alpha = _mm_srli_epi32(argb, 24);
+        __m128i  rgba  = _mm_or_si128(_mm_and_si128(argb, greenAlpha),
+                                      _mm_or_si128(_mm_and_si128(_mm_srli_epi32(argb, 16), lowByte),
+                                                   _mm_slli_epi32(_mm_and_si128(argb, lowByte), 16)));
+        __m128i  isTransparent = _mm_cmpeq_epi32(alpha, _mm_setzero_si128());
+
+        // Opaque and fully transparent pixels are most common, skip float math if that's all there is
+        __m128i  isOpaque = _mm_cmpeq_epi32(alpha, opaque);
+        if (!transparent && (_mm_movemask_epi8(_mm_or_si128(isTransparent, isOpaque)) != 0xffff)) {
+            __m128  factor = _mm_div_ps(_mm_cvtepi32_ps(_mm_sub_epi32(opaque, alpha)), divisor);
+            __m128i r2     = _mm_cvttps_epi32(_mm_mul_ps(bgR, factor));
+            __m128i g2     = _mm_cvttps_epi32(_mm_mul_ps(bgG, factor));
+            __m128i b2     = _mm_cvttps_epi32(_mm_mul_ps(bgB, factor));
+            __m128i bg     = _mm_or_si128(r2, _mm_or_si128(_mm_slli_epi32(g2, 8), _mm_slli_epi32(b2, 16)));
+            rgba = _mm_add_epi8(rgba, bg);
+        }
+
+        rgba = _mm_or_si128(_mm_and_si128(isTransparent, bgPacked), _mm_andnot_si128(isTransparent, rgba));
+        _mm_storeu_si128(p, rgba);
+    }
+
+    argbToRgbaScalar(pixels + i, count - i, background, transparent);
+}
+
+__attribute__((target("avx2")))
+static void argbToRgbaAvx2(uint32_t *pixels, size_t count, RgbColor background, bool transparent)
+{
+    const __m256i lowByte    = _mm256_set1_epi32(0xff);
+    const __m256i greenAlpha = _mm256_set1_epi32(0xff00ff00);
+    const __m256i opaque     = _mm256_set1_epi32(0xff);
+    const __m256i bgPacked   = _mm256_set1_epi32(packBackground(background));
+    const __m256  bgR        = _mm256_set1_ps(background.r);
+    const __m256  bgG        = _mm256_set1_ps(background.g);
+    const __m256  bgB        = _mm256_set1_ps(background.b);
+    const __m256  divisor    = _mm256_set1_ps(255);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i *p     = reinterpret_cast<__m256i *>(pixels + i);
+        __m256i  argb  = _mm256_loadu_si256(p);
+        __m256i  alpha = _mm256_srli_epi32(argb, 24);
+        __m256i  rgba  = _mm256_or_si256(_mm256_and_si256(argb, greenAlpha),
+                                         _mm256_or_si256(_mm256_and_si256(_mm256_srli_epi32(argb, 16), lowByte),
+                                                         _mm256_slli_epi32(_mm256_and_si256(argb, lowByte), 16)));
+        __m256i  isTransparent = _mm256_cmpeq_epi32(alpha, _mm256_setzero_si256());
+
+        __m256i  isOpaque = _mm256_cmpeq_epi32(alpha, opaque);
+        if (!transparent && (_mm256_movemask_epi8(_mm256_or_si256(isTransparent, isOpaque)) != -1)) {
+            __m256  factor = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(opaque, alpha)), divisor);
+            __m256i r2     = _mm256_cvttps_epi32(_mm256_mul_ps(bgR, factor));
+            __m256i g2     = _mm256_cvttps_epi32(_mm256_mul_ps(bgG, factor));
+            __m256i b2     = _mm256_cvttps_epi32(_mm256_mul_ps(bgB, factor));
+            __m256i bg     = _mm256_or_si256(r2, _mm256_or_si256(_mm256_slli_epi32(g2, 8),
+                                                                 _mm256_slli_epi32(b2, 16)));
+            rgba = _mm256_add_epi8(rgba, bg);
+        }
+
+        rgba = _mm256_blendv_epi8(rgba, bgPacked, isTransparent);
+        _mm256_storeu_si256(p, rgba);
+    }
+
+    argbToRgbaSse2(pixels + i, count - i, background, transparent);
+}
+
+#endif
+
+bool isPixelKernelSupported(PixelKernel kernel)
+{
+    switch (kernel) {
+    case PixelKernel::Scalar:
+        return true;
+#ifdef PIXEL_CONVERT_X86
+    case PixelKernel::Sse2:
+        return true;
+    case PixelKernel::Avx2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+PixelKernel getBestPixelKernel()
+{
+    static const PixelKernel best = isPixelKernelSupported(PixelKernel::Avx2) ? PixelKernel::Avx2 :
+                                    isPixelKernelSupported(PixelKernel::Sse2) ? PixelKernel::Sse2 :
+                                                                                PixelKernel::Scalar;
+    return best;
+}
+
+const char *getPixelKernelName(PixelKernel kernel)
+{
+    switch (kernel) {
+    case PixelKernel::Scalar:
+        return "scalar";
+    case PixelKernel::Sse2:
+        return "sse2";
+    case PixelKernel::Avx2:
+        return "avx2";
+    }
+    return "";
+}
+
+void argbToRgba(PixelKernel kernel, uint32_t *pixels, size_t count, RgbColor background,
+                bool transparent)
+{
+    switch (kernel) {
+#ifdef PIXEL_CONVERT_X86
+    case PixelKernel::Sse2:
+        argbToRgbaSse2(pixels, count, background, transparent);
+        break;
+    case PixelKernel::Avx2:
+        argbToRgbaAvx2(pixels, count, background, transparent);
+        break;
+#endif
+    default:
+        argbToRgbaScalar(pixels, count, background, transparent);
+    }
+}
+
+void argbToRgba(uint32_t *pixels, size_t count, RgbColor background, bool transparent)
+{
+    argbToRgba(getBestPixelKernel(), pixels, count, background, transparent);
+}
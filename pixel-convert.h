@@ -0,0 +1,32 @@
+#ifndef _PIXEL_CONVERT_H
+#define _PIXEL_CONVERT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Conversion of premultiplied ARGB32, as rendered by rlottie, into RGBA byte order expected by
+// GIF encoder. Vectorized versions give exactly the same result as the scalar one.
+
+enum class PixelKernel {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+struct RgbColor {
+    uint8_t r, g, b;
+};
+
+// Whether the kernel is compiled in and supported by the CPU
+bool        isPixelKernelSupported(PixelKernel kernel);
+PixelKernel getBestPixelKernel();
+const char *getPixelKernelName(PixelKernel kernel);
+
+// Fully transparent pixels are replaced with background. Other pixels are swizzled and, unless
+// transparent is true, composited onto background. Alpha channel is left as it is.
+void argbToRgba(PixelKernel kernel, uint32_t *pixels, size_t count, RgbColor background,
+                bool transparent);
+// Same with the best kernel for this CPU
+void argbToRgba(uint32_t *pixels, size_t count, RgbColor background, bool transparent);
+
+#endif
@@ -124,6 +124,44 @@ unsigned getAutoDownloadLimitKb(PurpleAccount *account)
     return floorf(dlLimit*1024);
 }
 
+unsigned getWorkerThreadCount(PurpleAccount *account)
+{
+    const char *countStr = purple_account_get_string(account, AccountOptions::WorkerThreads,
+                                                     AccountOptions::WorkerThreadsDefault);
+    char *endptr;
+    long count = strtol(countStr ? countStr : "", &endptr, 10);
+
+    // Zero means automatic. Any more than this would only make stickers fight each other for CPU.
+    if ((*endptr != '\0') || (count < 0) || (count > 64)) {
+        purple_debug_warning(config::pluginId, "Invalid worker thread count '%s', using default\n",
+                             countStr ? countStr : "");
+        purple_account_set_string(account, AccountOptions::WorkerThreads,
+                                  AccountOptions::WorkerThreadsDefault);
+        count = 0;
+    }
+
+    return count;
+}
+
+// In megabytes
+unsigned getStickerCacheSize(PurpleAccount *account)
+{
+    const char *sizeStr = purple_account_get_string(account, AccountOptions::StickerCacheSize,
+                                                    AccountOptions::StickerCacheSizeDefault);
+    char *endptr;
+    long size = strtol(sizeStr ? sizeStr : "", &endptr, 10);
+
+    if ((*endptr != '\0') || (size < 0) || (size > 1024)) {
+        purple_debug_warning(config::pluginId, "Invalid sticker cache size '%s', using default\n",
+                             sizeStr ? sizeStr : "");
+        purple_account_set_string(account, AccountOptions::StickerCacheSize,
+                                  AccountOptions::StickerCacheSizeDefault);
+        size = atoi(AccountOptions::StickerCacheSizeDefault);
+    }
+
+    return size;
+}
+
 bool isSizeWithinLimit(unsigned size, unsigned limit)
 {
     return (limit == 0) || (size <= limit);
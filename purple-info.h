@@ -40,6 +40,16 @@ namespace AccountOptions {
     constexpr gboolean    EnableSecretChatsDefault   = TRUE;
     constexpr const char *AnimatedStickers           = "animated-stickers";
     constexpr gboolean    AnimatedStickersDefault    = TRUE;
+    constexpr const char *StickerQuality             = "animated-sticker-quality";
+    constexpr const char *StickerQualityHigh         = "high";
+    constexpr const char *StickerQualityMedium       = "medium";
+    constexpr const char *StickerQualityLow          = "low";
+    constexpr const char *StickerQualityDefault      = StickerQualityHigh;
+    constexpr const char *StickerFormat              = "animated-sticker-format";
+    constexpr const char *StickerFormatGif           = "gif";
+    constexpr const char *StickerFormatWebp          = "webp";
+    constexpr const char *StickerFormatApng          = "apng";
+    constexpr const char *StickerFormatDefault       = StickerFormatGif;
     constexpr const char *ShowSelfDestruct           = "show-self-destruct";
     constexpr gboolean    ShowSelfDestructDefault    = FALSE;
     constexpr const char *DownloadBehaviour          = "download-behaviour";
@@ -50,6 +60,10 @@ namespace AccountOptions {
     constexpr gboolean    KeepInlineDownloadsDefault = FALSE;
     constexpr const char *ReadReceipts               = "read-receipts";
     constexpr gboolean    ReadReceiptsDefault        = TRUE;
+    constexpr const char *WorkerThreads              = "worker-threads";
+    constexpr const char *WorkerThreadsDefault       = "0";
+    constexpr const char *StickerCacheSize           = "animated-sticker-cache-mb";
+    constexpr const char *StickerCacheSizeDefault    = "16";
     constexpr const char *ApiId                      = "api-id";
     constexpr const char *ApiHash                    = "api-hash";
 };
@@ -61,6 +75,8 @@ namespace BuddyOptions {
 unsigned getAutoDownloadLimitKb(PurpleAccount *account);
 bool     isSizeWithinLimit(unsigned size, unsigned limit);
 bool     ignoreBigDownloads(PurpleAccount *account);
+unsigned getWorkerThreadCount(PurpleAccount *account);
+unsigned getStickerCacheSize(PurpleAccount *account);
 PurpleTdClient *getTdClient(PurpleAccount *account);
 const char *getUiName();
 bool        canDisableReadReceipts();
@@ -6,6 +6,7 @@
 #include "sticker.h"
 #include "config.h"
 #include "call.h"
+#include "html-text.h"
 #include <algorithm>
 
 enum {
@@ -23,10 +24,7 @@ std::string makeNoticeWithSender(const td::td_api::chat &chat, const TgMessageIn
 
 std::string getMessageText(const td::td_api::formattedText &text)
 {
-    char *newText = purple_markup_escape_text(text.text_.c_str(), text.text_.size());
-    std::string result(newText);
-    g_free(newText);
-    return result;
+    return escapeHtml(text.text_.data(), text.text_.size());
 }
 
 std::string makeInlineImageText(int imgstoreId)
@@ -347,6 +345,20 @@ bool shouldConvertAnimatedSticker(const TgMessageInfo &message, const PurpleAcco
 #endif
 }
 
+bool shouldConvertSticker(const TgMessageInfo &message, const std::string &filePath,
+                          const PurpleAccount *purpleAccount)
+{
+    if (filePath.empty())
+        return false;
+    if (isStickerAnimated(filePath))
+        return shouldConvertAnimatedSticker(message, purpleAccount);
+#ifndef NoWebp
+    return true;
+#else
+    return false;
+#endif
+}
+
 static void showDownloadedSticker(const td::td_api::chat &chat, TgMessageInfo &message,
                                   const std::string &filePath,
                                   const std::string &fileDescription,
@@ -360,8 +372,9 @@ static void showDownloadedSticker(const td::td_api::chat &chat, TgMessageInfo &m
                                                       account.purpleAccount);
             showMessageText(account, chat, message, NULL, notice.c_str());
             StickerConversionThread *thread;
-            thread = new StickerConversionThread(account.purpleAccount, filePath, getId(chat),
-                                                 std::move(message));
+            thread = new StickerConversionThread(account.purpleAccount, filePath, fileDescription,
+                                                 getId(chat), std::move(message));
+            thread->setThumbnail(thumbnail.get());
             thread->startThread();
         } else if (thumbnail) {
             // Avoid message like "Downloading sticker thumbnail...
@@ -375,11 +388,29 @@ static void showDownloadedSticker(const td::td_api::chat &chat, TgMessageInfo &m
         } else {
             showGenericFileInline(chat, message, filePath, NULL, fileDescription, account);
         }
+    } else if (shouldConvertSticker(message, filePath, account.purpleAccount)) {
+        // Decoding happens off main thread, the image is shown when conversion finishes
+        StickerConversionThread *thread;
+        thread = new StickerConversionThread(account.purpleAccount, filePath, fileDescription,
+                                             getId(chat), std::move(message));
+        thread->startThread();
     } else {
-        showWebpSticker(chat, message, filePath, fileDescription, account);
+        showGenericFileInline(chat, message, filePath, NULL, fileDescription, account);
     }
 }
 
+void showStickerThumbnail(const td::td_api::chat &chat, TgMessageInfo &message, int32_t thumbnailId,
+                          const std::string &thumbnailPath, const std::string &fileDescription,
+                          TdTransceiver &transceiver, TdAccountData &account)
+{
+    if (!thumbnailPath.empty())
+        showDownloadedSticker(chat, message, thumbnailPath, fileDescription, nullptr, transceiver,
+                              account);
+    else
+        downloadFileInline(thumbnailId, getId(chat), message, fileDescription, nullptr, transceiver,
+                           account);
+}
+
 void showGenericFileInline(const td::td_api::chat &chat, const TgMessageInfo &message,
                            const std::string &filePath, const char *caption,
                            const std::string &fileDescription, TdAccountData &account)
@@ -532,11 +563,16 @@ static void showFileInline(const td::td_api::chat &chat, IncomingMessage &fullMe
         showMessageText(account, chat, fullMessage.messageInfo, caption, notice.c_str());
 
     if (autoDownload || askDownload) {
-        if (fullMessage.animatedStickerConverted) {
-            if (fullMessage.animatedStickerConvertSuccess) {
-                std::string text = makeInlineImageText(fullMessage.animatedStickerImageId);
+        if (fullMessage.stickerConverted) {
+            std::string filePath = fullMessage.inlineDownloadComplete ? fullMessage.inlineDownloadedFilePath :
+                                   file.local_ ? file.local_->path_ : std::string();
+            if (fullMessage.stickerConvertSuccess) {
+                std::string text = makeInlineImageText(fullMessage.stickerImageId);
                 showMessageText(account, chat, fullMessage.messageInfo, text.c_str(), NULL, PURPLE_MESSAGE_IMAGES);
-            }
+            } else if (!isStickerAnimated(filePath))
+                // Undecodable static sticker is shown as a link, failed animated sticker conversion
+                // has been reported already
+                showGenericFileInline(chat, fullMessage.messageInfo, filePath, caption, fileDesc, account);
         } else if (file.local_ && file.local_->is_downloading_completed_)
             showDownloadedFileInline(getId(chat), fullMessage.messageInfo, file.local_->path_,
                                      caption, fileDesc, std::move(fullMessage.thumbnail), transceiver, account);
@@ -770,9 +806,9 @@ void makeFullMessage(const td::td_api::chat &chat, td::td_api::object_ptr<td::td
     fullMessage.repliedMessageFetchDoneOrFailed = false;
     fullMessage.inlineDownloadComplete = false;
     fullMessage.inlineDownloadTimeout = false;
-    fullMessage.animatedStickerConverted = false;
-    fullMessage.animatedStickerConvertSuccess = false;
-    fullMessage.animatedStickerImageId = 0;
+    fullMessage.stickerConverted = false;
+    fullMessage.stickerConvertSuccess = false;
+    fullMessage.stickerImageId = 0;
 
     const char *option = purple_account_get_string(account.purpleAccount, AccountOptions::DownloadBehaviour,
                                                    AccountOptions::DownloadBehaviourDefault());
@@ -849,17 +885,17 @@ static bool isFileMessageReady(const IncomingMessage &fullMessage, ChatId chatId
 
     if (chat && isInlineDownload(fullMessage, content, *chat)) {
         // File will be shown inline
-        // Animated stickers are not ready until converted
+        // Stickers are not ready until converted
         if (fullMessage.inlineDownloadComplete)
             return !((content.get_id() == td::td_api::messageSticker::ID) &&
-                     isStickerAnimated(fullMessage.inlineDownloadedFilePath) &&
-                     shouldConvertAnimatedSticker(fullMessage.messageInfo, account.purpleAccount) &&
-                     !fullMessage.animatedStickerConverted);
+                     shouldConvertSticker(fullMessage.messageInfo, fullMessage.inlineDownloadedFilePath,
+                                          account.purpleAccount) &&
+                     !fullMessage.stickerConverted);
         else if (file.local_ && file.local_->is_downloading_completed_)
             return !((content.get_id() == td::td_api::messageSticker::ID) &&
-                     isStickerAnimated(file.local_->path_) &&
-                     shouldConvertAnimatedSticker(fullMessage.messageInfo, account.purpleAccount) &&
-                     !fullMessage.animatedStickerConverted);
+                     shouldConvertSticker(fullMessage.messageInfo, file.local_->path_,
+                                          account.purpleAccount) &&
+                     !fullMessage.stickerConverted);
         else
             // Files above limit will either be ignored (in which case, message is ready)
             // or requested (in which case, don't try do display in order)
@@ -1001,13 +1037,16 @@ void fetchExtras(IncomingMessage &fullMessage, TdTransceiver &transceiver, TdAcc
     getFileFromMessage(fullMessage, fileInfo);
     if (fileInfo.file && message.content_ && chat && isInlineDownload(fullMessage, *message.content_, *chat)) {
         if (fileInfo.file->local_ && fileInfo.file->local_->is_downloading_completed_ &&
-            (message.content_->get_id() == td::td_api::messageSticker::ID) &&
-            isStickerAnimated(fileInfo.file->local_->path_))
+            (message.content_->get_id() == td::td_api::messageSticker::ID))
         {
-            if (shouldConvertAnimatedSticker(fullMessage.messageInfo, account.purpleAccount)) {
+            if (shouldConvertSticker(fullMessage.messageInfo, fileInfo.file->local_->path_,
+                                     account.purpleAccount))
+            {
                 StickerConversionThread *thread;
                 thread = new StickerConversionThread(account.purpleAccount, fileInfo.file->local_->path_,
-                                                     chatId, &fullMessage.messageInfo);
+                                                     fileInfo.description, chatId,
+                                                     &fullMessage.messageInfo);
+                thread->setThumbnail(fullMessage.thumbnail.get());
                 thread->startThread();
             }
             // TODO: if animated stickers are disabled, fetch thumbnail instead
@@ -25,8 +25,14 @@ void showDownloadedFileInline(ChatId chatId, TgMessageInfo &message,
                               const std::string &fileDescription,
                               td::td_api::object_ptr<td::td_api::file> thumbnail,
                               TdTransceiver &transceiver, TdAccountData &account);
+// Shows static thumbnail in place of an animated sticker, downloading it first if path is empty
+void showStickerThumbnail(const td::td_api::chat &chat, TgMessageInfo &message, int32_t thumbnailId,
+                          const std::string &thumbnailPath, const std::string &fileDescription,
+                          TdTransceiver &transceiver, TdAccountData &account);
 bool isStickerAnimated(const std::string &filePath);
 bool shouldConvertAnimatedSticker(const TgMessageInfo &message, const PurpleAccount *purpleAccount);
+bool shouldConvertSticker(const TgMessageInfo &message, const std::string &filePath,
+                          const PurpleAccount *purpleAccount);
 void showMessage(const td::td_api::chat &chat, IncomingMessage &fullMessage,
                  TdTransceiver &transceiver, TdAccountData &account);
 void showMessages(std::vector<IncomingMessage>& messages, TdAccountData &account);
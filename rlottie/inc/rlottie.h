@@ -19,9 +19,11 @@
 #ifndef _RLOTTIE_H_
 #define _RLOTTIE_H_
 
+#include <functional>
 #include <future>
 #include <vector>
 #include <memory>
+#include <cstdint>
 
 #if defined _WIN32 || defined __CYGWIN__
   #ifdef LOT_BUILD
@@ -60,6 +62,164 @@ namespace rlottie {
  */
 LOT_EXPORT void configureModelCacheSize(size_t cacheSize);
 
+/**
+ *  @brief Configures the memory limit of the model cache, in addition to
+ *  the entry count set by configureModelCacheSize(). Least recently used
+ *  models are dropped once the limit is exceeded, and models bigger than
+ *  the limit are not cached at all.
+ *
+ *  Memory use of a model is estimated as the size of the JSON data it was
+ *  parsed from.
+ *
+ *  @param[in] maxBytes  Memory limit, 0 for none (the default).
+ *
+ *  @internal
+ */
+LOT_EXPORT void configureModelCacheMemoryLimit(size_t maxBytes);
+
+/**
+ *  @brief Model cache usage counters, since the start of the process.
+ */
+struct ModelCacheStats {
+    size_t   entries{0};    // models currently cached
+    size_t   bytes{0};      // their estimated memory use
+    uint64_t hits{0};       // loads that found the model in the cache
+    uint64_t misses{0};     // models that were parsed and added to the cache
+    uint64_t evictions{0};  // models dropped to stay within the limits
+};
+
+/**
+ *  @brief Returns model cache usage counters.
+ *
+ *  @internal
+ */
+LOT_EXPORT ModelCacheStats modelCacheStats();
+
+/**
+ *  @brief Configures how many gradient color tables are kept for reuse,
+ *  60 by default. Tables are shared by all animations and threads; the
+ *  least recently used ones are dropped first.
+ *
+ *  @param[in] cacheSize  Tables to keep, 0 to keep none and drop the
+ *             current ones.
+ *
+ *  @internal
+ */
+LOT_EXPORT void configureGradientCacheSize(size_t cacheSize);
+
+/**
+ *  @brief Gradient cache usage counters, since the start of the process.
+ */
+struct GradientCacheStats {
+    size_t   entries{0};    // color tables currently cached
+    uint64_t hits{0};       // gradients drawn with a cached table
+    uint64_t misses{0};     // tables that had to be made
+    uint64_t evictions{0};  // tables dropped to stay within the size
+};
+
+/**
+ *  @brief Returns gradient cache usage counters.
+ *
+ *  @internal
+ */
+LOT_EXPORT GradientCacheStats gradientCacheStats();
+
+/**
+ *  @brief Configures how much memory is kept for reuse by the bitmaps that
+ *  track mattes and translucent precomposition layers are drawn into.
+ *  Bitmaps are shared by all animations and threads, reused for others of
+ *  the same size. 8 MB by default.
+ *
+ *  @param[in] maxBytes  Memory to keep at most, 0 to keep none.
+ *
+ *  @internal
+ */
+LOT_EXPORT void configureBitmapPoolMemoryLimit(size_t maxBytes);
+
+/**
+ *  @brief Bitmap pool counters, since the start of the process.
+ */
+struct BitmapPoolStats {
+    size_t   bytes{0};      // memory currently kept for reuse
+    size_t   peakBytes{0};  // most memory in use and kept at once
+    uint64_t hits{0};       // bitmaps that reused kept memory
+    uint64_t misses{0};     // bitmaps that had to allocate
+};
+
+/**
+ *  @brief Returns bitmap pool counters.
+ *
+ *  @internal
+ */
+LOT_EXPORT BitmapPoolStats bitmapPoolStats();
+
+/**
+ *  @brief Configures the thread pools used for Animation::render() and
+ *  for rasterizing shapes while a frame renders.
+ *
+ *  No threads are started until this is called. Without a pool, or with
+ *  0 threads, the work runs in the calling thread. Counts are capped at the
+ *  number of cores. Queued work is finished before a pool is replaced.
+ *
+ *  Does nothing unless rlottie is built with thread support.
+ *
+ *  @param[in] renderThreads  Threads rendering frames for Animation::render().
+ *  @param[in] rasterThreads  Threads rasterizing shapes.
+ *
+ *  @internal
+ */
+LOT_EXPORT void configureThreads(unsigned renderThreads, unsigned rasterThreads);
+
+/**
+ *  @brief Runs a task on some thread of the application.
+ */
+using Executor = std::function<void(std::function<void()>)>;
+
+/**
+ *  @brief Hands rendering and rasterization work to the application's own
+ *  thread pool instead of the one set by configureThreads().
+ *
+ *  A thread waiting for a shape runs it itself if the executor has not got
+ *  to it yet, so the executor may be the same pool that renders frames.
+ *  Waiting for an Animation::render() result from inside the executor can
+ *  still deadlock.
+ *
+ *  Does nothing unless rlottie is built with thread support.
+ *
+ *  @param[in] executor  Executor to use, or an empty one to go back to
+ *             configureThreads().
+ *
+ *  @internal
+ */
+LOT_EXPORT void configureExecutor(Executor executor);
+
+/**
+ *  @brief Thread pool counters, since the start of the process.
+ */
+struct SchedulerStats {
+    unsigned threads{0};        // threads currently started by rlottie
+    uint64_t tasks{0};          // tasks submitted
+    uint64_t steals{0};         // tasks a thread took from another thread's queue
+    uint64_t idleSpins{0};      // times a thread found no work and had to block
+    uint64_t callerRuns{0};     // tasks run by the thread waiting for them
+    size_t   queueDepth{0};     // tasks submitted but not started yet
+    size_t   maxQueueDepth{0};  // highest queueDepth so far
+};
+
+/**
+ *  @brief Returns counters of the Animation::render() pool.
+ *
+ *  @internal
+ */
+LOT_EXPORT SchedulerStats renderSchedulerStats();
+
+/**
+ *  @brief Returns counters of the rasterization pool.
+ *
+ *  @internal
+ */
+LOT_EXPORT SchedulerStats rasterSchedulerStats();
+
 struct Color {
     Color() = default;
     Color(float r, float g , float b):_r(r), _g(g), _b(b){}
@@ -301,6 +461,36 @@ public:
     loadFromData(std::string jsonData, const std::string &key,
                  const std::string &resourcePath="", bool cachePolicy=true);
 
+    /**
+     *  @brief Constructs another animation object sharing the parsed model
+     *         of this one.
+     *
+     *  Each animation object can only render one frame at a time, so this
+     *  is how frames of the same resource get rendered in parallel without
+     *  parsing the JSON data again. Unlike loading with the same cache key,
+     *  it works regardless of model cache state.
+     *
+     *  @return Animation object rendering the same content.
+     *
+     *  @internal
+     */
+    std::unique_ptr<Animation> clone() const;
+
+    /**
+     *  @brief Constructs an animation object from a model cached by an
+     *         earlier load with the same key.
+     *
+     *  Lets the caller skip reading and decompressing the JSON data when
+     *  it's already been parsed.
+     *
+     *  @param[in] key the key the JSON string data was cached with.
+     *
+     *  @return Animation object, or nullptr if the model is not in the cache.
+     *
+     *  @internal
+     */
+    static std::unique_ptr<Animation> loadFromCache(const std::string &key);
+
     /**
      *  @brief Returns default framerate of the Lottie resource.
      *
@@ -397,6 +587,38 @@ public:
      */
     void              renderSync(size_t frameNo, Surface surface, bool keepAspectRatio=true);
 
+    /**
+     *  @brief Makes rendering repaint only what changed since the previous
+     *         frame rendered by this object.
+     *
+     *  Only works if the surface still holds that frame: same buffer, size
+     *  and draw region, with the pixels left as they were. Otherwise the
+     *  whole surface gets cleared and painted, as it does by default.
+     *
+     *  @param[in] enable whether to repaint partially.
+     *
+     *  @see damageRect()
+     *  @internal
+     */
+    void              setPartialRender(bool enable);
+
+    /**
+     *  @brief Returns the area of the surface changed by the last render.
+     *
+     *  Pixels outside of it are left as they were in the previous frame.
+     *  Without partial rendering it's always the whole surface, and with it
+     *  the area is empty when the frame looks the same as the previous one.
+     *
+     *  @param[out] x      left edge of the area.
+     *  @param[out] y      top edge of the area.
+     *  @param[out] width  width of the area.
+     *  @param[out] height height of the area.
+     *
+     *  @see setPartialRender()
+     *  @internal
+     */
+    void              damageRect(size_t &x, size_t &y, size_t &width, size_t &height) const;
+
     /**
      *  @brief Returns root layer of the composition updated with
      *         content of the Lottie resource at frame number @p frameNo.
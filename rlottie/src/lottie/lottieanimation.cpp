@@ -20,6 +20,9 @@
 #include "lottieloader.h"
 #include "lottiemodel.h"
 #include "rlottie.h"
+#include "vbitmappool.h"
+#include "vgradientcache.h"
+#include "vraster.h"
 
 #include <fstream>
 
@@ -30,6 +33,48 @@ LOT_EXPORT void rlottie::configureModelCacheSize(size_t cacheSize)
     LottieLoader::configureModelCacheSize(cacheSize);
 }
 
+LOT_EXPORT void rlottie::configureModelCacheMemoryLimit(size_t maxBytes)
+{
+    LottieLoader::configureModelCacheMemoryLimit(maxBytes);
+}
+
+LOT_EXPORT rlottie::ModelCacheStats rlottie::modelCacheStats()
+{
+    return LottieLoader::modelCacheStats();
+}
+
+LOT_EXPORT void rlottie::configureGradientCacheSize(size_t cacheSize)
+{
+    VGradientCache::instance().configureCacheSize(cacheSize);
+}
+
+LOT_EXPORT rlottie::GradientCacheStats rlottie::gradientCacheStats()
+{
+    VGradientCache::Stats from = VGradientCache::instance().stats();
+    GradientCacheStats    stats;
+    stats.entries = from.entries;
+    stats.hits = from.hits;
+    stats.misses = from.misses;
+    stats.evictions = from.evictions;
+    return stats;
+}
+
+LOT_EXPORT void rlottie::configureBitmapPoolMemoryLimit(size_t maxBytes)
+{
+    VBitmapPool::instance().configureMemoryLimit(maxBytes);
+}
+
+LOT_EXPORT rlottie::BitmapPoolStats rlottie::bitmapPoolStats()
+{
+    VBitmapPool::Stats from = VBitmapPool::instance().stats();
+    BitmapPoolStats    stats;
+    stats.bytes = from.bytes;
+    stats.peakBytes = from.peakBytes;
+    stats.hits = from.hits;
+    stats.misses = from.misses;
+    return stats;
+}
+
 struct RenderTask {
     RenderTask() { receiver = sender.get_future(); }
     std::promise<Surface> sender;
@@ -44,6 +89,7 @@ using SharedRenderTask = std::shared_ptr<RenderTask>;
 class AnimationImpl {
 public:
     void    init(const std::shared_ptr<LOTModel> &model);
+    const std::shared_ptr<LOTModel> &model() const { return mModel; }
     bool    update(size_t frameNo, const VSize &size, bool keepAspectRatio);
     VSize   size() const { return mModel->size(); }
     double  duration() const { return mModel->duration(); }
@@ -53,6 +99,8 @@ public:
     Surface render(size_t frameNo, const Surface &surface, bool keepAspectRatio);
     std::future<Surface> renderAsync(size_t frameNo, Surface &&surface, bool keepAspectRatio);
     const LOTLayerNode * renderTree(size_t frameNo, const VSize &size);
+    void    setPartialRender(bool enable) { mCompItem->setPartialRender(enable); }
+    VRect   damageRect() const { return mCompItem->damageRect(); }
 
     const LayerInfoList &layerInfoList() const
     {
@@ -128,79 +176,28 @@ void AnimationImpl::init(const std::shared_ptr<LOTModel> &model)
 
 #ifdef LOTTIE_THREAD_SUPPORT
 
-#include <thread>
-#include "vtaskqueue.h"
-
 /*
- * Implement a task stealing schduler to perform render task
- * As each player draws into its own buffer we can delegate this
- * task to a slave thread. The scheduler creates a threadpool depending
- * on the number of cores available in the system and does a simple fair
- * scheduling by assigning the task in a round-robin fashion. Each thread
- * in the threadpool has its own queue. once it finishes all the task on its
- * own queue it goes through rest of the queue and looks for task if it founds
- * one it steals the task from it and executes. if it couldn't find one then it
- * just waits for new task on its own queue.
+ * As each player draws into its own buffer, rendering a frame can be handed
+ * to another thread. Nothing is started until configureThreads() asks for a
+ * pool or configureExecutor() hands over the application's own, until then
+ * frames render synchronously in render().
  */
 class RenderTaskScheduler {
-    const unsigned           _count{std::thread::hardware_concurrency()};
-    std::vector<std::thread> _threads;
-    std::vector<TaskQueue<SharedRenderTask>> _q{_count};
-    std::atomic<unsigned>                    _index{0};
-
-    void run(unsigned i)
-    {
-        while (true) {
-            bool             success = false;
-            SharedRenderTask task;
-            for (unsigned n = 0; n != _count * 2; ++n) {
-                if (_q[(i + n) % _count].try_pop(task)) {
-                    success = true;
-                    break;
-                }
-            }
-            if (!success && !_q[i].pop(task)) break;
-
-            auto result =
-                task->playerImpl->render(task->frameNo, task->surface, task->keepAspectRatio);
-            task->sender.set_value(result);
-        }
-    }
-
-    RenderTaskScheduler()
-    {
-        for (unsigned n = 0; n != _count; ++n) {
-            _threads.emplace_back([&, n] { run(n); });
-        }
-    }
-
 public:
-    static RenderTaskScheduler &instance()
+    static VTaskScheduler &instance()
     {
-        static RenderTaskScheduler singleton;
+        static VTaskScheduler singleton;
         return singleton;
     }
 
-    ~RenderTaskScheduler()
-    {
-        for (auto &e : _q) e.done();
-
-        for (auto &e : _threads) e.join();
-    }
-
-    std::future<Surface> process(SharedRenderTask task)
+    static std::future<Surface> process(SharedRenderTask task)
     {
         auto receiver = std::move(task->receiver);
-        auto i = _index++;
-
-        for (unsigned n = 0; n != _count; ++n) {
-            if (_q[(i + n) % _count].try_push(std::move(task))) return receiver;
-        }
-
-        if (_count > 0) {
-            _q[i % _count].push(std::move(task));
-        }
-
+        instance().process([task] {
+            auto result =
+                task->playerImpl->render(task->frameNo, task->surface, task->keepAspectRatio);
+            task->sender.set_value(result);
+        });
         return receiver;
     }
 };
@@ -208,13 +205,7 @@ public:
 #else
 class RenderTaskScheduler {
 public:
-    static RenderTaskScheduler &instance()
-    {
-        static RenderTaskScheduler singleton;
-        return singleton;
-    }
-
-    std::future<Surface> process(SharedRenderTask task)
+    static std::future<Surface> process(SharedRenderTask task)
     {
         auto result = task->playerImpl->render(task->frameNo, task->surface, task->keepAspectRatio);
         task->sender.set_value(result);
@@ -223,6 +214,51 @@ public:
 };
 #endif
 
+static SchedulerStats toSchedulerStats(const VTaskScheduler::Stats &from)
+{
+    SchedulerStats stats;
+    stats.threads = from.threads;
+    stats.tasks = from.tasks;
+    stats.steals = from.steals;
+    stats.idleSpins = from.idleSpins;
+    stats.callerRuns = from.callerRuns;
+    stats.queueDepth = from.queueDepth;
+    stats.maxQueueDepth = from.maxQueueDepth;
+    return stats;
+}
+
+LOT_EXPORT void rlottie::configureThreads(unsigned renderThreads, unsigned rasterThreads)
+{
+#ifdef LOTTIE_THREAD_SUPPORT
+    RenderTaskScheduler::instance().configure(renderThreads);
+#else
+    (void)renderThreads;
+#endif
+    VRasterizer::configureThreads(rasterThreads);
+}
+
+LOT_EXPORT void rlottie::configureExecutor(Executor executor)
+{
+#ifdef LOTTIE_THREAD_SUPPORT
+    RenderTaskScheduler::instance().setExecutor(executor);
+#endif
+    VRasterizer::setExecutor(std::move(executor));
+}
+
+LOT_EXPORT SchedulerStats rlottie::renderSchedulerStats()
+{
+#ifdef LOTTIE_THREAD_SUPPORT
+    return toSchedulerStats(RenderTaskScheduler::instance().stats());
+#else
+    return SchedulerStats();
+#endif
+}
+
+LOT_EXPORT SchedulerStats rlottie::rasterSchedulerStats()
+{
+    return toSchedulerStats(VRasterizer::schedulerStats());
+}
+
 std::future<Surface> AnimationImpl::renderAsync(size_t    frameNo,
                                                 Surface &&surface,
                                                 bool keepAspectRatio)
@@ -238,7 +274,7 @@ std::future<Surface> AnimationImpl::renderAsync(size_t    frameNo,
     mTask->surface = std::move(surface);
     mTask->keepAspectRatio = keepAspectRatio;
 
-    return RenderTaskScheduler::instance().process(mTask);
+    return RenderTaskScheduler::process(mTask);
 }
 
 /**
@@ -265,6 +301,24 @@ std::unique_ptr<Animation> Animation::loadFromData(
     return nullptr;
 }
 
+std::unique_ptr<Animation> Animation::loadFromCache(const std::string &key)
+{
+    LottieLoader loader;
+    if (loader.loadFromCache(key)) {
+        auto animation = std::unique_ptr<Animation>(new Animation);
+        animation->d->init(loader.model());
+        return animation;
+    }
+    return nullptr;
+}
+
+std::unique_ptr<Animation> Animation::clone() const
+{
+    auto animation = std::unique_ptr<Animation>(new Animation);
+    animation->d->init(d->model());
+    return animation;
+}
+
 std::unique_ptr<Animation>
 Animation::loadFromFile(const std::string &path, bool cachePolicy)
 {
@@ -326,6 +380,21 @@ void Animation::renderSync(size_t frameNo, Surface surface, bool keepAspectRatio
     d->render(frameNo, surface, keepAspectRatio);
 }
 
+void Animation::setPartialRender(bool enable)
+{
+    d->setPartialRender(enable);
+}
+
+void Animation::damageRect(size_t &x, size_t &y, size_t &width,
+                           size_t &height) const
+{
+    VRect rect = d->damageRect();
+    x = size_t(rect.x());
+    y = size_t(rect.y());
+    width = size_t(rect.width());
+    height = size_t(rect.height());
+}
+
 const LayerInfoList &Animation::layers() const
 {
     return d->layerInfoList();
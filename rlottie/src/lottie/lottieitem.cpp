@@ -22,6 +22,7 @@
 #include <iterator>
 #include "lottiekeypath.h"
 #include "vbitmap.h"
+#include "vbitmappool.h"
 #include "vpainter.h"
 #include "vraster.h"
 
@@ -152,16 +153,62 @@ bool LOTCompItem::render(const rlottie::Surface &surface)
     VRect clip(0, 0, int(surface.drawRegionWidth()), int(surface.drawRegionHeight()));
     mRootLayer->preprocess(clip);
 
-    VPainter painter(&mSurface);
-    // set sub surface area for drawing.
-    painter.setDrawRegion(
-        VRect(int(surface.drawRegionPosX()), int(surface.drawRegionPosY()),
-              int(surface.drawRegionWidth()), int(surface.drawRegionHeight())));
+    VRect region(int(surface.drawRegionPosX()), int(surface.drawRegionPosY()),
+                 int(surface.drawRegionWidth()), int(surface.drawRegionHeight()));
+    VRect all(0, 0, int(surface.width()), int(surface.height()));
+
+    if (!mPartialRender) {
+        VPainter painter(&mSurface);
+        // set sub surface area for drawing.
+        painter.setDrawRegion(region);
+        mRootLayer->render(&painter, {}, {});
+        painter.end();
+        mDamage = all;
+        return true;
+    }
+
+    /*
+     * Draw calls get compared with the ones of the previous frame, only
+     * the area they differ in is cleared and painted again.
+     */
+    bool     keep = holdsLastFrame(surface);
+    VPainter painter;
+    painter.beginRecording(&mSurface, &mNextDrawOps);
+    painter.setDrawRegion(region);
     mRootLayer->render(&painter, {}, {});
+    mDamage = painter.replay(keep ? &mDrawOps : nullptr);
     painter.end();
+
+    if (!keep || painter.recordingAborted())
+        mDamage = all;
+    else
+        mDamage.translate(region.x(), region.y());
+    mDrawOpsValid = !painter.recordingAborted();
+    std::swap(mDrawOps, mNextDrawOps);
+    mLastSurface = surface;
     return true;
 }
 
+bool LOTCompItem::holdsLastFrame(const rlottie::Surface &surface) const
+{
+    return mDrawOpsValid && surface.buffer() == mLastSurface.buffer() &&
+           surface.width() == mLastSurface.width() &&
+           surface.height() == mLastSurface.height() &&
+           surface.bytesPerLine() == mLastSurface.bytesPerLine() &&
+           surface.drawRegionPosX() == mLastSurface.drawRegionPosX() &&
+           surface.drawRegionPosY() == mLastSurface.drawRegionPosY() &&
+           surface.drawRegionWidth() == mLastSurface.drawRegionWidth() &&
+           surface.drawRegionHeight() == mLastSurface.drawRegionHeight();
+}
+
+void LOTCompItem::setPartialRender(bool enable)
+{
+    mPartialRender = enable;
+    mDrawOpsValid = false;
+    mDrawOps.clear();
+    mNextDrawOps.clear();
+}
+
 void LOTMaskItem::update(int frameNo, const VMatrix &            parentMatrix,
                          float /*parentAlpha*/, const DirtyFlag &flag)
 {
@@ -476,14 +523,14 @@ void LOTCompLayerItem::render(VPainter *painter, const VRle &inheritMask,
         renderHelper(painter, inheritMask, matteRle);
     } else {
         if (complexContent()) {
-            VSize    size = painter->clipBoundingRect().size();
-            VPainter srcPainter;
-            VBitmap  srcBitmap(size.width(), size.height(),
-                              VBitmap::Format::ARGB32_Premultiplied);
-            srcPainter.begin(&srcBitmap);
+            VSize               size = painter->clipBoundingRect().size();
+            VPainter            srcPainter;
+            VBitmapPool::Bitmap srcBuffer(size.width(), size.height());
+            srcPainter.begin(&srcBuffer.bitmap());
             renderHelper(&srcPainter, inheritMask, matteRle);
             srcPainter.end();
-            painter->drawBitmap(VPoint(), srcBitmap, uchar(combinedAlpha() * 255.0f));
+            painter->drawBitmap(VPoint(), srcBuffer.bitmap(),
+                                uchar(combinedAlpha() * 255.0f));
         } else {
             renderHelper(painter, inheritMask, matteRle);
         }
@@ -534,18 +581,16 @@ void LOTCompLayerItem::renderMatteLayer(VPainter *painter, const VRle &mask,
     VSize size = painter->clipBoundingRect().size();
     // Decide if we can use fast matte.
     // 1. draw src layer to matte buffer
-    VPainter srcPainter;
-    src->bitmap().reset(size.width(), size.height(),
-                        VBitmap::Format::ARGB32_Premultiplied);
-    srcPainter.begin(&src->bitmap());
+    VPainter            srcPainter;
+    VBitmapPool::Bitmap srcBuffer(size.width(), size.height());
+    srcPainter.begin(&srcBuffer.bitmap());
     src->render(&srcPainter, mask, matteRle);
     srcPainter.end();
 
     // 2. draw layer to layer buffer
-    VPainter layerPainter;
-    layer->bitmap().reset(size.width(), size.height(),
-                          VBitmap::Format::ARGB32_Premultiplied);
-    layerPainter.begin(&layer->bitmap());
+    VPainter            layerPainter;
+    VBitmapPool::Bitmap layerBuffer(size.width(), size.height());
+    layerPainter.begin(&layerBuffer.bitmap());
     layer->render(&layerPainter, mask, matteRle);
 
     // 2.1update composition mode
@@ -567,14 +612,14 @@ void LOTCompLayerItem::renderMatteLayer(VPainter *painter, const VRle &mask,
     // 2.2 update srcBuffer if the matte is luma type
     if (layer->matteType() == MatteType::Luma ||
         layer->matteType() == MatteType::LumaInv) {
-        src->bitmap().updateLuma();
+        srcBuffer.bitmap().updateLuma();
     }
 
     // 2.3 draw src buffer as mask
-    layerPainter.drawBitmap(VPoint(), src->bitmap());
+    layerPainter.drawBitmap(VPoint(), srcBuffer.bitmap());
     layerPainter.end();
     // 3. draw the result buffer into painter
-    painter->drawBitmap(VPoint(), layer->bitmap());
+    painter->drawBitmap(VPoint(), layerBuffer.bitmap());
 }
 
 void LOTClipperItem::update(const VMatrix &matrix)
@@ -656,8 +701,7 @@ void LOTSolidLayerItem::updateContent()
                    mLayerData->layerSize().width(),
                    mLayerData->layerSize().height()));
         path.transform(combinedMatrix());
-        mRenderNode.mFlag |= VDrawable::DirtyState::Path;
-        mRenderNode.mPath = path;
+        mRenderNode.setPath(path);
     }
     if (flag() & DirtyFlagBit::Alpha) {
         LottieColor color = mLayerData->solidColor();
@@ -700,8 +744,7 @@ void LOTImageLayerItem::updateContent()
         path.addRect(VRectF(0, 0, mLayerData->asset()->mWidth,
                             mLayerData->asset()->mHeight));
         path.transform(combinedMatrix());
-        mRenderNode.mFlag |= VDrawable::DirtyState::Path;
-        mRenderNode.mPath = path;
+        mRenderNode.setPath(path);
         mTexture.mMatrix = combinedMatrix();
     }
 
@@ -1046,10 +1089,15 @@ void LOTPathDataItem::update(int              frameNo, const VMatrix &, float,
 
         updatePath(mLocalPath, frameNo);
         mDirtyPath = true;
+        mVersion++;
     }
     // 2. keep a reference path in temp in case there is some
     // path operation like trim which will update the path.
     // we don't want to update the local path.
+    if (mTrimmed) {
+        mTrimmed = false;
+        mVersion++;
+    }
     mTemp = mLocalPath;
 
     // 3. mark the path dirty if matrix has changed.
@@ -1168,13 +1216,66 @@ void LOTPaintDataItem::updateRenderNode()
         for (const auto &i : mPathItems) {
             i->finalPath(mPath);
         }
-        mDrawable.setPath(mPath);
+        VPoint offset;
+        if (moved(offset))
+            mDrawable.setPath(mPath, offset);
+        else
+            mDrawable.setPath(mPath);
+
+        mPathKeys.clear();
+        for (const auto &i : mPathItems) {
+            mPathKeys.push_back({i->version(), i->parent()->matrix()});
+        }
     } else {
         if (mDrawable.mFlag & VDrawable::DirtyState::Path)
             mDrawable.mPath = mPath;
     }
 }
 
+/*
+ * Whether the path is the last one moved by whole pixels: no local path
+ * changed, and the matrices of all of them differ from last time by the
+ * same translation only. Sub-pixel moves change the coverage, so those
+ * still get rasterized again.
+ */
+bool LOTPaintDataItem::moved(VPoint &offset) const
+{
+    constexpr float Tolerance = 1.0f / 4096;
+
+    if (mPathKeys.empty() || mPathKeys.size() != mPathItems.size())
+        return false;
+
+    VPointF delta;
+    for (size_t i = 0; i < mPathItems.size(); i++) {
+        const VMatrix &m = mPathItems[i]->parent()->matrix();
+        const PathKey &key = mPathKeys[i];
+        if (key.version != mPathItems[i]->version() ||
+            !vCompare(m.m_11(), key.matrix.m_11()) ||
+            !vCompare(m.m_12(), key.matrix.m_12()) ||
+            !vCompare(m.m_13(), key.matrix.m_13()) ||
+            !vCompare(m.m_21(), key.matrix.m_21()) ||
+            !vCompare(m.m_22(), key.matrix.m_22()) ||
+            !vCompare(m.m_23(), key.matrix.m_23()) ||
+            !vCompare(m.m_33(), key.matrix.m_33()))
+            return false;
+
+        VPointF d(m.m_tx() - key.matrix.m_tx(), m.m_ty() - key.matrix.m_ty());
+        if (i == 0)
+            delta = d;
+        else if (std::abs(d.x() - delta.x()) > Tolerance ||
+                 std::abs(d.y() - delta.y()) > Tolerance)
+            return false;
+    }
+
+    float x = std::round(delta.x());
+    float y = std::round(delta.y());
+    if (std::abs(delta.x() - x) > Tolerance || std::abs(delta.y() - y) > Tolerance)
+        return false;
+
+    offset = VPoint(int(x), int(y));
+    return true;
+}
+
 void LOTPaintDataItem::renderList(std::vector<VDrawable *> &list)
 {
     if (mRenderNodeUpdate) {
@@ -71,7 +71,10 @@ public:
    const LOTLayerNode * renderTree()const;
    bool render(const rlottie::Surface &surface);
    void setValue(const std::string &keypath, LOTVariant &value);
+   void setPartialRender(bool enable);
+   VRect damageRect() const { return mDamage; }
 private:
+   bool holdsLastFrame(const rlottie::Surface &surface) const;
    VBitmap                                     mSurface;
    VMatrix                                     mScaleMatrix;
    VSize                                       mViewSize;
@@ -80,6 +83,13 @@ private:
    VArenaAlloc                                 mAllocator{2048};
    int                                         mCurFrameNo;
    bool                                        mKeepAspectRatio{true};
+   bool                                        mPartialRender{false};
+   // draw calls of the frame in mLastSurface, for partial repaint
+   VPaintOpList                                mDrawOps;
+   VPaintOpList                                mNextDrawOps;
+   bool                                        mDrawOpsValid{false};
+   rlottie::Surface                            mLastSurface;
+   VRect                                       mDamage;
 };
 
 class LOTLayerMaskItem;
@@ -168,7 +178,6 @@ public:
    std::vector<LOTNode *>& cnodes() {return mCApiData->mCNodeList;}
    const char* name() const {return mLayerData->name();}
    virtual bool resolveKeyPath(LOTKeyPath &keyPath, uint depth, LOTVariant &value);
-   VBitmap& bitmap() {return mRenderBuffer;}
 protected:
    virtual void preprocessStage(const VRect& clip) = 0;
    virtual void updateContent() = 0;
@@ -184,7 +193,6 @@ protected:
    LOTLayerData                               *mLayerData{nullptr};
    LOTLayerItem                               *mParentLayer{nullptr};
    VMatrix                                     mCombinedMatrix;
-   VBitmap                                     mRenderBuffer;
    float                                       mCombinedAlpha{0.0};
    int                                         mFrameNo{-1};
    DirtyFlag                                   mDirtyFlag{DirtyFlagBit::All};
@@ -360,7 +368,9 @@ public:
    bool dirty() const {return mDirtyPath;}
    const VPath &localPath() const {return mTemp;}
    void finalPath(VPath& result);
-   void updatePath(const VPath &path) {mTemp = path; mDirtyPath = true;}
+   void updatePath(const VPath &path) {mTemp = path; mDirtyPath = true; mTrimmed = true; mVersion++;}
+   // changes whenever localPath() might have
+   uint version() const {return mVersion;}
    bool staticPath() const { return mStaticPath; }
    void setParent(LOTContentGroupItem *parent) {mParent = parent;}
    LOTContentGroupItem *parent() const {return mParent;}
@@ -380,7 +390,9 @@ private:
    VPath                                   mLocalPath;
    VPath                                   mTemp;
    int                                     mFrameNo{-1};
+   uint                                    mVersion{0};
    bool                                    mDirtyPath{true};
+   bool                                    mTrimmed{false};
    bool                                    mStaticPath;
 };
 
@@ -456,11 +468,18 @@ public:
 protected:
    virtual bool updateContent(int frameNo, const VMatrix &matrix, float alpha) = 0;
 private:
+   struct PathKey {
+      uint    version;
+      VMatrix matrix;
+   };
    void updateRenderNode();
+   bool moved(VPoint &offset) const;
 protected:
    std::vector<LOTPathDataItem *>   mPathItems;
    LOTDrawable                      mDrawable;
    VPath                            mPath;
+   // what mPath was built from
+   std::vector<PathKey>             mPathKeys;
    DirtyFlag                        mFlag;
    bool                             mStaticContent;
    bool                             mRenderNodeUpdate{true};
@@ -18,12 +18,14 @@
 
 #include "lottieloader.h"
 #include "lottieparser.h"
+#include "rlottie.h"
 
 #include <cstring>
 #include <fstream>
 
 #ifdef LOTTIE_CACHE_SUPPORT
 
+#include <list>
 #include <unordered_map>
 #include <mutex>
 
@@ -41,21 +43,31 @@ public:
         if (!mcacheSize) return nullptr;
 
         auto search = mHash.find(key);
+        if (search == mHash.end()) return nullptr;
 
-        return (search != mHash.end()) ? search->second : nullptr;
-
+        // move to front, it's now the most recently used
+        mLru.splice(mLru.begin(), mLru, search->second);
+        mStats.hits++;
+        return search->second->model;
     }
-    void add(const std::string &key, std::shared_ptr<LOTModel> value)
+    // cost is the size of JSON data the model was parsed from, which is
+    // close to the heap memory the model itself takes
+    void add(const std::string &key, std::shared_ptr<LOTModel> value, size_t cost)
     {
         std::lock_guard<std::mutex> guard(mMutex);
 
         if (!mcacheSize) return;
 
-        //@TODO just remove the 1st element
-        // not the best of LRU logic
-        if (mcacheSize == mHash.size()) mHash.erase(mHash.cbegin());
+        mStats.misses++;
+        auto search = mHash.find(key);
+        if (search != mHash.end()) remove(search->second);
+
+        if (mMemoryLimit && cost > mMemoryLimit) return;
 
-        mHash[key] = std::move(value);
+        mLru.push_front({key, std::move(value), cost});
+        mHash[key] = mLru.begin();
+        mStats.bytes += cost;
+        evict();
     }
 
     void configureCacheSize(size_t cacheSize)
@@ -63,15 +75,62 @@ public:
         std::lock_guard<std::mutex> guard(mMutex);
         mcacheSize = cacheSize;
 
-        if (!mcacheSize) mHash.clear();
+        if (!mcacheSize) {
+            mHash.clear();
+            mLru.clear();
+            mStats.bytes = 0;
+        }
+        evict();
+    }
+
+    void configureMemoryLimit(size_t maxBytes)
+    {
+        std::lock_guard<std::mutex> guard(mMutex);
+        mMemoryLimit = maxBytes;
+        evict();
+    }
+
+    rlottie::ModelCacheStats stats()
+    {
+        std::lock_guard<std::mutex> guard(mMutex);
+        rlottie::ModelCacheStats result = mStats;
+        result.entries = mLru.size();
+        return result;
     }
 
 private:
+    struct Entry {
+        std::string               key;
+        std::shared_ptr<LOTModel> model;
+        size_t                    cost;
+    };
+
     LottieModelCache() = default;
 
-    std::unordered_map<std::string, std::shared_ptr<LOTModel>>  mHash;
-    std::mutex                                                  mMutex;
-    size_t                                                      mcacheSize{10};
+    void remove(std::list<Entry>::iterator entry)
+    {
+        mStats.bytes -= entry->cost;
+        mHash.erase(entry->key);
+        mLru.erase(entry);
+    }
+
+    // drop least recently used models until within both limits
+    void evict()
+    {
+        while (!mLru.empty() &&
+               (mLru.size() > mcacheSize ||
+                (mMemoryLimit && mStats.bytes > mMemoryLimit))) {
+            remove(std::prev(mLru.end()));
+            mStats.evictions++;
+        }
+    }
+
+    std::list<Entry>                                          mLru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> mHash;
+    std::mutex                                                mMutex;
+    size_t                                                    mcacheSize{10};
+    size_t                                                    mMemoryLimit{0};
+    rlottie::ModelCacheStats                                  mStats;
 };
 
 #else
@@ -84,8 +143,10 @@ public:
         return CACHE;
     }
     std::shared_ptr<LOTModel> find(const std::string &) { return nullptr; }
-    void add(const std::string &, std::shared_ptr<LOTModel>) {}
+    void add(const std::string &, std::shared_ptr<LOTModel>, size_t) {}
     void configureCacheSize(size_t) {}
+    void configureMemoryLimit(size_t) {}
+    rlottie::ModelCacheStats stats() { return {}; }
 };
 
 #endif
@@ -95,6 +156,16 @@ void LottieLoader::configureModelCacheSize(size_t cacheSize)
     LottieModelCache::instance().configureCacheSize(cacheSize);
 }
 
+void LottieLoader::configureModelCacheMemoryLimit(size_t maxBytes)
+{
+    LottieModelCache::instance().configureMemoryLimit(maxBytes);
+}
+
+rlottie::ModelCacheStats LottieLoader::modelCacheStats()
+{
+    return LottieModelCache::instance().stats();
+}
+
 static std::string dirname(const std::string &path)
 {
     const char *ptr = strrchr(path.c_str(), '/');
@@ -134,7 +205,7 @@ bool LottieLoader::load(const std::string &path, bool cachePolicy)
         if (!mModel) return false;
 
         if (cachePolicy)
-            LottieModelCache::instance().add(path, mModel);
+            LottieModelCache::instance().add(path, mModel, content.size());
     }
 
     return true;
@@ -155,11 +226,17 @@ bool LottieLoader::loadFromData(std::string &&jsonData, const std::string &key,
     if (!mModel) return false;
 
     if (cachePolicy)
-        LottieModelCache::instance().add(key, mModel);
+        LottieModelCache::instance().add(key, mModel, jsonData.size());
 
     return true;
 }
 
+bool LottieLoader::loadFromCache(const std::string &key)
+{
+    mModel = LottieModelCache::instance().find(key);
+    return mModel != nullptr;
+}
+
 std::shared_ptr<LOTModel> LottieLoader::model()
 {
     return mModel;
@@ -23,13 +23,17 @@
 #include<memory>
 
 class LOTModel;
+namespace rlottie { struct ModelCacheStats; }
 class LottieLoader
 {
 public:
    static void configureModelCacheSize(size_t cacheSize);
+   static void configureModelCacheMemoryLimit(size_t maxBytes);
+   static rlottie::ModelCacheStats modelCacheStats();
    bool load(const std::string &filePath, bool cachePolicy);
    bool loadFromData(std::string &&jsonData, const std::string &key,
                      const std::string &resourcePath, bool cachePolicy);
+   bool loadFromCache(const std::string &key);
    std::shared_ptr<LOTModel> model();
 private:  
    std::shared_ptr<LOTModel>    mModel;
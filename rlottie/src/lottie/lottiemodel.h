@@ -23,6 +23,7 @@
 #include<memory>
 #include<unordered_map>
 #include<algorithm>
+#include<atomic>
 #include <cmath>
 #include <cstring>
 #include"vpoint.h"
@@ -170,6 +171,36 @@ inline T lerp(const T& start, const T& end, float t)
     return start + t * (end - start);
 }
 
+/*
+ * exact comparison, used to find keyframed properties that never change.
+ * interpolating between equal values gives back the same value, so they
+ * can be treated as static without affecting the rendering.
+ */
+inline bool isSameValue(float v1, float v2)
+{
+    return v1 == v2;
+}
+
+inline bool isSameValue(const VPointF &p1, const VPointF &p2)
+{
+    return p1.x() == p2.x() && p1.y() == p2.y();
+}
+
+inline bool isSameValue(const LottieColor &c1, const LottieColor &c2)
+{
+    return c1.r == c2.r && c1.g == c2.g && c1.b == c2.b;
+}
+
+inline bool isSameValue(const LottieShapeData &s1, const LottieShapeData &s2)
+{
+    if (s1.mClosed != s2.mClosed || s1.mPoints.size() != s2.mPoints.size())
+        return false;
+    for (size_t i = 0; i < s1.mPoints.size(); i++) {
+        if (!isSameValue(s1.mPoints[i], s2.mPoints[i])) return false;
+    }
+    return true;
+}
+
 template <typename T>
 struct LOTKeyFrameValue
 {
@@ -179,6 +210,9 @@ struct LOTKeyFrameValue
         return lerp(mStartValue, mEndValue, t);
     }
     float angle(float ) const { return 0;}
+    bool isConstant() const {
+        return isSameValue(mStartValue, mEndValue);
+    }
 };
 
 template <>
@@ -212,6 +246,10 @@ struct LOTKeyFrameValue<VPointF>
         }
         return 0;
     }
+
+    bool isConstant() const {
+        return !mPathKeyFrame && isSameValue(mStartValue, mEndValue);
+    }
 };
 
 
@@ -246,10 +284,9 @@ public:
         if(mKeyFrames.back().mEndFrame <= frameNo)
             return mKeyFrames.back().mValue.mEndValue;
 
-        for(const auto &keyFrame : mKeyFrames) {
-            if (frameNo >= keyFrame.mStartFrame && frameNo < keyFrame.mEndFrame)
-                return keyFrame.value(frameNo);
-        }
+        size_t index = keyFrameIndex(frameNo);
+        if (index < mKeyFrames.size())
+            return mKeyFrames[index].value(frameNo);
         return T();
     }
 
@@ -258,10 +295,9 @@ public:
             (mKeyFrames.back().mEndFrame <= frameNo) )
             return 0;
 
-        for(const auto &keyFrame : mKeyFrames) {
-            if (frameNo >= keyFrame.mStartFrame && frameNo < keyFrame.mEndFrame)
-                return keyFrame.angle(frameNo);
-        }
+        size_t index = keyFrameIndex(frameNo);
+        if (index < mKeyFrames.size())
+            return mKeyFrames[index].angle(frameNo);
         return 0;
     }
 
@@ -273,8 +309,65 @@ public:
                  (last < prevFrame  && last < curFrame));
     }
 
+    /*
+     * Index of the keyframe whose [start, end) range holds frameNo, or
+     * mKeyFrames.size() if there is none. Each keyframe ends where the next
+     * one starts, so when start frames are in order the answer is the last
+     * keyframe starting at or before frameNo. Frames are mostly rendered in
+     * sequence, so the previous answer and the one after it are tried first.
+     * The model is shared by animations rendering on different threads, the
+     * hint is only a guess and a stale one costs nothing but the search.
+     */
+    size_t keyFrameIndex(int frameNo) const {
+        auto covers = [this, frameNo](size_t i) {
+            return frameNo >= mKeyFrames[i].mStartFrame &&
+                   frameNo < mKeyFrames[i].mEndFrame;
+        };
+
+        if (!mOrdered) {
+            for (size_t i = 0; i < mKeyFrames.size(); i++)
+                if (covers(i)) return i;
+            return mKeyFrames.size();
+        }
+
+        size_t hint = mHint.load(std::memory_order_relaxed);
+        if (hint < mKeyFrames.size() && covers(hint)) return hint;
+        if (hint + 1 < mKeyFrames.size() && covers(hint + 1)) {
+            mHint.store(hint + 1, std::memory_order_relaxed);
+            return hint + 1;
+        }
+
+        auto it = std::upper_bound(mKeyFrames.begin(), mKeyFrames.end(), frameNo,
+                                   [](int frame, const LOTKeyFrame<T> &keyFrame) {
+                                       return frame < keyFrame.mStartFrame;
+                                   });
+        if (it == mKeyFrames.begin()) return mKeyFrames.size();
+        size_t index = size_t(it - mKeyFrames.begin()) - 1;
+        if (!covers(index)) return mKeyFrames.size();
+        mHint.store(index, std::memory_order_relaxed);
+        return index;
+    }
+
+    /*
+     * true if every keyframe holds one and the same value, in which case
+     * the property doesn't need to be animated at all.
+     */
+    bool isConstant() const {
+        if (!mOrdered || mKeyFrames.empty()) return false;
+        const T &first = mKeyFrames.front().mValue.mStartValue;
+        for (const auto &keyFrame : mKeyFrames) {
+            if (!keyFrame.mValue.isConstant() ||
+                !isSameValue(keyFrame.mValue.mStartValue, first))
+                return false;
+        }
+        return true;
+    }
+
 public:
     std::vector<LOTKeyFrame<T>>    mKeyFrames;
+    bool                           mOrdered{true}; /* start frames don't decrease */
+private:
+    mutable std::atomic<size_t>    mHint{0};
 };
 
 template<typename T>
@@ -332,6 +425,19 @@ public:
     bool changed(int prevFrame, int curFrame) const {
         return isStatic() ? false : animation().changed(prevFrame, curFrame);
     }
+
+    /*
+     * turns a keyframed property that never changes into a static one,
+     * so that it's not evaluated on every frame and the items using it
+     * can be treated as static too.
+     */
+    void freezeIfConstant() {
+        if (isStatic() || !animation().isConstant()) return;
+        T value = animation().mKeyFrames.front().mValue.mStartValue;
+        destroy();
+        construct(impl.mValue, std::move(value));
+        mStatic = true;
+    }
 private:
     template <typename Tp>
     void construct(Tp& member, Tp&& val)
@@ -374,13 +480,13 @@ public:
             if(vec.back().mEndFrame <= frameNo)
                 return vec.back().mValue.mEndValue.toPath(path);
 
-            for(const auto &keyFrame : vec) {
-                if (frameNo >= keyFrame.mStartFrame && frameNo < keyFrame.mEndFrame) {
-                    LottieShapeData::lerp(keyFrame.mValue.mStartValue,
-                                          keyFrame.mValue.mEndValue,
-                                          keyFrame.progress(frameNo),
-                                          path);
-                }
+            size_t index = animation().keyFrameIndex(frameNo);
+            if (index < vec.size()) {
+                const auto &keyFrame = vec[index];
+                LottieShapeData::lerp(keyFrame.mValue.mStartValue,
+                                      keyFrame.mValue.mEndValue,
+                                      keyFrame.progress(frameNo),
+                                      path);
             }
         }
     }
@@ -782,6 +888,11 @@ public:
     std::vector<float>    mGradient;
 };
 
+inline bool isSameValue(const LottieGradient &g1, const LottieGradient &g2)
+{
+    return g1.mGradient == g2.mGradient;
+}
+
 inline LottieGradient operator+(const LottieGradient &g1, const LottieGradient &g2)
 {
     if (g1.mGradient.size() != g2.mGradient.size())
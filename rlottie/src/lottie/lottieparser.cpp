@@ -51,7 +51,8 @@
 // This parser uses in-situ strings, so the JSON buffer will be altered during
 // the parse.
 
-#include <array>
+#include <cmath>
+#include <cstring>
 
 #include "lottiemodel.h"
 #include "rapidjson/document.h"
@@ -184,6 +185,8 @@ public:
     const char *GetString();
     bool        GetBool();
     void        GetNull();
+    bool        GetNumbers();
+    bool        GetPoints(std::vector<VPointF> &v);
 
     void   SkipObject();
     void   SkipArray();
@@ -249,7 +252,7 @@ public:
     template <typename T>
     void parseKeyFrame(LOTAnimInfo<T> &obj);
     template <typename T>
-    void parseProperty(LOTAnimatable<T> &obj);
+    void parseProperty(LOTAnimatable<T> &obj, bool freeze = true);
     template <typename T>
     void parsePropertyHelper(LOTAnimatable<T> &obj);
 
@@ -259,6 +262,24 @@ public:
 
     VInterpolator* interpolator(VPointF, VPointF, std::string);
 
+    // what "%.2f" makes of the tangents, without printing them
+    struct InterpolatorKey {
+        uint64_t v[4];
+        bool     operator==(const InterpolatorKey &o) const
+        {
+            return v[0] == o.v[0] && v[1] == o.v[1] && v[2] == o.v[2] &&
+                   v[3] == o.v[3];
+        }
+    };
+    struct InterpolatorKeyHash {
+        size_t operator()(const InterpolatorKey &key) const
+        {
+            uint64_t h = key.v[0];
+            for (int i = 1; i < 4; i++) h = h * 0x9E3779B97F4A7C15ull + key.v[i];
+            return size_t(h ^ (h >> 32));
+        }
+    };
+
     LottieColor toColor(const char *str);
 
     void resolveLayerRefs();
@@ -266,6 +287,8 @@ public:
 protected:
     std::unordered_map<std::string, VInterpolator*>
                                                mInterpolatorCache;
+    std::unordered_map<InterpolatorKey, VInterpolator*, InterpolatorKeyHash>
+                                               mTangentInterpolatorCache;
     std::shared_ptr<LOTCompositionData>        mComposition;
     LOTCompositionData *                       compRef{nullptr};
     LOTLayerData *                             curLayerRef{nullptr};
@@ -274,6 +297,7 @@ protected:
     std::vector<VPointF>                       mInPoint;  /* "i" */
     std::vector<VPointF>                       mOutPoint; /* "o" */
     std::vector<VPointF>                       mVertices;
+    std::vector<float>                         mNumbers;
     void                                       SkipOut(int depth);
 };
 
@@ -432,6 +456,157 @@ void LottieParserImpl::GetNull()
     ParseNext();
 }
 
+/*
+ * Point, color and gradient arrays make up most of a lottie file, so the
+ * plain numbers in them are read straight from the input instead of one
+ * reader event at a time. A number comes out exactly as the reader would
+ * make it. Anything else gives up on the whole array and the reader goes
+ * over it the usual way.
+ */
+static bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static void skipWhitespace(char *&p)
+{
+    while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t') p++;
+}
+
+static bool scanNumber(char *&p, double &value)
+{
+    char *s = p;
+    bool  minus = *s == '-';
+    if (minus) s++;
+
+    // few enough digits for the reader to keep the integer part in 32 bits
+    // and the significand within the 53 bits its fast path takes
+    uint64_t significand = 0;
+    if (*s == '0') {
+        s++;
+    } else if (isDigit(*s)) {
+        for (int digits = 0; isDigit(*s); digits++) {
+            if (digits == 9) return false;
+            significand = significand * 10 + unsigned(*s++ - '0');
+        }
+    } else {
+        return false;
+    }
+
+    bool integer = true;
+    int  exp = 0;
+    if (*s == '.') {
+        s++;
+        if (!isDigit(*s)) return false;
+        while (isDigit(*s)) {
+            if (significand > RAPIDJSON_UINT64_C2(0x1FFFFF, 0xFFFFFFFF))
+                return false;
+            significand = significand * 10 + unsigned(*s++ - '0');
+            exp--;
+        }
+        integer = false;
+    }
+    if (*s == 'e' || *s == 'E') {
+        s++;
+        bool expMinus = *s == '-';
+        if (*s == '+' || *s == '-') s++;
+        if (!isDigit(*s)) return false;
+        int e = 0;
+        while (isDigit(*s)) {
+            e = e * 10 + (*s++ - '0');
+            if (e > 300) return false;
+        }
+        exp += expMinus ? -e : e;
+        integer = false;
+    }
+    if (*s != ',' && *s != ']' && *s != ' ' && *s != '\n' && *s != '\r' &&
+        *s != '\t')
+        return false;
+
+    if (integer) {
+        value = double(minus ? -int64_t(significand) : int64_t(significand));
+    } else {
+        double d = internal::StrtodNormalPrecision(double(significand), exp);
+        if (d > (std::numeric_limits<double>::max)()) return false;
+        value = minus ? -d : d;
+    }
+    p = s;
+    return true;
+}
+
+// p is just inside an array and is left on its closing bracket
+template <typename Sink>
+static bool scanNumbers(char *&p, Sink sink)
+{
+    skipWhitespace(p);
+    if (*p == ']') return true;
+    while (true) {
+        double value;
+        if (!scanNumber(p, value)) return false;
+        sink(value);
+        skipWhitespace(p);
+        if (*p == ']') return true;
+        if (*p != ',') return false;
+        p++;
+        skipWhitespace(p);
+    }
+}
+
+// Takes an array of plain numbers into mNumbers
+bool LottieParserImpl::GetNumbers()
+{
+    if (st_ != kEnteringArray) return false;
+
+    char *p = ss_.src_;
+    mNumbers.clear();
+    if (!scanNumbers(p, [this](double value) { mNumbers.push_back(value); }))
+        return false;
+
+    // let the reader see the closing bracket
+    ss_.src_ = p;
+    EnterArray();
+    NextArrayValue();
+    return true;
+}
+
+// Takes an array of [x, y] arrays of plain numbers onto the end of v
+bool LottieParserImpl::GetPoints(std::vector<VPointF> &v)
+{
+    if (st_ != kEnteringArray) return false;
+
+    char * p = ss_.src_;
+    size_t size = v.size();
+    skipWhitespace(p);
+    while (*p != ']') {
+        float val[2] = {0.f};
+        int   i = 0;
+        if (*p != '[') break;
+        p++;
+        if (!scanNumbers(p, [&](double value) {
+                if (i < 2) val[i++] = value;
+            }))
+            break;
+        v.emplace_back(val[0], val[1]);
+        p++;
+        skipWhitespace(p);
+        if (*p == ',') {
+            p++;
+            skipWhitespace(p);
+        } else if (*p != ']') {
+            break;
+        }
+    }
+    if (*p != ']') {
+        v.resize(size);
+        return false;
+    }
+
+    ss_.src_ = p;
+    EnterArray();
+    NextArrayValue();
+    return true;
+}
+
 const char *LottieParserImpl::GetString()
 {
     if (st_ != kHasString) {
@@ -922,7 +1097,9 @@ LOTLayerData* LottieParserImpl::parseLayer()
             RAPIDJSON_ASSERT(PeekType() == kNumberType);
             layer->mTimeStreatch = GetDouble();
         } else if (0 == strcmp(key, "tm")) {  // time remapping
-            parseProperty(layer->extra()->mTimeRemap);
+            // a constant time remap still holds the layer at that time,
+            // so it must stay keyframed.
+            parseProperty(layer->extra()->mTimeRemap, false);
         } else if (0 == strcmp(key, "ip")) {
             RAPIDJSON_ASSERT(PeekType() == kNumberType);
             layer->mInFrame = std::lround(GetDouble());
@@ -1434,6 +1611,7 @@ LOTTransformData* LottieParserImpl::parseTransformObject(
             while (const char *key = NextObjectKey()) {
                 if (0 == strcmp(key, "k")) {
                     parsePropertyHelper(obj->mPosition);
+                    obj->mPosition.freezeIfConstant();
                 } else if (0 == strcmp(key, "s")) {
                     obj->createExtraData();
                     obj->mExtra->mSeparate = GetBool();
@@ -1719,6 +1897,7 @@ LOTGStrokeData* LottieParserImpl::parseGStrokeObject()
 void LottieParserImpl::getValue(std::vector<VPointF> &v)
 {
     RAPIDJSON_ASSERT(PeekType() == kArrayType);
+    if (GetPoints(v)) return;
     EnterArray();
     while (NextArrayValue()) {
         RAPIDJSON_ASSERT(PeekType() == kArrayType);
@@ -1734,13 +1913,20 @@ void LottieParserImpl::getValue(VPointF &pt)
     float val[4] = {0.f};
     int   i = 0;
 
-    if (PeekType() == kArrayType) EnterArray();
-
-    while (NextArrayValue()) {
-        const auto value = GetDouble();
-        if (i < 4) {
+    if (GetNumbers()) {
+        for (float value : mNumbers) {
+            if (i == 4) break;
             val[i++] = value;
         }
+    } else {
+        if (PeekType() == kArrayType) EnterArray();
+
+        while (NextArrayValue()) {
+            const auto value = GetDouble();
+            if (i < 4) {
+                val[i++] = value;
+            }
+        }
     }
     pt.setX(val[0]);
     pt.setY(val[1]);
@@ -1748,7 +1934,9 @@ void LottieParserImpl::getValue(VPointF &pt)
 
 void LottieParserImpl::getValue(float &val)
 {
-    if (PeekType() == kArrayType) {
+    if (GetNumbers()) {
+        if (!mNumbers.empty()) val = mNumbers[0];
+    } else if (PeekType() == kArrayType) {
         EnterArray();
         if (NextArrayValue()) val = GetDouble();
         // discard rest
@@ -1766,13 +1954,20 @@ void LottieParserImpl::getValue(LottieColor &color)
 {
     float val[4] = {0.f};
     int   i = 0;
-    if (PeekType() == kArrayType) EnterArray();
-
-    while (NextArrayValue()) {
-        const auto value = GetDouble();
-        if (i < 4) {
+    if (GetNumbers()) {
+        for (float value : mNumbers) {
+            if (i == 4) break;
             val[i++] = value;
         }
+    } else {
+        if (PeekType() == kArrayType) EnterArray();
+
+        while (NextArrayValue()) {
+            const auto value = GetDouble();
+            if (i < 4) {
+                val[i++] = value;
+            }
+        }
     }
     color.r = val[0];
     color.g = val[1];
@@ -1781,6 +1976,12 @@ void LottieParserImpl::getValue(LottieColor &color)
 
 void LottieParserImpl::getValue(LottieGradient &grad)
 {
+    if (GetNumbers()) {
+        grad.mGradient.insert(grad.mGradient.end(), mNumbers.begin(),
+                              mNumbers.end());
+        return;
+    }
+
     if (PeekType() == kArrayType) EnterArray();
 
     while (NextArrayValue()) {
@@ -1915,10 +2116,25 @@ VInterpolator* LottieParserImpl::interpolator(
     VPointF inTangent, VPointF outTangent, std::string key)
 {
     if (key.empty()) {
-        std::array<char, 20> temp;
-        snprintf(temp.data(), temp.size(), "%.2f_%.2f_%.2f_%.2f", inTangent.x(),
-                 inTangent.y(), outTangent.x(), outTangent.y());
-        key = temp.data();
+        // hundredths rounded half to even, as printf does, and the sign
+        // of a zero kept apart the way "-0.00" is; a float times 100 is
+        // exact in a double
+        float tangents[4] = {inTangent.x(), inTangent.y(), outTangent.x(),
+                             outTangent.y()};
+        InterpolatorKey numeric;
+        for (int i = 0; i < 4; i++) {
+            double rounded = std::nearbyint(double(tangents[i]) * 100);
+            memcpy(&numeric.v[i], &rounded, sizeof(rounded));
+        }
+
+        auto search = mTangentInterpolatorCache.find(numeric);
+        if (search != mTangentInterpolatorCache.end()) {
+            return search->second;
+        }
+
+        auto obj = allocator().make<VInterpolator>(outTangent, inTangent);
+        mTangentInterpolatorCache[numeric] = obj;
+        return obj;
     }
 
     auto search = mInterpolatorCache.find(key);
@@ -1999,6 +2215,8 @@ void LottieParserImpl::parseKeyFrame(LOTAnimInfo<T> &obj)
     }
 
     if (!obj.mKeyFrames.empty()) {
+        if (keyframe.mStartFrame < obj.mKeyFrames.back().mStartFrame)
+            obj.mOrdered = false;
         // update the endFrame value of current keyframe
         obj.mKeyFrames.back().mEndFrame = keyframe.mStartFrame;
         // if no end value provided, copy start value to previous frame
@@ -2054,6 +2272,7 @@ void LottieParserImpl::parseShapeProperty(LOTAnimatable<LottieShapeData> &obj)
             Skip(nullptr);
         }
     }
+    obj.freezeIfConstant();
 }
 
 template <typename T>
@@ -2100,7 +2319,7 @@ void LottieParserImpl::parsePropertyHelper(LOTAnimatable<T> &obj)
  * https://github.com/airbnb/lottie-web/tree/master/docs/json/properties
  */
 template <typename T>
-void LottieParserImpl::parseProperty(LOTAnimatable<T> &obj)
+void LottieParserImpl::parseProperty(LOTAnimatable<T> &obj, bool freeze)
 {
     EnterObject();
     while (const char *key = NextObjectKey()) {
@@ -2110,6 +2329,7 @@ void LottieParserImpl::parseProperty(LOTAnimatable<T> &obj)
             Skip(key);
         }
     }
+    if (freeze) obj.freezeIfConstant();
 }
 
 #ifdef LOTTIE_DUMP_TREE_SUPPORT
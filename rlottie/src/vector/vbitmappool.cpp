@@ -0,0 +1,74 @@
+#include "vbitmappool.h"
+#include <algorithm>
+
+VBitmapPool::Bitmap::Bitmap(size_t width, size_t height)
+    : mSize(width * height * 4)
+{
+    mData = instance().take(mSize);
+    mBitmap = VBitmap(mData.get(), width, height, width * 4,
+                      VBitmap::Format::ARGB32_Premultiplied);
+}
+
+VBitmapPool::Bitmap::~Bitmap()
+{
+    instance().give(std::move(mData), mSize);
+}
+
+std::unique_ptr<uchar[]> VBitmapPool::take(size_t size)
+{
+    if (!size) return nullptr;
+
+    std::lock_guard<std::mutex> guard(mMutex);
+
+    mInUse += size;
+    auto found = std::find_if(mFree.begin(), mFree.end(),
+                              [size](const Buffer &b) { return b.first == size; });
+    if (found != mFree.end()) {
+        std::unique_ptr<uchar[]> data = std::move(found->second);
+        mStats.bytes -= size;
+        mFree.erase(found);
+        mStats.hits++;
+        return data;
+    }
+
+    mStats.misses++;
+    mStats.peakBytes = std::max(mStats.peakBytes, mInUse + mStats.bytes);
+    // no need to clear it, painters do that when they begin
+    return std::unique_ptr<uchar[]>(new uchar[size]);
+}
+
+void VBitmapPool::give(std::unique_ptr<uchar[]> data, size_t size)
+{
+    if (!data) return;
+
+    std::lock_guard<std::mutex> guard(mMutex);
+
+    mInUse -= size;
+    if (size > mLimit) return;
+
+    mFree.emplace_front(size, std::move(data));
+    mStats.bytes += size;
+    trim();
+}
+
+// free the buffers given back longest ago until within the limit
+void VBitmapPool::trim()
+{
+    while (mStats.bytes > mLimit) {
+        mStats.bytes -= mFree.back().first;
+        mFree.pop_back();
+    }
+}
+
+void VBitmapPool::configureMemoryLimit(size_t maxBytes)
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    mLimit = maxBytes;
+    trim();
+}
+
+VBitmapPool::Stats VBitmapPool::stats() const
+{
+    std::lock_guard<std::mutex> guard(mMutex);
+    return mStats;
+}
@@ -0,0 +1,70 @@
+#ifndef VBITMAPPOOL_H
+#define VBITMAPPOOL_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include "vbitmap.h"
+
+/*
+ * Memory for the bitmaps a frame is drawn into on the way, for track
+ * mattes and for layers drawn with an opacity. Buffers given back are
+ * kept by size for the next frame, or for another animation of the same
+ * size on any thread, up to a memory limit past which the ones given back
+ * longest ago are freed.
+ */
+class VBitmapPool {
+public:
+    struct Stats {
+        size_t   bytes{0};
+        size_t   peakBytes{0};
+        uint64_t hits{0};
+        uint64_t misses{0};
+    };
+
+    // An ARGB32_Premultiplied bitmap borrowed from the pool while it
+    // lives. Its pixels are left as the last user drew them.
+    class Bitmap {
+    public:
+        Bitmap(size_t width, size_t height);
+        ~Bitmap();
+        Bitmap(const Bitmap &) = delete;
+        Bitmap &operator=(const Bitmap &) = delete;
+
+        VBitmap &bitmap() { return mBitmap; }
+
+    private:
+        std::unique_ptr<uchar[]> mData;
+        size_t                   mSize;
+        VBitmap                  mBitmap;
+    };
+
+    static VBitmapPool &instance()
+    {
+        static VBitmapPool POOL;
+        return POOL;
+    }
+
+    // Bytes kept for reuse at most, 0 to free buffers as soon as they
+    // are given back
+    void  configureMemoryLimit(size_t maxBytes);
+    Stats stats() const;
+
+private:
+    using Buffer = std::pair<size_t, std::unique_ptr<uchar[]>>;
+
+    VBitmapPool() = default;
+
+    std::unique_ptr<uchar[]> take(size_t size);
+    void                     give(std::unique_ptr<uchar[]> data, size_t size);
+    void                     trim();
+
+    mutable std::mutex mMutex;
+    std::list<Buffer>  mFree;  // most recently given back first
+    size_t             mLimit{8 * 1024 * 1024};
+    size_t             mInUse{0};
+    Stats              mStats;
+};
+
+#endif  // VBITMAPPOOL_H
@@ -18,6 +18,47 @@
 
 #include "vdrawhelper.h"
 
+void memfill32_C(uint32_t *dest, uint32_t value, int length)
+{
+    int n;
+
+    if (length <= 0) return;
+
+    // Cute hack to align future memcopy operation
+    // and do unroll the loop a bit. Not sure it is
+    // the most efficient, but will do for now.
+    n = (length + 7) / 8;
+    switch (length & 0x07) {
+    case 0:
+        do {
+            *dest++ = value;
+            VECTOR_FALLTHROUGH;
+        case 7:
+            *dest++ = value;
+            VECTOR_FALLTHROUGH;
+        case 6:
+            *dest++ = value;
+            VECTOR_FALLTHROUGH;
+        case 5:
+            *dest++ = value;
+            VECTOR_FALLTHROUGH;
+        case 4:
+            *dest++ = value;
+            VECTOR_FALLTHROUGH;
+        case 3:
+            *dest++ = value;
+            VECTOR_FALLTHROUGH;
+        case 2:
+            *dest++ = value;
+            VECTOR_FALLTHROUGH;
+        case 1:
+            *dest++ = value;
+        } while (--n > 0);
+    }
+}
+
+MemFillFunction memfill32 = memfill32_C;
+
 /*
   result = s
   dest = s * ca + d * cia
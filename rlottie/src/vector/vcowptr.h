@@ -21,6 +21,7 @@
 
 #include <cassert>
 #include <atomic>
+#include "vfreelist.h"
 
 template <typename T>
 class vcow_ptr {
@@ -33,6 +34,13 @@ class vcow_ptr {
         explicit model(Args&&... args) : mValue(std::forward<Args>(args)...){}
         explicit model(const T& other) : mValue(other){}
 
+        // shapes replace their data every frame, keep the nodes around
+        static void* operator new(std::size_t)
+        {
+            return VFreeList<sizeof(model)>::take();
+        }
+        static void operator delete(void* p) { VFreeList<sizeof(model)>::give(p); }
+
         T mValue;
     };
     model* mModel;
@@ -42,8 +50,9 @@ public:
 
     vcow_ptr()
     {
-        static model default_s;
-        mModel = &default_s;
+        // allocated once and never released, as the pooled delete must not see a static object
+        static model *default_s = new model();
+        mModel = default_s;
         ++mModel->mRef;
     }
 
@@ -57,17 +57,27 @@ void VDrawable::applyDashOp()
     }
 }
 
+/*
+ * A path that only moved by whole pixels since it was last rasterized
+ * gets the old rle moved along with it. That skips flattening and, for
+ * strokes, running the stroker again, which is most of the work for
+ * static shapes carried around by their layer or group.
+ */
 void VDrawable::preprocess(const VRect &clip)
 {
     if (mFlag & (DirtyState::Path)) {
-        if (mType == Type::Fill) {
-            mRasterizer.rasterize(std::move(mPath), mFillRule, clip);
-        } else {
-            applyDashOp();
-            mRasterizer.rasterize(std::move(mPath), mStrokeInfo->cap, mStrokeInfo->join,
-                                  mStrokeInfo->width, mStrokeInfo->miterLimit, clip);
+        if (!mMovable || !mRasterizer.translate(mOffset, clip)) {
+            if (mType == Type::Fill) {
+                mRasterizer.rasterize(std::move(mPath), mFillRule, clip);
+            } else {
+                applyDashOp();
+                mRasterizer.rasterize(std::move(mPath), mStrokeInfo->cap, mStrokeInfo->join,
+                                      mStrokeInfo->width, mStrokeInfo->miterLimit, clip);
+            }
         }
         mPath = {};
+        mMovable = true;
+        mOffset = VPoint();
         mFlag &= ~DirtyFlag(DirtyState::Path);
     }
 }
@@ -91,6 +101,7 @@ void VDrawable::setStrokeInfo(CapStyle cap, JoinStyle join, float miterLimit,
     mStrokeInfo->miterLimit = miterLimit;
     mStrokeInfo->width = strokeWidth;
     mFlag |= DirtyState::Path;
+    mMovable = false;
 }
 
 void VDrawable::setDashInfo(std::vector<float> &dashInfo)
@@ -117,10 +128,19 @@ void VDrawable::setDashInfo(std::vector<float> &dashInfo)
     obj->mDash = dashInfo;
 
     mFlag |= DirtyState::Path;
+    mMovable = false;
 }
 
 void VDrawable::setPath(const VPath &path)
 {
     mPath = path;
     mFlag |= DirtyState::Path;
+    mMovable = false;
+}
+
+void VDrawable::setPath(const VPath &path, const VPoint &offset)
+{
+    mPath = path;
+    mFlag |= DirtyState::Path;
+    mOffset += offset;
 }
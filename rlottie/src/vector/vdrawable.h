@@ -47,6 +47,8 @@ public:
 
     typedef vFlag<DirtyState> DirtyFlag;
     void setPath(const VPath &path);
+    // path is the one set before moved by offset, see preprocess()
+    void setPath(const VPath &path, const VPoint &offset);
     void setFillRule(FillRule rule) { mFillRule = rule; }
     void setBrush(const VBrush &brush) { mBrush = brush; }
     void setStrokeInfo(CapStyle cap, JoinStyle join, float miterLimit,
@@ -82,6 +84,9 @@ public:
     DirtyFlag                mFlag{DirtyState::All};
     FillRule                 mFillRule{FillRule::Winding};
     VDrawable::Type          mType{Type::Fill};
+    // the rasterized path moved by mOffset is still what mPath is
+    bool                     mMovable{false};
+    VPoint                   mOffset;
 
     const char              *mName{nullptr};
 };
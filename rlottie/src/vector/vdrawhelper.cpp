@@ -51,150 +51,10 @@
 ****************************************************************************/
 
 #include "vdrawhelper.h"
+#include "vgradientcache.h"
 #include <algorithm>
 #include <climits>
 #include <cstring>
-#include <mutex>
-#include <unordered_map>
-
-class VGradientCache {
-public:
-    struct CacheInfo : public VColorTable {
-        inline CacheInfo(VGradientStops s) : stops(std::move(s)) {}
-        VGradientStops stops;
-    };
-    using VCacheData = std::shared_ptr<const CacheInfo>;
-    using VCacheKey = int64_t;
-    using VGradientColorTableHash =
-        std::unordered_multimap<VCacheKey, VCacheData>;
-
-    bool generateGradientColorTable(const VGradientStops &stops, float alpha,
-                                    uint32_t *colorTable, int size);
-    VCacheData getBuffer(const VGradient &gradient)
-    {
-        VCacheKey             hash_val = 0;
-        VCacheData            info;
-        const VGradientStops &stops = gradient.mStops;
-        for (uint i = 0; i < stops.size() && i <= 2; i++)
-            hash_val += VCacheKey(stops[i].second.premulARGB() * gradient.alpha());
-
-        {
-            std::lock_guard<std::mutex> guard(mMutex);
-
-            size_t count = mCache.count(hash_val);
-            if (!count) {
-                // key is not present in the hash
-                info = addCacheElement(hash_val, gradient);
-            } else if (count == 1) {
-                auto search = mCache.find(hash_val);
-                if (search->second->stops == stops) {
-                    info = search->second;
-                } else {
-                    // didn't find an exact match
-                    info = addCacheElement(hash_val, gradient);
-                }
-            } else {
-                // we have a multiple data with same key
-                auto range = mCache.equal_range(hash_val);
-                for (auto it = range.first; it != range.second; ++it) {
-                    if (it->second->stops == stops) {
-                        info = it->second;
-                        break;
-                    }
-                }
-                if (!info) {
-                    // didn't find an exact match
-                    info = addCacheElement(hash_val, gradient);
-                }
-            }
-        }
-        return info;
-    }
-
-    static VGradientCache &instance()
-      {
-         static VGradientCache CACHE;
-         return CACHE;
-      }
-
-protected:
-    uint       maxCacheSize() const { return 60; }
-    VCacheData addCacheElement(VCacheKey hash_val, const VGradient &gradient)
-    {
-        if (mCache.size() == maxCacheSize()) {
-            uint count = maxCacheSize() / 10;
-            while (count--) {
-                mCache.erase(mCache.begin());
-            }
-        }
-        auto cache_entry = std::make_shared<CacheInfo>(gradient.mStops);
-        cache_entry->alpha = generateGradientColorTable(
-            gradient.mStops, gradient.alpha(), cache_entry->buffer32,
-            VGradient::colorTableSize);
-        mCache.insert(std::make_pair(hash_val, cache_entry));
-        return cache_entry;
-    }
-
-private:
-    VGradientCache() = default;
-
-    VGradientColorTableHash mCache;
-    std::mutex              mMutex;
-};
-
-bool VGradientCache::generateGradientColorTable(const VGradientStops &stops,
-                                                float                 opacity,
-                                                uint32_t *colorTable, int size)
-{
-    int                  dist, idist, pos = 0;
-    size_t i;
-    bool                 alpha = false;
-    size_t               stopCount = stops.size();
-    const VGradientStop *curr, *next, *start;
-    uint32_t             curColor, nextColor;
-    float                delta, t, incr, fpos;
-
-    if (!vCompare(opacity, 1.0f)) alpha = true;
-
-    start = stops.data();
-    curr = start;
-    if (!curr->second.isOpaque()) alpha = true;
-    curColor = curr->second.premulARGB(opacity);
-    incr = 1.0f / (float)size;
-    fpos = 1.5f * incr;
-
-    colorTable[pos++] = curColor;
-
-    while (fpos <= curr->first) {
-        colorTable[pos] = colorTable[pos - 1];
-        pos++;
-        fpos += incr;
-    }
-
-    for (i = 0; i < stopCount - 1; ++i) {
-        curr = (start + i);
-        next = (start + i + 1);
-        delta = 1 / (next->first - curr->first);
-        if (!next->second.isOpaque()) alpha = true;
-        nextColor = next->second.premulARGB(opacity);
-        while (fpos < next->first && pos < size) {
-            t = (fpos - curr->first) * delta;
-            dist = (int)(255 * t);
-            idist = 255 - dist;
-            colorTable[pos] =
-                INTERPOLATE_PIXEL_255(curColor, idist, nextColor, dist);
-            ++pos;
-            fpos += incr;
-        }
-        curColor = nextColor;
-    }
-
-    for (; pos < size; ++pos) colorTable[pos] = curColor;
-
-    // Make sure the last color stop is represented at the end of the table
-    colorTable[size - 1] = curColor;
-    return alpha;
-}
 
 void VRasterBuffer::clear()
 {
@@ -874,62 +734,24 @@ void VSpanData::updateSpanFunc()
     }
 }
 
-#if !defined(__SSE2__) && !defined(__ARM_NEON__)
-void memfill32(uint32_t *dest, uint32_t value, int length)
-{
-    int n;
-
-    if (length <= 0) return;
-
-    // Cute hack to align future memcopy operation
-    // and do unroll the loop a bit. Not sure it is
-    // the most efficient, but will do for now.
-    n = (length + 7) / 8;
-    switch (length & 0x07) {
-    case 0:
-        do {
-            *dest++ = value;
-            VECTOR_FALLTHROUGH;
-        case 7:
-            *dest++ = value;
-            VECTOR_FALLTHROUGH;
-        case 6:
-            *dest++ = value;
-            VECTOR_FALLTHROUGH;
-        case 5:
-            *dest++ = value;
-            VECTOR_FALLTHROUGH;
-        case 4:
-            *dest++ = value;
-            VECTOR_FALLTHROUGH;
-        case 3:
-            *dest++ = value;
-            VECTOR_FALLTHROUGH;
-        case 2:
-            *dest++ = value;
-            VECTOR_FALLTHROUGH;
-        case 1:
-            *dest++ = value;
-        } while (--n > 0);
-    }
-}
-#endif
-
 void vInitDrawhelperFunctions()
 {
     vInitBlendFunctions();
 
 #if defined(__ARM_NEON__)
     // update fast path for NEON
+    extern void memfill32_neon(uint32_t * dest, uint32_t value, int length);
     extern void Vcomp_func_solid_SourceOver_neon(
         uint32_t * dest, int length, uint32_t color, uint32_t const_alpha);
 
+    memfill32 = memfill32_neon;
     COMP_functionForModeSolid_C[uint(BlendMode::SrcOver)] =
         Vcomp_func_solid_SourceOver_neon;
 #endif
 
 #if defined(__SSE2__)
     // update fast path for SSE2
+    extern void memfill32_sse2(uint32_t * dest, uint32_t value, int length);
     extern void Vcomp_func_solid_SourceOver_sse2(
         uint32_t * dest, int length, uint32_t color, uint32_t const_alpha);
     extern void Vcomp_func_solid_Source_sse2(
@@ -939,6 +761,7 @@ void vInitDrawhelperFunctions()
     extern void Vcomp_func_SourceOver_sse2(uint32_t * dest, const uint32_t *src,
                                           int length, uint32_t const_alpha);
 
+    memfill32 = memfill32_sse2;
     COMP_functionForModeSolid_C[uint(BlendMode::Src)] =
         Vcomp_func_solid_Source_sse2;
     COMP_functionForModeSolid_C[uint(BlendMode::SrcOver)] =
@@ -948,6 +771,20 @@ void vInitDrawhelperFunctions()
     // COMP_functionForMode_C[uint(BlendMode::SrcOver)] =
     // Vcomp_func_SourceOver_sse2;
 #endif
+
+#if defined(VECTOR_AVX2_SUPPORT)
+    // update fast path for AVX2, decided at runtime so that the same
+    // binary still runs on cpus without it.
+    if (vCpuSupportsAvx2()) {
+        memfill32 = memfill32_avx2;
+        COMP_functionForModeSolid_C[uint(BlendMode::Src)] =
+            Vcomp_func_solid_Source_avx2;
+        COMP_functionForModeSolid_C[uint(BlendMode::SrcOver)] =
+            Vcomp_func_solid_SourceOver_avx2;
+        COMP_functionForMode_C[uint(BlendMode::SrcOver)] =
+            Vcomp_func_SourceOver_avx2;
+    }
+#endif
 }
 
 V_CONSTRUCTOR_FUNCTION(vInitDrawhelperFunctions)
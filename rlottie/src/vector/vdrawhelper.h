@@ -42,7 +42,30 @@ typedef void (*SourceFetchProc)(uint32_t *buffer, const Operator *o,
 typedef void (*ProcessRleSpan)(size_t count, const VRle::Span *spans,
                                void *userData);
 
-extern void memfill32(uint32_t *dest, uint32_t value, int count);
+typedef void (*MemFillFunction)(uint32_t *dest, uint32_t value, int count);
+
+/*
+ * points to the fastest fill the build and the cpu allow, selected by
+ * vInitDrawhelperFunctions().
+ */
+extern MemFillFunction memfill32;
+void memfill32_C(uint32_t *dest, uint32_t value, int count);
+
+/*
+ * AVX2 kernels are compiled with a per function target attribute, so they
+ * are part of every x86 build and only used when the cpu has AVX2.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define VECTOR_AVX2_SUPPORT
+bool vCpuSupportsAvx2();
+void memfill32_avx2(uint32_t *dest, uint32_t value, int count);
+void Vcomp_func_solid_Source_avx2(uint32_t *dest, int length, uint32_t color,
+                                  uint32_t const_alpha);
+void Vcomp_func_solid_SourceOver_avx2(uint32_t *dest, int length,
+                                      uint32_t color, uint32_t const_alpha);
+void Vcomp_func_SourceOver_avx2(uint32_t *dest, const uint32_t *src,
+                                int length, uint32_t const_alpha);
+#endif
 
 struct LinearGradientValues {
     float dx;
@@ -0,0 +1,172 @@
+#include "vdrawhelper.h"
+
+#if defined(VECTOR_AVX2_SUPPORT)
+
+#include <immintrin.h>
+
+/*
+ * Only the functions below are compiled for AVX2, the rest of the library
+ * keeps the baseline instruction set. vInitDrawhelperFunctions() installs
+ * them when vCpuSupportsAvx2() says so. Results are bit for bit the same as
+ * the C versions in vcompositionfunctions.cpp.
+ */
+#define V_AVX2 __attribute__((target("avx2")))
+
+bool vCpuSupportsAvx2()
+{
+    // may run from a static constructor, before libgcc did this itself
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+// BYTE_MUL() for 8 pixels, each 32bits component of a must be 0x00AA00AA
+V_AVX2 static inline __m256i v8_byte_mul_avx2(__m256i c, __m256i a)
+{
+    const __m256i ag_mask = _mm256_set1_epi32(0xFF00FF00);
+    const __m256i rb_mask = _mm256_set1_epi32(0x00FF00FF);
+
+    /* for AG */
+    __m256i v_ag = _mm256_and_si256(ag_mask, c);
+    v_ag = _mm256_srli_epi32(v_ag, 8);
+    v_ag = _mm256_mullo_epi16(a, v_ag);
+    v_ag = _mm256_and_si256(ag_mask, v_ag);
+
+    /* for RB */
+    __m256i v_rb = _mm256_and_si256(rb_mask, c);
+    v_rb = _mm256_mullo_epi16(a, v_rb);
+    v_rb = _mm256_srli_epi32(v_rb, 8);
+    v_rb = _mm256_and_si256(rb_mask, v_rb);
+
+    /* combine */
+    return _mm256_add_epi32(v_ag, v_rb);
+}
+
+// 255 - alpha of each pixel, in the form BYTE_MUL() takes
+V_AVX2 static inline __m256i v8_ialpha_avx2(__m256i c)
+{
+    __m256i ia = _mm256_srli_epi32(_mm256_xor_si256(c, _mm256_set1_epi32(-1)), 24);
+    return _mm256_or_si256(ia, _mm256_slli_epi32(ia, 16));
+}
+
+V_AVX2 void memfill32_avx2(uint32_t *dest, uint32_t value, int length)
+{
+    const __m256i v_value = _mm256_set1_epi32(int(value));
+
+    // stores split across cache lines are slow, align dest first
+    while (length > 0 && ((uintptr_t)dest & 0x1f)) {
+        *dest++ = value;
+        length--;
+    }
+
+    while (length >= 32) {
+        _mm256_store_si256((__m256i *)(dest), v_value);
+        _mm256_store_si256((__m256i *)(dest + 8), v_value);
+        _mm256_store_si256((__m256i *)(dest + 16), v_value);
+        _mm256_store_si256((__m256i *)(dest + 24), v_value);
+        dest += 32;
+        length -= 32;
+    }
+
+    while (length >= 8) {
+        _mm256_store_si256((__m256i *)dest, v_value);
+        dest += 8;
+        length -= 8;
+    }
+
+    while (length > 0) {
+        *dest++ = value;
+        length--;
+    }
+}
+
+// dest = color + (dest * alpha)
+V_AVX2 static inline void comp_func_helper_avx2(uint32_t *dest, int length,
+                                                uint32_t color, uint32_t alpha)
+{
+    const __m256i v_color = _mm256_set1_epi32(int(color));
+    const __m256i v_a = _mm256_set1_epi16(short(alpha));
+
+    for (; length >= 8; length -= 8, dest += 8) {
+        __m256i v_dest = _mm256_loadu_si256((const __m256i *)dest);
+        v_dest = _mm256_add_epi32(v8_byte_mul_avx2(v_dest, v_a), v_color);
+        _mm256_storeu_si256((__m256i *)dest, v_dest);
+    }
+
+    for (; length > 0; length--, dest++) *dest = color + BYTE_MUL(*dest, alpha);
+}
+
+V_AVX2 void Vcomp_func_solid_Source_avx2(uint32_t *dest, int length,
+                                         uint32_t color, uint32_t const_alpha)
+{
+    if (const_alpha == 255) {
+        memfill32_avx2(dest, color, length);
+    } else {
+        color = BYTE_MUL(color, const_alpha);
+        comp_func_helper_avx2(dest, length, color, 255 - const_alpha);
+    }
+}
+
+V_AVX2 void Vcomp_func_solid_SourceOver_avx2(uint32_t *dest, int length,
+                                             uint32_t color,
+                                             uint32_t const_alpha)
+{
+    if (const_alpha != 255) color = BYTE_MUL(color, const_alpha);
+    comp_func_helper_avx2(dest, length, color, 255 - vAlpha(color));
+}
+
+/* s' = s * ca
+ * d' = s' + d (1 - s'a)
+ * like the C version, transparent source pixels leave dest untouched when
+ * there is no const_alpha.
+ */
+V_AVX2 void Vcomp_func_SourceOver_avx2(uint32_t *dest, const uint32_t *src,
+                                       int length, uint32_t const_alpha)
+{
+    const __m256i alpha_mask = _mm256_set1_epi32(int(0xff000000));
+    uint32_t      s, sia;
+
+    if (const_alpha == 255) {
+        for (; length >= 8; length -= 8, dest += 8, src += 8) {
+            __m256i v_src = _mm256_loadu_si256((const __m256i *)src);
+
+            if (_mm256_testz_si256(v_src, v_src)) continue;
+            if (!_mm256_testc_si256(v_src, alpha_mask)) {
+                __m256i v_dest = _mm256_loadu_si256((const __m256i *)dest);
+                __m256i v_zero = _mm256_cmpeq_epi32(v_src, _mm256_setzero_si256());
+                __m256i v_blend = _mm256_add_epi32(
+                    v_src, v8_byte_mul_avx2(v_dest, v8_ialpha_avx2(v_src)));
+                v_src = _mm256_blendv_epi8(v_blend, v_dest, v_zero);
+            }
+            _mm256_storeu_si256((__m256i *)dest, v_src);
+        }
+
+        for (; length > 0; length--, dest++, src++) {
+            s = *src;
+            if (s >= 0xff000000)
+                *dest = s;
+            else if (s != 0) {
+                sia = vAlpha(~s);
+                *dest = s + BYTE_MUL(*dest, sia);
+            }
+        }
+    } else {
+        const __m256i v_alpha = _mm256_set1_epi16(short(const_alpha));
+
+        for (; length >= 8; length -= 8, dest += 8, src += 8) {
+            __m256i v_src = _mm256_loadu_si256((const __m256i *)src);
+            __m256i v_dest = _mm256_loadu_si256((const __m256i *)dest);
+
+            v_src = v8_byte_mul_avx2(v_src, v_alpha);
+            v_dest = v8_byte_mul_avx2(v_dest, v8_ialpha_avx2(v_src));
+            _mm256_storeu_si256((__m256i *)dest, _mm256_add_epi32(v_src, v_dest));
+        }
+
+        for (; length > 0; length--, dest++, src++) {
+            s = BYTE_MUL(*src, const_alpha);
+            sia = vAlpha(~s);
+            *dest = s + BYTE_MUL(*dest, sia);
+        }
+    }
+}
+
+#endif
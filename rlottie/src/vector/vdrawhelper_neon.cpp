@@ -12,7 +12,7 @@ extern "C" void pixman_composite_over_n_8888_asm_neon(int32_t w, int32_t h,
                                                       int32_t   dst_stride,
                                                       uint32_t  src);
 
-void memfill32(uint32_t *dest, uint32_t value, int length)
+void memfill32_neon(uint32_t *dest, uint32_t value, int length)
 {
     pixman_composite_src_n_8888_asm_neon(length, 1, dest, length, value);
 }
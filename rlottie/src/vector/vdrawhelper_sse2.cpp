@@ -115,7 +115,7 @@ static inline __m128i v4_interpolate_color_sse2(__m128i a, __m128i c0,
 #define V4_COMP_OP_SRC \
     v_src = v4_interpolate_color_sse2(v_alpha, v_src, v_dest);
 
-void memfill32(uint32_t* dest, uint32_t value, int length)
+void memfill32_sse2(uint32_t* dest, uint32_t value, int length)
 {
     __m128i vector_data = _mm_set_epi32(value, value, value, value);
 
@@ -200,7 +200,7 @@ void Vcomp_func_solid_Source_sse2(uint32_t* dest, int length, uint32_t color,
                                  uint32_t const_alpha)
 {
     if (const_alpha == 255) {
-        memfill32(dest, color, length);
+        memfill32_sse2(dest, color, length);
     } else {
         int ialpha;
 
@@ -0,0 +1,75 @@
+#ifndef VFREELIST_H
+#define VFREELIST_H
+
+#include <cstddef>
+#include <new>
+
+/*
+ * Keeps released blocks of one size for the thread that released them,
+ * so objects that are dropped and created again every frame don't go
+ * back to malloc each time. A block may be taken on one thread and given
+ * back on another. Blocks given back while the thread is exiting, after
+ * its list is gone, are simply freed.
+ */
+template <size_t Size>
+class VFreeList {
+    static constexpr size_t MaxBlocks = 256;
+
+    struct Block {
+        Block *next;
+    };
+
+    struct List {
+        Block *mHead{nullptr};
+        size_t mCount{0};
+        bool & mGone;
+
+        explicit List(bool &gone) : mGone(gone) {}
+        ~List()
+        {
+            while (mHead) {
+                Block *next = mHead->next;
+                ::operator delete(mHead);
+                mHead = next;
+            }
+            mGone = true;
+        }
+    };
+
+    static List *local()
+    {
+        static thread_local bool gone = false;
+        if (gone) return nullptr;
+        static thread_local List list(gone);
+        return &list;
+    }
+
+public:
+    static_assert(Size >= sizeof(Block), "block too small to link");
+
+    static void *take()
+    {
+        List *list = local();
+        if (!list || !list->mHead) return ::operator new(Size);
+        Block *block = list->mHead;
+        list->mHead = block->next;
+        list->mCount--;
+        return block;
+    }
+
+    static void give(void *p)
+    {
+        if (!p) return;
+        List *list = local();
+        if (!list || list->mCount == MaxBlocks) {
+            ::operator delete(p);
+            return;
+        }
+        Block *block = static_cast<Block *>(p);
+        block->next = list->mHead;
+        list->mHead = block;
+        list->mCount++;
+    }
+};
+
+#endif  // VFREELIST_H
@@ -0,0 +1,169 @@
+#include "vgradientcache.h"
+#include <cstring>
+
+static size_t hashOf(const VGradient &gradient)
+{
+    // FNV-1a over the opacity and every stop, offsets and colors alike
+    uint64_t hash = 14695981039346656037ull;
+    auto     add = [&hash](uint32_t value) {
+        for (int i = 0; i < 4; i++, value >>= 8) {
+            hash ^= value & 0xff;
+            hash *= 1099511628211ull;
+        }
+    };
+    auto bits = [](float value) {
+        uint32_t result;
+        memcpy(&result, &value, sizeof(result));
+        return result;
+    };
+
+    add(bits(gradient.alpha()));
+    for (const auto &stop : gradient.mStops) {
+        const VColor &color = stop.second;
+        add(bits(stop.first));
+        add(uint32_t(color.red()) << 24 | uint32_t(color.green()) << 16 |
+            uint32_t(color.blue()) << 8 | color.alpha());
+    }
+    return size_t(hash ^ (hash >> 32));
+}
+
+VGradientCache::EntryList::iterator VGradientCache::find(
+    Shard &shard, size_t hash, const VGradient &gradient)
+{
+    auto range = shard.mHash.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        const Entry &entry = *it->second;
+        if (entry.alpha == gradient.alpha() && entry.stops == gradient.mStops)
+            return it->second;
+    }
+    return shard.mLru.end();
+}
+
+// drop least recently used tables until the shard is within its size
+void VGradientCache::evict(Shard &shard)
+{
+    size_t maxSize = mShardSize;
+    while (shard.mLru.size() > maxSize) {
+        const Entry &entry = shard.mLru.back();
+        auto         range = shard.mHash.equal_range(entry.hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (&*it->second == &entry) {
+                shard.mHash.erase(it);
+                break;
+            }
+        }
+        shard.mLru.pop_back();
+        shard.mEvictions++;
+    }
+}
+
+VGradientCache::VCacheData VGradientCache::getBuffer(const VGradient &gradient)
+{
+    size_t hash = hashOf(gradient);
+    Shard &shard = mShards[hash % ShardCount];
+
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        auto                        found = find(shard, hash, gradient);
+        if (found != shard.mLru.end()) {
+            // move to front, it's now the most recently used
+            shard.mLru.splice(shard.mLru.begin(), shard.mLru, found);
+            shard.mHits++;
+            return found->table;
+        }
+        shard.mMisses++;
+    }
+
+    auto table = std::make_shared<VColorTable>();
+    table->alpha = generateGradientColorTable(gradient.mStops, gradient.alpha(),
+                                              table->buffer32,
+                                              VGradient::colorTableSize);
+
+    std::lock_guard<std::mutex> guard(shard.mMutex);
+    if (!mShardSize) return table;
+
+    // some other thread may have made the same table meanwhile
+    auto found = find(shard, hash, gradient);
+    if (found != shard.mLru.end()) return found->table;
+
+    shard.mLru.push_front({hash, gradient.mStops, gradient.alpha(), table});
+    shard.mHash.emplace(hash, shard.mLru.begin());
+    evict(shard);
+    return table;
+}
+
+void VGradientCache::configureCacheSize(size_t cacheSize)
+{
+    mShardSize = (cacheSize + ShardCount - 1) / ShardCount;
+    for (auto &shard : mShards) {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        evict(shard);
+    }
+}
+
+VGradientCache::Stats VGradientCache::stats() const
+{
+    Stats stats;
+    for (const auto &shard : mShards) {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        stats.entries += shard.mLru.size();
+        stats.hits += shard.mHits;
+        stats.misses += shard.mMisses;
+        stats.evictions += shard.mEvictions;
+    }
+    return stats;
+}
+
+bool VGradientCache::generateGradientColorTable(const VGradientStops &stops,
+                                                float                 opacity,
+                                                uint32_t *colorTable, int size)
+{
+    int                  dist, idist, pos = 0;
+    size_t i;
+    bool                 alpha = false;
+    size_t               stopCount = stops.size();
+    const VGradientStop *curr, *next, *start;
+    uint32_t             curColor, nextColor;
+    float                delta, t, incr, fpos;
+
+    if (!vCompare(opacity, 1.0f)) alpha = true;
+
+    start = stops.data();
+    curr = start;
+    if (!curr->second.isOpaque()) alpha = true;
+    curColor = curr->second.premulARGB(opacity);
+    incr = 1.0f / (float)size;
+    fpos = 1.5f * incr;
+
+    colorTable[pos++] = curColor;
+
+    while (fpos <= curr->first) {
+        colorTable[pos] = colorTable[pos - 1];
+        pos++;
+        fpos += incr;
+    }
+
+    for (i = 0; i < stopCount - 1; ++i) {
+        curr = (start + i);
+        next = (start + i + 1);
+        delta = 1 / (next->first - curr->first);
+        if (!next->second.isOpaque()) alpha = true;
+        nextColor = next->second.premulARGB(opacity);
+        while (fpos < next->first && pos < size) {
+            t = (fpos - curr->first) * delta;
+            dist = (int)(255 * t);
+            idist = 255 - dist;
+            colorTable[pos] =
+                INTERPOLATE_PIXEL_255(curColor, idist, nextColor, dist);
+            ++pos;
+            fpos += incr;
+        }
+        curColor = nextColor;
+    }
+
+    for (; pos < size; ++pos) colorTable[pos] = curColor;
+
+    // Make sure the last color stop is represented at the end of the table
+    colorTable[size - 1] = curColor;
+    return alpha;
+}
@@ -0,0 +1,76 @@
+#ifndef VGRADIENTCACHE_H
+#define VGRADIENTCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "vdrawhelper.h"
+
+/*
+ * Color tables of the gradients being drawn, shared by every thread that
+ * renders. Tables are looked up by their stops and opacity, split over a
+ * few shards with a lock each, so threads drawing different gradients
+ * rarely wait on one another. A missing table is made outside the lock.
+ * Each shard drops its least recently used tables once it is full.
+ */
+class VGradientCache {
+public:
+    using VCacheData = std::shared_ptr<const VColorTable>;
+
+    struct Stats {
+        size_t   entries{0};
+        uint64_t hits{0};
+        uint64_t misses{0};
+        uint64_t evictions{0};
+    };
+
+    static VGradientCache &instance()
+    {
+        static VGradientCache CACHE;
+        return CACHE;
+    }
+
+    VCacheData getBuffer(const VGradient &gradient);
+    // Tables kept in all, 0 makes a new table each time and drops the
+    // ones kept so far
+    void  configureCacheSize(size_t cacheSize);
+    Stats stats() const;
+
+    static bool generateGradientColorTable(const VGradientStops &stops,
+                                           float alpha, uint32_t *colorTable,
+                                           int size);
+
+private:
+    static constexpr size_t ShardCount = 8;
+
+    struct Entry {
+        size_t         hash;
+        VGradientStops stops;
+        float          alpha;
+        VCacheData     table;
+    };
+    using EntryList = std::list<Entry>;
+
+    struct Shard {
+        mutable std::mutex                              mMutex;
+        EntryList                                       mLru;
+        std::unordered_multimap<size_t, EntryList::iterator> mHash;
+        uint64_t                                        mHits{0};
+        uint64_t                                        mMisses{0};
+        uint64_t                                        mEvictions{0};
+    };
+
+    VGradientCache() = default;
+
+    EntryList::iterator find(Shard &shard, size_t hash,
+                             const VGradient &gradient);
+    void                evict(Shard &shard);
+
+    Shard               mShards[ShardCount];
+    std::atomic<size_t> mShardSize{(60 + ShardCount - 1) / ShardCount};
+};
+
+#endif  // VGRADIENTCACHE_H
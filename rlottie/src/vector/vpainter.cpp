@@ -18,6 +18,7 @@
 
 #include "vpainter.h"
 #include <algorithm>
+#include <cstring>
 
 
 V_BEGIN_NAMESPACE
@@ -25,6 +26,11 @@ V_BEGIN_NAMESPACE
 
 void VPainter::drawRle(const VPoint &, const VRle &rle)
 {
+    if (mRecording) {
+        record(rle, nullptr);
+        return;
+    }
+
     if (rle.empty()) return;
     // mSpanData.updateSpanFunc();
 
@@ -37,6 +43,11 @@ void VPainter::drawRle(const VPoint &, const VRle &rle)
 
 void VPainter::drawRle(const VRle &rle, const VRle &clip)
 {
+    if (mRecording) {
+        record(rle, &clip);
+        return;
+    }
+
     if (rle.empty() || clip.empty()) return;
 
     if (!mSpanData.mUnclippedBlendFunc) return;
@@ -102,6 +113,182 @@ bool VPainter::begin(VBitmap *buffer)
 }
 void VPainter::end() {}
 
+void VPainter::beginRecording(VBitmap *buffer, VPaintOpList *ops)
+{
+    mBuffer.prepare(buffer);
+    mSpanData.init(&mBuffer);
+    ops->clear();
+    mRecording = ops;
+    mRecordState = VPaintOp();
+    mRecordingAborted = false;
+}
+
+void VPainter::record(const VRle &rle, const VRle *clip)
+{
+    mRecording->push_back(mRecordState);
+    VPaintOp &op = mRecording->back();
+    op.mRle = rle;
+    // empty calls are kept so the calls of two frames still line up
+    if (!rle.empty()) op.mBox = rle.boundingRect() & clipBoundingRect();
+    if (clip) {
+        op.mClip = *clip;
+        op.mClipped = true;
+        op.mBox = clip->empty() ? VRect() : op.mBox & clip->boundingRect();
+    }
+}
+
+static bool sameGradient(const VGradient &g1, const VGradient &g2)
+{
+    const VMatrix &m1 = g1.mMatrix;
+    const VMatrix &m2 = g2.mMatrix;
+    if (g1.mType != g2.mType || g1.mSpread != g2.mSpread ||
+        g1.mMode != g2.mMode || g1.mAlpha != g2.mAlpha ||
+        g1.mStops != g2.mStops || m1.m_11() != m2.m_11() ||
+        m1.m_12() != m2.m_12() || m1.m_13() != m2.m_13() ||
+        m1.m_21() != m2.m_21() || m1.m_22() != m2.m_22() ||
+        m1.m_23() != m2.m_23() || m1.m_tx() != m2.m_tx() ||
+        m1.m_ty() != m2.m_ty() || m1.m_33() != m2.m_33())
+        return false;
+
+    if (g1.mType == VGradient::Type::Linear)
+        return g1.linear.x1 == g2.linear.x1 && g1.linear.y1 == g2.linear.y1 &&
+               g1.linear.x2 == g2.linear.x2 && g1.linear.y2 == g2.linear.y2;
+
+    return g1.radial.cx == g2.radial.cx && g1.radial.cy == g2.radial.cy &&
+           g1.radial.fx == g2.radial.fx && g1.radial.fy == g2.radial.fy &&
+           g1.radial.cradius == g2.radial.cradius &&
+           g1.radial.fradius == g2.radial.fradius;
+}
+
+static bool sameOp(const VPaintOp &op1, const VPaintOp &op2)
+{
+    if (op1.mMode != op2.mMode || op1.mClipped != op2.mClipped ||
+        op1.mBrush.type() != op2.mBrush.type())
+        return false;
+
+    switch (op1.mBrush.type()) {
+    case VBrush::Type::Solid:
+        if (!(op1.mBrush.mColor == op2.mBrush.mColor)) return false;
+        break;
+    case VBrush::Type::LinearGradient:
+    case VBrush::Type::RadialGradient:
+        if (!sameGradient(*op1.mGradient, *op2.mGradient)) return false;
+        break;
+    default:
+        break;
+    }
+
+    return op1.mRle == op2.mRle && (!op1.mClipped || op1.mClip == op2.mClip);
+}
+
+static VRect united(const VRect &r1, const VRect &r2)
+{
+    if (r1.empty()) return r2;
+    if (r2.empty()) return r1;
+
+    int left = std::min(r1.left(), r2.left());
+    int top = std::min(r1.top(), r2.top());
+    return VRect(left, top, std::max(r1.right(), r2.right()) - left,
+                 std::max(r1.bottom(), r2.bottom()) - top);
+}
+
+struct VClippedSpans {
+    VRect      mClip;
+    VSpanData *mSpanData;
+};
+
+static void clippedBlend(size_t count, const VRle::Span *spans, void *userData)
+{
+    auto *       data = static_cast<VClippedSpans *>(userData);
+    const VRect &clip = data->mClip;
+    const int    nspans = 256;
+    VRle::Span   out[nspans];
+    int          n = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const VRle::Span &span = spans[i];
+        if (span.y < clip.top() || span.y >= clip.bottom()) continue;
+
+        int x1 = std::max(int(span.x), clip.left());
+        int x2 = std::min(span.x + span.len, clip.right());
+        if (x1 >= x2) continue;
+
+        out[n].x = short(x1);
+        out[n].y = span.y;
+        out[n].len = ushort(x2 - x1);
+        out[n].coverage = span.coverage;
+        if (++n == nspans) {
+            data->mSpanData->mUnclippedBlendFunc(n, out, data->mSpanData);
+            n = 0;
+        }
+    }
+    if (n) data->mSpanData->mUnclippedBlendFunc(n, out, data->mSpanData);
+}
+
+void VPainter::drawOp(const VPaintOp &op, const VRect &clip)
+{
+    if (op.mRle.empty() || (op.mBox & clip).empty()) return;
+
+    mSpanData.setup(op.mBrush);
+    mSpanData.mBlendMode = op.mMode;
+    if (!mSpanData.mUnclippedBlendFunc) return;
+
+    if (op.mClipped) {
+        VClippedSpans data{clip, &mSpanData};
+        op.mRle.intersect(op.mClip, clippedBlend, &data);
+    } else {
+        op.mRle.intersect(clip, mSpanData.mUnclippedBlendFunc, &mSpanData);
+    }
+}
+
+void VPainter::abortRecording()
+{
+    VPaintOpList &ops = *mRecording;
+    mRecording = nullptr;
+    mRecordingAborted = true;
+
+    mBuffer.clear();
+    for (const auto &op : ops) drawOp(op, clipBoundingRect());
+    ops.clear();
+
+    mSpanData.setup(mRecordState.mBrush);
+    mSpanData.mBlendMode = mRecordState.mMode;
+}
+
+VRect VPainter::replay(const VPaintOpList *previous)
+{
+    // already painted everything
+    if (!mRecording) return clipBoundingRect();
+
+    const VPaintOpList &ops = *mRecording;
+    mRecording = nullptr;
+
+    VRect damage;
+    if (!previous || previous->size() != ops.size()) {
+        damage = clipBoundingRect();
+    } else {
+        for (size_t i = 0; i < ops.size(); i++) {
+            const VPaintOp &prev = (*previous)[i];
+            if (!sameOp(ops[i], prev))
+                damage = united(damage, united(ops[i].mBox, prev.mBox));
+        }
+        damage = damage & clipBoundingRect();
+    }
+    if (damage.empty()) return {};
+
+    if (previous) {
+        for (int y = damage.top(); y < damage.bottom(); y++)
+            memset(mSpanData.buffer(damage.left(), y), 0,
+                   size_t(damage.width()) * 4);
+    } else {
+        mBuffer.clear();
+    }
+
+    for (const auto &op : ops) drawOp(op, damage);
+
+    return damage;
+}
+
 void VPainter::setDrawRegion(const VRect &region)
 {
     mSpanData.setDrawRegion(region);
@@ -109,11 +296,29 @@ void VPainter::setDrawRegion(const VRect &region)
 
 void VPainter::setBrush(const VBrush &brush)
 {
+    if (mRecording) {
+        switch (brush.type()) {
+        case VBrush::Type::LinearGradient:
+        case VBrush::Type::RadialGradient:
+            // the gradient gets updated in place for the next frame
+            mRecordState.mGradient = std::make_shared<VGradient>(*brush.mGradient);
+            mRecordState.mBrush = VBrush(mRecordState.mGradient.get());
+            return;
+        case VBrush::Type::Texture:
+            abortRecording();
+            break;
+        default:
+            mRecordState.mBrush = brush;
+            mRecordState.mGradient.reset();
+            return;
+        }
+    }
     mSpanData.setup(brush);
 }
 
 void VPainter::setBlendMode(BlendMode mode)
 {
+    mRecordState.mMode = mode;
     mSpanData.mBlendMode = mode;
 }
 
@@ -136,6 +341,8 @@ void VPainter::drawBitmap(const VRect &target, const VBitmap &bitmap,
 {
     if (!bitmap.valid()) return;
 
+    if (mRecording) abortRecording();
+
     // clear any existing brush data.
     setBrush(VBrush());
 
@@ -23,16 +23,46 @@
 #include "vpoint.h"
 #include "vrle.h"
 #include "vdrawhelper.h"
+#include <memory>
+#include <vector>
 
 V_BEGIN_NAMESPACE
 
 class VBitmap;
+
+// A draw call recorded by VPainter::beginRecording()
+struct VPaintOp {
+    VRle                             mRle;
+    VRle                             mClip;
+    bool                             mClipped{false};
+    VBrush                           mBrush;
+    std::shared_ptr<const VGradient> mGradient;  // copy mBrush points to
+    BlendMode                        mMode{BlendMode::SrcOver};
+    VRect                            mBox;
+};
+using VPaintOpList = std::vector<VPaintOp>;
+
 class VPainter {
 public:
     VPainter() = default;
     explicit VPainter(VBitmap *buffer);
     bool  begin(VBitmap *buffer);
     void  end();
+    /*
+     * Partial repaint: like begin(), but the buffer is left alone and draw
+     * calls are only recorded into ops until replay(). Drawing a bitmap or
+     * with a texture brush can't be recorded, so it repaints everything
+     * right away and stops recording.
+     */
+    void  beginRecording(VBitmap *buffer, VPaintOpList *ops);
+    /*
+     * Clears and repaints the area the recorded calls differ from previous
+     * in, previous being those of the frame still in the buffer. Without it
+     * the whole buffer is cleared and repainted. Returns the repainted area,
+     * relative to the draw region.
+     */
+    VRect replay(const VPaintOpList *previous);
+    bool  recordingAborted() const { return mRecordingAborted; }
     void  setDrawRegion(const VRect &region); // sub surface rendering area.
     void  setBrush(const VBrush &brush);
     void  setBlendMode(BlendMode mode);
@@ -45,10 +75,16 @@ public:
     void  drawBitmap(const VPoint &point, const VBitmap &bitmap, uint8_t const_alpha = 255);
     void  drawBitmap(const VRect &rect, const VBitmap &bitmap, uint8_t const_alpha = 255);
 private:
+    void record(const VRle &rle, const VRle *clip);
+    void abortRecording();
+    void drawOp(const VPaintOp &op, const VRect &clip);
     void drawBitmapUntransform(const VRect &target, const VBitmap &bitmap,
                                const VRect &source, uint8_t const_alpha);
     VRasterBuffer mBuffer;
     VSpanData     mSpanData;
+    VPaintOpList *mRecording{nullptr};
+    VPaintOp      mRecordState;
+    bool          mRecordingAborted{false};
 };
 
 V_END_NAMESPACE
@@ -308,21 +308,77 @@ private:
     bool                    _pending{false};
 };
 
+/*
+ * outline and stroker are scratch state, so each thread gets its own
+ * copy. This lets the caller render several animations in parallel
+ * from its own threads even without LOTTIE_THREAD_SUPPORT.
+ */
+struct RleScratch {
+    FTOutline     outlineRef{};
+    SW_FT_Stroker stroker;
+
+    static RleScratch &local()
+    {
+        static thread_local RleScratch scratch;
+        return scratch;
+    }
+
+    RleScratch() { SW_FT_Stroker_New(&stroker); }
+
+    ~RleScratch() { SW_FT_Stroker_Done(stroker); }
+};
+
+#ifdef LOTTIE_THREAD_SUPPORT
+static VTaskScheduler &rleScheduler()
+{
+    static VTaskScheduler scheduler;
+    return scheduler;
+}
+#endif
+
 struct VRleTask {
-    SharedRle mRle;
-    VPath     mPath;
-    float     mStrokeWidth;
-    float     mMiterLimit;
-    VRect     mClip;
-    FillRule  mFillRule;
-    CapStyle  mCap;
-    JoinStyle mJoin;
-    bool      mGenerateStroke;
-
-    VRle &rle() { return mRle.get(); }
+    SharedRle         mRle;
+    std::atomic<bool> mClaimed{true};
+    VPath             mPath;
+    float             mStrokeWidth;
+    float             mMiterLimit;
+    VRect             mClip;
+    FillRule          mFillRule;
+    CapStyle          mCap;
+    JoinStyle         mJoin;
+    bool              mGenerateStroke;
+
+    VRle &rle()
+    {
+        finish();
+        return mRle.get();
+    }
+
+    // Rasterizes, unless some other thread already took the task
+    bool run()
+    {
+        if (mClaimed.exchange(true)) return false;
+        auto &scratch = RleScratch::local();
+        (*this)(scratch.outlineRef, scratch.stroker);
+        return true;
+    }
+
+    /*
+     * Whoever needs the result first runs the task, so waiting for it
+     * never depends on a busy pool or executor getting to it.
+     */
+    void finish()
+    {
+        if (run()) {
+#ifdef LOTTIE_THREAD_SUPPORT
+            rleScheduler().noteCallerRun();
+#endif
+        }
+    }
 
     void update(VPath path, FillRule fillRule, const VRect &clip)
     {
+        finish();
         mRle.reset();
         mPath = std::move(path);
         mFillRule = fillRule;
@@ -333,6 +389,7 @@ struct VRleTask {
     void update(VPath path, CapStyle cap, JoinStyle join, float width,
                 float miterLimit, const VRect &clip)
     {
+        finish();
         mRle.reset();
         mPath = std::move(path);
         mCap = cap;
@@ -342,6 +399,26 @@ struct VRleTask {
         mClip = clip;
         mGenerateStroke = true;
     }
+    /*
+     * Moves the last result by offset instead of rasterizing the moved
+     * path, as long as neither clip cuts into it: the result would be the
+     * same up to float rounding far below what the rasterizer resolves.
+     */
+    bool translate(const VPoint &offset, const VRect &clip)
+    {
+        VRle &result = rle();
+        if (result.empty() || mClip.empty() || clip.empty()) return false;
+
+        VRect box = result.boundingRect();
+        if (!mClip.contains(box, true) ||
+            !clip.contains(box.translated(offset.x(), offset.y()), true))
+            return false;
+
+        result.translate(offset);
+        mClip = clip;
+        return true;
+    }
+
     void render(FTOutline &outRef)
     {
         SW_FT_Raster_Params params;
@@ -370,6 +447,8 @@ struct VRleTask {
     {
         if (mPath.points().size() > SHRT_MAX ||
             mPath.points().size() + mPath.segments() > SHRT_MAX) {
+            mRle.unsafe().reset();
+            mRle.notify();
             return;
         }
 
@@ -412,104 +491,6 @@ struct VRleTask {
 
 using VTask = std::shared_ptr<VRleTask>;
 
-#ifdef LOTTIE_THREAD_SUPPORT
-
-#include <thread>
-#include "vtaskqueue.h"
-
-class RleTaskScheduler {
-    const unsigned                _count{std::thread::hardware_concurrency()};
-    std::vector<std::thread>      _threads;
-    std::vector<TaskQueue<VTask>> _q{_count};
-    std::atomic<unsigned>         _index{0};
-
-    void run(unsigned i)
-    {
-        /*
-         * initalize  per thread objects.
-         */
-        FTOutline     outlineRef;
-        SW_FT_Stroker stroker;
-        SW_FT_Stroker_New(&stroker);
-
-        // Task Loop
-        VTask task;
-        while (true) {
-            bool success = false;
-
-            for (unsigned n = 0; n != _count * 2; ++n) {
-                if (_q[(i + n) % _count].try_pop(task)) {
-                    success = true;
-                    break;
-                }
-            }
-
-            if (!success && !_q[i].pop(task)) break;
-
-            (*task)(outlineRef, stroker);
-        }
-
-        // cleanup
-        SW_FT_Stroker_Done(stroker);
-    }
-
-    RleTaskScheduler()
-    {
-        for (unsigned n = 0; n != _count; ++n) {
-            _threads.emplace_back([&, n] { run(n); });
-        }
-    }
-
-public:
-    static RleTaskScheduler &instance()
-    {
-        static RleTaskScheduler singleton;
-        return singleton;
-    }
-
-    ~RleTaskScheduler()
-    {
-        for (auto &e : _q) e.done();
-
-        for (auto &e : _threads) e.join();
-    }
-
-    void process(VTask task)
-    {
-        auto i = _index++;
-
-        for (unsigned n = 0; n != _count; ++n) {
-            if (_q[(i + n) % _count].try_push(std::move(task))) return;
-        }
-
-        if (_count > 0) {
-            _q[i % _count].push(std::move(task));
-        }
-    }
-};
-
-#else
-
-class RleTaskScheduler {
-public:
-    FTOutline     outlineRef{};
-    SW_FT_Stroker stroker;
-
-public:
-    static RleTaskScheduler &instance()
-    {
-        static RleTaskScheduler singleton;
-        return singleton;
-    }
-
-    RleTaskScheduler() { SW_FT_Stroker_New(&stroker); }
-
-    ~RleTaskScheduler() { SW_FT_Stroker_Done(stroker); }
-
-    void process(VTask task) { (*task)(outlineRef, stroker); }
-};
-#endif
-
 struct VRasterizer::VRasterizerImpl {
     VRleTask mTask;
 
@@ -531,7 +512,45 @@ void VRasterizer::init()
 void VRasterizer::updateRequest()
 {
     VTask taskObj = VTask(d, &d->task());
-    RleTaskScheduler::instance().process(std::move(taskObj));
+    taskObj->mClaimed = false;
+#ifdef LOTTIE_THREAD_SUPPORT
+    rleScheduler().process([taskObj] { taskObj->run(); });
+#else
+    taskObj->run();
+#endif
+}
+
+bool VRasterizer::translate(const VPoint &offset, const VRect &clip)
+{
+    if (!d) return false;
+    return d->task().translate(offset, clip);
+}
+
+void VRasterizer::configureThreads(unsigned threadCount)
+{
+#ifdef LOTTIE_THREAD_SUPPORT
+    rleScheduler().configure(threadCount);
+#else
+    (void)threadCount;
+#endif
+}
+
+void VRasterizer::setExecutor(VTaskScheduler::Executor executor)
+{
+#ifdef LOTTIE_THREAD_SUPPORT
+    rleScheduler().setExecutor(std::move(executor));
+#else
+    (void)executor;
+#endif
+}
+
+VTaskScheduler::Stats VRasterizer::schedulerStats()
+{
+#ifdef LOTTIE_THREAD_SUPPORT
+    return rleScheduler().stats();
+#else
+    return VTaskScheduler::Stats();
+#endif
 }
 
 void VRasterizer::rasterize(VPath path, FillRule fillRule, const VRect &clip)
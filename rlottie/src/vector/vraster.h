@@ -21,6 +21,7 @@
 #include <future>
 #include "vglobal.h"
 #include "vrect.h"
+#include "vtaskscheduler.h"
 
 V_BEGIN_NAMESPACE
 
@@ -34,6 +35,13 @@ public:
     void rasterize(VPath path, CapStyle cap, JoinStyle join, float width,
                    float miterLimit, const VRect &clip = VRect());
     VRle rle();
+    // Moves the last result by offset; false if it has to be rasterized again
+    bool translate(const VPoint &offset, const VRect &clip);
+
+    // Where rasterization runs, see rlottie::configureThreads()
+    static void configureThreads(unsigned threadCount);
+    static void setExecutor(VTaskScheduler::Executor executor);
+    static VTaskScheduler::Stats schedulerStats();
 private:
     struct VRasterizerImpl;
     void init();
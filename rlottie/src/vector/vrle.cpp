@@ -28,8 +28,6 @@
 
 V_BEGIN_NAMESPACE
 
-enum class Operation { Add, Xor };
-
 struct VRleHelper {
     size_t      alloc{0};
     size_t      size{0};
@@ -38,9 +36,6 @@ struct VRleHelper {
 static void rleIntersectWithRle(VRleHelper *, int, int, VRleHelper *,
                                 VRleHelper *);
 static void rleIntersectWithRect(const VRect &, VRleHelper *, VRleHelper *);
-static void rleOpGeneric(VRleHelper *, VRleHelper *, VRleHelper *,
-                         Operation op);
-static void rleSubstractWithRle(VRleHelper *, VRleHelper *, VRleHelper *);
 
 static inline uchar divBy255(int x)
 {
@@ -55,6 +50,75 @@ inline static void copyArrayToVector(const VRle::Span *span, size_t count,
     std::copy(span, span + count, back_inserter(v));
 }
 
+/*
+ * Span buffers of rles this thread dropped. Shapes are rasterized again
+ * every frame into fresh rles while the old ones are still referenced by
+ * the previous frame, so without this every frame allocates and regrows
+ * the same buffers. Bounded in count and in total size.
+ */
+class SpanPool {
+    static constexpr size_t MaxBuffers = 64;
+    static constexpr size_t MaxBytes = 1024 * 1024;
+
+    std::vector<std::vector<VRle::Span>> mBuffers;
+    size_t                               mBytes{0};
+    bool &                               mGone;
+
+    explicit SpanPool(bool &gone) : mGone(gone) {}
+
+public:
+    ~SpanPool() { mGone = true; }
+
+    // nullptr once the thread is exiting and its pool is gone
+    static SpanPool *local()
+    {
+        static thread_local bool gone = false;
+        if (gone) return nullptr;
+        static thread_local SpanPool pool(gone);
+        return &pool;
+    }
+
+    std::vector<VRle::Span> take(size_t count)
+    {
+        if (mBuffers.empty()) return {};
+
+        // most recent one big enough, the last one otherwise
+        size_t i = mBuffers.size() - 1;
+        for (size_t n = mBuffers.size(); n-- > 0;) {
+            if (mBuffers[n].capacity() >= count) {
+                i = n;
+                break;
+            }
+        }
+        std::vector<VRle::Span> buffer = std::move(mBuffers[i]);
+        mBuffers.erase(mBuffers.begin() + i);
+        mBytes -= buffer.capacity() * sizeof(VRle::Span);
+        return buffer;
+    }
+
+    void give(std::vector<VRle::Span> &buffer)
+    {
+        size_t bytes = buffer.capacity() * sizeof(VRle::Span);
+        if (!bytes || mBuffers.size() == MaxBuffers || mBytes + bytes > MaxBytes)
+            return;
+        buffer.clear();
+        mBytes += bytes;
+        mBuffers.push_back(std::move(buffer));
+    }
+};
+
+VRle::VRleData::VRleData(const VRle::VRleData &o)
+    : mBbox(o.mBbox), mBboxDirty(o.mBboxDirty)
+{
+    if (SpanPool *pool = SpanPool::local()) mSpans = pool->take(o.mSpans.size());
+    mSpans.assign(o.mSpans.begin(), o.mSpans.end());
+}
+
+VRle::VRleData::~VRleData()
+{
+    if (SpanPool *pool = SpanPool::local()) pool->give(mSpans);
+}
+
 void VRle::VRleData::addSpan(const VRle::Span *span, size_t count)
 {
     copyArrayToVector(span, count, mSpans);
@@ -77,7 +141,6 @@ void VRle::VRleData::reset()
 {
     mSpans.clear();
     mBbox = VRect();
-    mOffset = VPoint();
     mBboxDirty = false;
 }
 
@@ -88,16 +151,15 @@ void VRle::VRleData::clone(const VRle::VRleData &o)
 
 void VRle::VRleData::translate(const VPoint &p)
 {
-    // take care of last offset if applied
-    mOffset = p - mOffset;
-    int x = mOffset.x();
-    int y = mOffset.y();
+    // the box is worked out from the spans before they move, if at all
+    updateBbox();
+    int x = p.x();
+    int y = p.y();
     for (auto &i : mSpans) {
         i.x = i.x + x;
         i.y = i.y + y;
     }
-    updateBbox();
-    mBbox.translate(mOffset.x(), mOffset.y());
+    mBbox.translate(x, y);
 }
 
 void VRle::VRleData::addRect(const VRect &rect)
@@ -190,6 +252,100 @@ void VRle::VRleData::opIntersect(const VRect &r, VRle::VRleSpanCb cb,
     }
 }
 
+/*
+ * Blends a row of a with the same row of b, spans of both sorted and not
+ * overlapping. Instead of painting both into a coverage buffer and reading
+ * it back, it walks the span edges of both rows, so the work depends on
+ * the number of spans rather than the width. Neighbours that come out
+ * with the same coverage are merged and empty ones are dropped, which is
+ * what reading back a coverage buffer gave.
+ */
+template <typename Blend>
+static void blendRow(const VRle::Span *a, const VRle::Span *aEnd,
+                     const VRle::Span *b, const VRle::Span *bEnd,
+                     std::vector<VRle::Span> &result, Blend blend)
+{
+    size_t rowStart = result.size();
+    short  y = a->y;
+    int    x = std::min(a->x, b->x);
+
+    while (a != aEnd || b != bEnd) {
+        int next = std::numeric_limits<int>::max();
+        int ca = 0, cb = 0;
+        if (a != aEnd) {
+            if (x >= a->x) {
+                ca = a->coverage;
+                next = a->x + a->len;
+            } else {
+                next = a->x;
+            }
+        }
+        if (b != bEnd) {
+            if (x >= b->x) {
+                cb = b->coverage;
+                next = std::min(next, b->x + b->len);
+            } else {
+                next = std::min(next, int(b->x));
+            }
+        }
+
+        uchar coverage = blend(ca, cb);
+        if (coverage && next > x) {
+            if (result.size() > rowStart && result.back().coverage == coverage &&
+                result.back().x + result.back().len == x) {
+                result.back().len += next - x;
+            } else {
+                VRle::Span span;
+                span.x = short(x);
+                span.y = y;
+                span.len = ushort(next - x);
+                span.coverage = coverage;
+                result.push_back(span);
+            }
+        }
+
+        x = next;
+        if (a != aEnd && x >= a->x + a->len) ++a;
+        if (b != bEnd && x >= b->x + b->len) ++b;
+    }
+}
+
+/*
+ * Rows only in a are copied, rows only in b are copied when keepB is set,
+ * rows in both are blended.
+ */
+template <typename Blend>
+static void blendRle(const VRle::VRleData &a, const VRle::VRleData &b,
+                     bool keepB, std::vector<VRle::Span> &result, Blend blend)
+{
+    const VRle::Span *aPtr = a.mSpans.data();
+    const VRle::Span *aEnd = aPtr + a.mSpans.size();
+    const VRle::Span *bPtr = b.mSpans.data();
+    const VRle::Span *bEnd = bPtr + b.mSpans.size();
+
+    while (aPtr != aEnd && bPtr != bEnd) {
+        if (aPtr->y < bPtr->y) {
+            const VRle::Span *start = aPtr;
+            while (aPtr != aEnd && aPtr->y < bPtr->y) aPtr++;
+            result.insert(result.end(), start, aPtr);
+        } else if (bPtr->y < aPtr->y) {
+            const VRle::Span *start = bPtr;
+            while (bPtr != bEnd && bPtr->y < aPtr->y) bPtr++;
+            if (keepB) result.insert(result.end(), start, bPtr);
+        } else {
+            const VRle::Span *aRow = aPtr;
+            const VRle::Span *bRow = bPtr;
+            int               y = aPtr->y;
+            while (aPtr != aEnd && aPtr->y == y) aPtr++;
+            while (bPtr != bEnd && bPtr->y == y) bPtr++;
+            blendRow(aRow, aPtr, bRow, bPtr, result, blend);
+        }
+    }
+
+    result.insert(result.end(), aPtr, aEnd);
+    if (keepB) result.insert(result.end(), bPtr, bEnd);
+}
+
 // res = a - b;
 void VRle::VRleData::opSubstract(const VRle::VRleData &a,
                                  const VRle::VRleData &b)
@@ -198,47 +354,10 @@ void VRle::VRleData::opSubstract(const VRle::VRleData &a,
     if (!a.bbox().intersects(b.bbox())) {
         mSpans = a.mSpans;
     } else {
-        VRle::Span *      aPtr = const_cast<VRle::Span *>(a.mSpans.data());
-        const VRle::Span *aEnd = a.mSpans.data() + a.mSpans.size();
-        VRle::Span *      bPtr = const_cast<VRle::Span *>(b.mSpans.data());
-        const VRle::Span *bEnd = b.mSpans.data() + b.mSpans.size();
-
-        // 1. forward till both y intersect
-        while ((aPtr != aEnd) && (aPtr->y < bPtr->y)) aPtr++;
-        size_t sizeA = size_t(aPtr - a.mSpans.data());
-        if (sizeA) copyArrayToVector(a.mSpans.data(), sizeA, mSpans);
-
-        // 2. forward b till it intersect with a.
-        while ((bPtr != bEnd) && (bPtr->y < aPtr->y)) bPtr++;
-        size_t sizeB = size_t(bPtr - b.mSpans.data());
-
-        // 2. calculate the intersect region
-        VRleHelper                  tresult, aObj, bObj;
-        std::array<VRle::Span, 256> array;
-
-        // setup the tresult object
-        tresult.size = array.size();
-        tresult.alloc = array.size();
-        tresult.spans = array.data();
-
-        // setup a object
-        aObj.size = a.mSpans.size() - sizeA;
-        aObj.spans = aPtr;
-
-        // setup b object
-        bObj.size = b.mSpans.size() - sizeB;
-        bObj.spans = bPtr;
-
-        // run till all the spans are processed
-        while (aObj.size && bObj.size) {
-            rleSubstractWithRle(&aObj, &bObj, &tresult);
-            if (tresult.size) {
-                copyArrayToVector(tresult.spans, tresult.size, mSpans);
-            }
-            tresult.size = 0;
-        }
-        // 3. copy the rest of a
-        if (aObj.size) copyArrayToVector(aObj.spans, aObj.size, mSpans);
+        mSpans.reserve(a.mSpans.size() + b.mSpans.size());
+        blendRle(a, b, false, mSpans, [](int ca, int cb) {
+            return divBy255((255 - cb) * ca);
+        });
     }
 
     mBboxDirty = true;
@@ -247,8 +366,6 @@ void VRle::VRleData::opSubstract(const VRle::VRleData &a,
 void VRle::VRleData::opGeneric(const VRle::VRleData &a, const VRle::VRleData &b,
                                OpCode code)
 {
-    // This routine assumes, obj1(span_y) < obj2(span_y).
-
     // reserve some space for the result vector.
     mSpans.reserve(a.mSpans.size() + b.mSpans.size());
 
@@ -261,59 +378,14 @@ void VRle::VRleData::opGeneric(const VRle::VRleData &a, const VRle::VRleData &b,
             copyArrayToVector(b.mSpans.data(), b.mSpans.size(), mSpans);
             copyArrayToVector(a.mSpans.data(), a.mSpans.size(), mSpans);
         }
+    } else if (code == OpCode::Add) {
+        blendRle(a, b, true, mSpans, [](int ca, int cb) {
+            return uchar(cb + divBy255((255 - cb) * ca));
+        });
     } else {
-        VRle::Span *      aPtr = const_cast<VRle::Span *>(a.mSpans.data());
-        const VRle::Span *aEnd = a.mSpans.data() + a.mSpans.size();
-        VRle::Span *      bPtr = const_cast<VRle::Span *>(b.mSpans.data());
-        const VRle::Span *bEnd = b.mSpans.data() + b.mSpans.size();
-
-        // 1. forward a till it intersects with b
-        while ((aPtr != aEnd) && (aPtr->y < bPtr->y)) aPtr++;
-        size_t sizeA = size_t(aPtr - a.mSpans.data());
-        if (sizeA) copyArrayToVector(a.mSpans.data(), sizeA, mSpans);
-
-        // 2. forward b till it intersects with a
-        while ((bPtr != bEnd) && (bPtr->y < aPtr->y)) bPtr++;
-        size_t sizeB = size_t(bPtr - b.mSpans.data());
-        if (sizeB) copyArrayToVector(b.mSpans.data(), sizeB, mSpans);
-
-        // 3. calculate the intersect region
-        VRleHelper                  tresult, aObj, bObj;
-        std::array<VRle::Span, 256> array;
-
-        // setup the tresult object
-        tresult.size = array.size();
-        tresult.alloc = array.size();
-        tresult.spans = array.data();
-
-        // setup a object
-        aObj.size = a.mSpans.size() - sizeA;
-        aObj.spans = aPtr;
-
-        // setup b object
-        bObj.size = b.mSpans.size() - sizeB;
-        bObj.spans = bPtr;
-
-        Operation op = Operation::Add;
-        switch (code) {
-        case OpCode::Add:
-            op = Operation::Add;
-            break;
-        case OpCode::Xor:
-            op = Operation::Xor;
-            break;
-        }
-        // run till all the spans are processed
-        while (aObj.size && bObj.size) {
-            rleOpGeneric(&aObj, &bObj, &tresult, op);
-            if (tresult.size) {
-                copyArrayToVector(tresult.spans, tresult.size, mSpans);
-            }
-            tresult.size = 0;
-        }
-        // 3. copy the rest
-        if (bObj.size) copyArrayToVector(bObj.spans, bObj.size, mSpans);
-        if (aObj.size) copyArrayToVector(aObj.spans, aObj.size, mSpans);
+        blendRle(a, b, true, mSpans, [](int ca, int cb) {
+            return divBy255((255 - cb) * ca + cb * (255 - ca));
+        });
     }
 
     mBboxDirty = true;
@@ -498,222 +570,6 @@ static void rleIntersectWithRect(const VRect &clip, VRleHelper *tmp_obj,
     result->size = result->alloc - available;
 }
 
-void blitXor(VRle::Span *spans, int count, uchar *buffer, int offsetX)
-{
-    while (count--) {
-        int    x = spans->x + offsetX;
-        int    l = spans->len;
-        uchar *ptr = buffer + x;
-        while (l--) {
-            int da = *ptr;
-            *ptr = divBy255((255 - spans->coverage) * (da) +
-                            spans->coverage * (255 - da));
-            ptr++;
-        }
-        spans++;
-    }
-}
-
-void blitDestinationOut(VRle::Span *spans, int count, uchar *buffer,
-                        int offsetX)
-{
-    while (count--) {
-        int    x = spans->x + offsetX;
-        int    l = spans->len;
-        uchar *ptr = buffer + x;
-        while (l--) {
-            *ptr = divBy255((255 - spans->coverage) * (*ptr));
-            ptr++;
-        }
-        spans++;
-    }
-}
-
-void blitSrcOver(VRle::Span *spans, int count, uchar *buffer, int offsetX)
-{
-    while (count--) {
-        int    x = spans->x + offsetX;
-        int    l = spans->len;
-        uchar *ptr = buffer + x;
-        while (l--) {
-            *ptr = spans->coverage + divBy255((255 - spans->coverage) * (*ptr));
-            ptr++;
-        }
-        spans++;
-    }
-}
-
-void blit(VRle::Span *spans, int count, uchar *buffer, int offsetX)
-{
-    while (count--) {
-        int    x = spans->x + offsetX;
-        int    l = spans->len;
-        uchar *ptr = buffer + x;
-        while (l--) {
-            *ptr = std::max(spans->coverage, *ptr);
-            ptr++;
-        }
-        spans++;
-    }
-}
-
-size_t bufferToRle(uchar *buffer, int size, int offsetX, int y, VRle::Span *out)
-{
-    size_t count = 0;
-    uchar  value = buffer[0];
-    int    curIndex = 0;
-
-    size = offsetX < 0 ? size + offsetX : size;
-    for (int i = 0; i < size; i++) {
-        uchar curValue = buffer[0];
-        if (value != curValue) {
-            if (value) {
-                out->y = y;
-                out->x = offsetX + curIndex;
-                out->len = i - curIndex;
-                out->coverage = value;
-                out++;
-                count++;
-            }
-            curIndex = i;
-            value = curValue;
-        }
-        buffer++;
-    }
-    if (value) {
-        out->y = y;
-        out->x = offsetX + curIndex;
-        out->len = size - curIndex;
-        out->coverage = value;
-        count++;
-    }
-    return count;
-}
-
-static void rleOpGeneric(VRleHelper *a, VRleHelper *b, VRleHelper *result,
-                         Operation op)
-{
-    std::array<VRle::Span, 256> temp;
-    VRle::Span *                out = result->spans;
-    size_t                      available = result->alloc;
-    VRle::Span *                aPtr = a->spans;
-    VRle::Span *                aEnd = a->spans + a->size;
-    VRle::Span *                bPtr = b->spans;
-    VRle::Span *                bEnd = b->spans + b->size;
-
-    while (available && aPtr < aEnd && bPtr < bEnd) {
-        if (aPtr->y < bPtr->y) {
-            *out++ = *aPtr++;
-            available--;
-        } else if (bPtr->y < aPtr->y) {
-            *out++ = *bPtr++;
-            available--;
-        } else {  // same y
-            VRle::Span *aStart = aPtr;
-            VRle::Span *bStart = bPtr;
-
-            int y = aPtr->y;
-
-            while (aPtr < aEnd && aPtr->y == y) aPtr++;
-            while (bPtr < bEnd && bPtr->y == y) bPtr++;
-
-            int aLength = (aPtr - 1)->x + (aPtr - 1)->len;
-            int bLength = (bPtr - 1)->x + (bPtr - 1)->len;
-            int offset = std::min(aStart->x, bStart->x);
-
-            std::array<uchar, 1024> array = {{0}};
-            blit(aStart, (aPtr - aStart), array.data(), -offset);
-            if (op == Operation::Add)
-                blitSrcOver(bStart, (bPtr - bStart), array.data(), -offset);
-            else if (op == Operation::Xor)
-                blitXor(bStart, (bPtr - bStart), array.data(), -offset);
-            VRle::Span *tResult = temp.data();
-            size_t size = bufferToRle(array.data(), std::max(aLength, bLength),
-                                      offset, y, tResult);
-            if (available >= size) {
-                while (size--) {
-                    *out++ = *tResult++;
-                    available--;
-                }
-            } else {
-                aPtr = aStart;
-                bPtr = bStart;
-                break;
-            }
-        }
-    }
-    // update the span list that yet to be processed
-    a->spans = aPtr;
-    a->size = aEnd - aPtr;
-
-    // update the clip list that yet to be processed
-    b->spans = bPtr;
-    b->size = bEnd - bPtr;
-
-    // update the result
-    result->size = result->alloc - available;
-}
-
-static void rleSubstractWithRle(VRleHelper *a, VRleHelper *b,
-                                VRleHelper *result)
-{
-    std::array<VRle::Span, 256> temp;
-    VRle::Span *                out = result->spans;
-    size_t                      available = result->alloc;
-    VRle::Span *                aPtr = a->spans;
-    VRle::Span *                aEnd = a->spans + a->size;
-    VRle::Span *                bPtr = b->spans;
-    VRle::Span *                bEnd = b->spans + b->size;
-
-    while (available && aPtr < aEnd && bPtr < bEnd) {
-        if (aPtr->y < bPtr->y) {
-            *out++ = *aPtr++;
-            available--;
-        } else if (bPtr->y < aPtr->y) {
-            bPtr++;
-        } else {  // same y
-            VRle::Span *aStart = aPtr;
-            VRle::Span *bStart = bPtr;
-
-            int y = aPtr->y;
-
-            while (aPtr < aEnd && aPtr->y == y) aPtr++;
-            while (bPtr < bEnd && bPtr->y == y) bPtr++;
-
-            int aLength = (aPtr - 1)->x + (aPtr - 1)->len;
-            int bLength = (bPtr - 1)->x + (bPtr - 1)->len;
-            int offset = std::min(aStart->x, bStart->x);
-
-            std::array<uchar, 1024> array = {{0}};
-            blit(aStart, (aPtr - aStart), array.data(), -offset);
-            blitDestinationOut(bStart, (bPtr - bStart), array.data(), -offset);
-            VRle::Span *tResult = temp.data();
-            size_t size = bufferToRle(array.data(), std::max(aLength, bLength),
-                                      offset, y, tResult);
-            if (available >= size) {
-                while (size--) {
-                    *out++ = *tResult++;
-                    available--;
-                }
-            } else {
-                aPtr = aStart;
-                bPtr = bStart;
-                break;
-            }
-        }
-    }
-    // update the span list that yet to be processed
-    a->spans = aPtr;
-    a->size = size_t(aEnd - aPtr);
-
-    // update the clip list that yet to be processed
-    b->spans = bPtr;
-    b->size = size_t(bEnd - bPtr);
-
-    // update the result
-    result->size = result->alloc - available;
-}
-
 VRle VRle::toRle(const VRect &rect)
 {
     if (rect.empty()) return VRle();
@@ -723,6 +579,20 @@ VRle VRle::toRle(const VRect &rect)
     return result;
 }
 
+bool VRle::operator==(const VRle &o) const
+{
+    // shared data is the common case for paths that didn't change
+    const VRleData &a = d.read();
+    const VRleData &b = o.d.read();
+    if (&a == &b) return true;
+
+    return std::equal(a.mSpans.begin(), a.mSpans.end(), b.mSpans.begin(),
+                      b.mSpans.end(), [](const Span &s1, const Span &s2) {
+                          return s1.x == s2.x && s1.y == s2.y &&
+                                 s1.len == s2.len && s1.coverage == s2.coverage;
+                      });
+}
+
 /*
  * this api makes use of thread_local temporary
  * buffer to avoid creating intermediate temporary rle buffer
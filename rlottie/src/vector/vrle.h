@@ -56,6 +56,7 @@ public:
     VRle operator-(const VRle &o) const;
     VRle operator+(const VRle &o) const;
     VRle operator^(const VRle &o) const;
+    bool operator==(const VRle &o) const;
 
     static VRle toRle(const VRect &rect);
 
@@ -69,6 +70,11 @@ public:
             Add,
             Xor
         };
+        // span storage is recycled per thread, see vrle.cpp
+        VRleData() = default;
+        VRleData(const VRleData &o);
+        VRleData &operator=(const VRleData &) = default;
+        ~VRleData();
         bool  empty() const { return mSpans.empty(); }
         void  addSpan(const VRle::Span *span, size_t count);
         void  updateBbox() const;
@@ -85,7 +91,6 @@ public:
         void  addRect(const VRect &rect);
         void  clone(const VRle::VRleData &);
         std::vector<VRle::Span> mSpans;
-        VPoint                  mOffset;
         mutable VRect           mBbox;
         mutable bool            mBboxDirty = true;
     };
@@ -171,7 +176,11 @@ inline VRle VRle::operator-(const VRle &o) const
 
 inline void VRle::reset()
 {
-    d.write().reset();
+    // don't copy spans that are shared only to drop them
+    if (d.unique())
+        d.write().reset();
+    else
+        d = vcow_ptr<VRleData>();
 }
 
 inline void VRle::clone(const VRle &o)
@@ -0,0 +1,112 @@
+#include "vtaskscheduler.h"
+#include <algorithm>
+
+void VTaskScheduler::run(unsigned i)
+{
+    Task task;
+    while (true) {
+        bool success = mQueues[i].try_pop(task);
+
+        for (unsigned n = 1; !success && n != mCount; ++n) {
+            if (mQueues[(i + n) % mCount].try_pop(task)) {
+                success = true;
+                mSteals++;
+            }
+        }
+
+        if (!success) {
+            mIdleSpins++;
+            if (!mQueues[i].pop(task)) break;
+        }
+
+        started();
+        task();
+        // don't keep whatever the task holds alive until the next one
+        task = nullptr;
+    }
+}
+
+void VTaskScheduler::stop()
+{
+    for (unsigned n = 0; n != mCount; ++n) mQueues[n].done();
+
+    for (auto &e : mThreads) e.join();
+
+    mThreads.clear();
+    mQueues.reset();
+    mCount = 0;
+}
+
+void VTaskScheduler::configure(unsigned threadCount)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    stop();
+
+    unsigned cores = std::thread::hardware_concurrency();
+    if (cores) threadCount = std::min(threadCount, cores);
+    if (!threadCount) return;
+
+    mQueues.reset(new TaskQueue<Task>[threadCount]);
+    mCount = threadCount;
+    for (unsigned n = 0; n != mCount; ++n) {
+        mThreads.emplace_back([this, n] { run(n); });
+    }
+}
+
+void VTaskScheduler::setExecutor(Executor executor)
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    mExecutor = std::move(executor);
+}
+
+void VTaskScheduler::process(Task task)
+{
+    mTasks++;
+
+    std::unique_lock<std::mutex> lock(mLock);
+
+    if (!mExecutor && !mCount) {
+        lock.unlock();
+        task();
+        return;
+    }
+
+    size_t depth = ++mPending;
+    size_t max = mMaxPending.load();
+    while (depth > max && !mMaxPending.compare_exchange_weak(max, depth)) {
+    }
+
+    if (mExecutor) {
+        Executor executor = mExecutor;
+        lock.unlock();
+        executor([this, task] {
+            started();
+            task();
+        });
+        return;
+    }
+
+    auto i = mIndex++;
+
+    for (unsigned n = 0; n != mCount; ++n) {
+        if (mQueues[(i + n) % mCount].try_push(std::move(task))) return;
+    }
+
+    mQueues[i % mCount].push(std::move(task));
+}
+
+VTaskScheduler::Stats VTaskScheduler::stats() const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+
+    Stats stats;
+    stats.threads = unsigned(mThreads.size());
+    stats.tasks = mTasks;
+    stats.steals = mSteals;
+    stats.idleSpins = mIdleSpins;
+    stats.callerRuns = mCallerRuns;
+    stats.queueDepth = mPending;
+    stats.maxQueueDepth = mMaxPending;
+    return stats;
+}
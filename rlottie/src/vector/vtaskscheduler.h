@@ -0,0 +1,69 @@
+#ifndef VTASKSCHEDULER_H
+#define VTASKSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "vtaskqueue.h"
+
+/*
+ * Runs tasks on a bounded pool of threads, or hands them to an executor
+ * owned by the application. Nothing is started until configure() asks for
+ * threads; until then tasks run right away in the thread that submits them.
+ *
+ * Each pool thread has its own queue and tasks are handed out round-robin.
+ * A thread that runs out of work looks through the other queues once and
+ * then blocks on its own, instead of spinning.
+ */
+class VTaskScheduler {
+public:
+    using Task = std::function<void()>;
+    using Executor = std::function<void(Task)>;
+
+    struct Stats {
+        unsigned threads{0};
+        uint64_t tasks{0};
+        uint64_t steals{0};
+        uint64_t idleSpins{0};
+        uint64_t callerRuns{0};
+        size_t   queueDepth{0};
+        size_t   maxQueueDepth{0};
+    };
+
+    ~VTaskScheduler() { stop(); }
+
+    // Waits for queued tasks, then restarts with threadCount threads,
+    // at most one per core. 0 stops the pool.
+    void configure(unsigned threadCount);
+    // Tasks go to executor instead of the pool while it is set
+    void setExecutor(Executor executor);
+    void process(Task task);
+    // A waiting thread ran a task itself, instead of waiting for the pool
+    void noteCallerRun() { mCallerRuns++; }
+    Stats stats() const;
+
+private:
+    void run(unsigned i);
+    void stop();
+    void started() { mPending--; }
+
+    mutable std::mutex                       mLock;
+    Executor                                 mExecutor;
+    std::vector<std::thread>                 mThreads;
+    std::unique_ptr<TaskQueue<Task>[]>       mQueues;
+    unsigned                                 mCount{0};
+    unsigned                                 mIndex{0};
+    std::atomic<uint64_t>                    mTasks{0};
+    std::atomic<uint64_t>                    mSteals{0};
+    std::atomic<uint64_t>                    mIdleSpins{0};
+    std::atomic<uint64_t>                    mCallerRuns{0};
+    std::atomic<size_t>                      mPending{0};
+    std::atomic<size_t>                      mMaxPending{0};
+};
+
+#endif  // VTASKSCHEDULER_H
@@ -0,0 +1,126 @@
+/*
+ * Times rendering every frame with and without partial repaint, and
+ * counts heap allocations made while doing it.
+ * Usage: partialRenderBench [size] [file.json...]
+ * Without files it renders a mostly static sticker: a few large
+ * translucent shapes with a small one moving over them.
+ */
+#include <rlottie.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <vector>
+
+static size_t allocations = 0;
+
+void *operator new(size_t size)
+{
+    allocations++;
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace {
+
+std::string ellipse(int x, int y, int size, const char *color, int opacity)
+{
+    std::ostringstream shape;
+    shape << R"({"ty":"gr","it":[{"ty":"el","d":1,"p":{"a":0,"k":[)" << x << ","
+          << y << R"(]},"s":{"a":0,"k":[)" << size << "," << size << R"(]}},)"
+          << R"({"ty":"fl","r":1,"o":{"a":0,"k":)" << opacity << R"(},"c":{"a":0,"k":)"
+          << color << R"(}},)"
+          << R"({"ty":"tr","p":{"a":0,"k":[0,0]},"a":{"a":0,"k":[0,0]},"s":{"a":0,"k":[100,100]},)"
+          << R"("r":{"a":0,"k":0},"o":{"a":0,"k":100}}]})";
+    return shape.str();
+}
+
+const char *layerHead = R"({"ty":4,"ip":0,"op":90,"st":0,"sr":1,"ks":{"o":{"a":0,"k":100},)"
+                        R"("r":{"a":0,"k":0},"a":{"a":0,"k":[0,0]},"s":{"a":0,"k":[100,100]},)";
+
+std::string mostlyStatic()
+{
+    std::ostringstream json;
+    json << R"({"v":"5.5.2","fr":30,"ip":0,"op":90,"w":512,"h":512,"layers":[)";
+    // moving ball on top
+    json << layerHead
+         << R"("p":{"a":1,"k":[{"t":0,"s":[100,400],"e":[400,100],"i":{"x":0.5,"y":0.5},)"
+         << R"("o":{"x":0.5,"y":0.5}},{"t":45,"s":[400,100],"e":[100,400],)"
+         << R"("i":{"x":0.5,"y":0.5},"o":{"x":0.5,"y":0.5}},{"t":90}]}},"shapes":[)"
+         << ellipse(0, 0, 40, "[1,0.2,0.2,1]", 100) << "]},";
+    json << layerHead << R"("p":{"a":0,"k":[0,0]}},"shapes":[)";
+    const char *colors[] = {"[0.2,0.4,1,1]", "[0.2,1,0.4,1]", "[1,1,0.2,1]"};
+    for (int i = 0; i < 6; i++) {
+        if (i) json << ",";
+        json << ellipse(128 + i % 3 * 128, 160 + i / 3 * 192, 300, colors[i % 3], 60);
+    }
+    json << "]}]}";
+    return json.str();
+}
+
+void measure(const char *name, rlottie::Animation &animation, size_t size)
+{
+    std::vector<uint32_t> buffer(size * size);
+    for (bool partial : {false, true}) {
+        animation.setPartialRender(partial);
+        // first time through buffers are still growing
+        for (size_t frameNo = 0; frameNo < animation.totalFrame(); frameNo++) {
+            rlottie::Surface surface(buffer.data(), size, size, size * 4);
+            animation.renderSync(frameNo, surface);
+        }
+
+        double area = 0;
+        size_t allocated = allocations;
+        auto   start = std::chrono::steady_clock::now();
+        for (int round = 0; round < 5; round++) {
+            for (size_t frameNo = 0; frameNo < animation.totalFrame(); frameNo++) {
+                rlottie::Surface surface(buffer.data(), size, size, size * 4);
+                animation.renderSync(frameNo, surface);
+                size_t x, y, w, h;
+                animation.damageRect(x, y, w, h);
+                area += double(w * h);
+            }
+        }
+        std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+        double frames = 5.0 * animation.totalFrame();
+        printf("%-24s %-7s %.3f ms/frame, %.1f%% repainted, %.1f allocations/frame\n",
+               name, partial ? "partial" : "full", elapsed.count() / frames,
+               100 * area / (frames * size * size), (allocations - allocated) / frames);
+    }
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = argc > 1 ? size_t(atoi(argv[1])) : 512;
+    if (!size) size = 512;
+
+    if (argc <= 2) {
+        auto animation = rlottie::Animation::loadFromData(mostlyStatic(), "bench", "", false);
+        measure("mostly static", *animation, size);
+    }
+    for (int i = 2; i < argc; i++) {
+        auto animation = rlottie::Animation::loadFromFile(argv[i], false);
+        if (!animation) {
+            fprintf(stderr, "Failed to load %s\n", argv[i]);
+            return 1;
+        }
+        measure(argv[i], *animation, size);
+    }
+
+    return 0;
+}
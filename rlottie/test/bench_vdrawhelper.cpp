@@ -0,0 +1,137 @@
+/*
+ * Times the span kernels of each instruction set on sticker sized rows.
+ * Usage: drawHelperBench [rounds]
+ */
+#include "vdrawhelper.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+// Linked without vdrawhelper.cpp, so these still hold the C kernels
+extern CompositionFunction      COMP_functionForMode_C[];
+extern CompositionFunctionSolid COMP_functionForModeSolid_C[];
+
+#if defined(__SSE2__)
+extern void memfill32_sse2(uint32_t *dest, uint32_t value, int length);
+extern void Vcomp_func_solid_Source_sse2(uint32_t *dest, int length,
+                                         uint32_t color, uint32_t const_alpha);
+extern void Vcomp_func_solid_SourceOver_sse2(uint32_t *dest, int length,
+                                             uint32_t color,
+                                             uint32_t const_alpha);
+#endif
+
+namespace {
+
+constexpr int WIDTH = 200;
+constexpr int HEIGHT = 200;
+
+std::vector<uint32_t> makePixels(size_t count)
+{
+    std::mt19937          random(3);
+    std::vector<uint32_t> pixels(count);
+    for (auto &pixel : pixels) {
+        uint32_t alpha = random() % 3 ? random() % 256 : 255;
+        pixel = alpha << 24 | (alpha / 2) << 16 | (alpha / 3) << 8 | alpha / 4;
+    }
+    return pixels;
+}
+
+std::vector<uint32_t> dest(WIDTH * HEIGHT);
+std::vector<uint32_t> src = makePixels(WIDTH * HEIGHT);
+
+void measure(const char *kernel, const char *impl, int rounds,
+             const std::function<void(uint32_t *, const uint32_t *)> &row)
+{
+    dest = makePixels(WIDTH * HEIGHT);
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++)
+        for (int y = 0; y < HEIGHT; y++)
+            row(&dest[y * WIDTH], &src[y * WIDTH]);
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    printf("%-24s %-5s %.3f ns/pixel\n", kernel, impl,
+           elapsed.count() / (double(rounds) * WIDTH * HEIGHT));
+}
+
+void measureSolid(const char *kernel, const char *impl, int rounds,
+                  CompositionFunctionSolid func, uint32_t const_alpha)
+{
+    measure(kernel, impl, rounds, [=](uint32_t *d, const uint32_t *) {
+        func(d, WIDTH, 0x80402010, const_alpha);
+    });
+}
+
+void measureSpan(const char *kernel, const char *impl, int rounds,
+                 CompositionFunction func, uint32_t const_alpha)
+{
+    measure(kernel, impl, rounds, [=](uint32_t *d, const uint32_t *s) {
+        func(d, s, WIDTH, const_alpha);
+    });
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    if (rounds <= 0) rounds = 200;
+
+    CompositionFunctionSolid solidSource =
+        COMP_functionForModeSolid_C[uint(BlendMode::Src)];
+    CompositionFunctionSolid solidSourceOver =
+        COMP_functionForModeSolid_C[uint(BlendMode::SrcOver)];
+    CompositionFunction sourceOver = COMP_functionForMode_C[uint(BlendMode::SrcOver)];
+
+    measure("memfill32", "C", rounds, [](uint32_t *d, const uint32_t *) {
+        memfill32_C(d, 0xff336699, WIDTH);
+    });
+#if defined(__SSE2__)
+    measure("memfill32", "SSE2", rounds, [](uint32_t *d, const uint32_t *) {
+        memfill32_sse2(d, 0xff336699, WIDTH);
+    });
+#endif
+#if defined(VECTOR_AVX2_SUPPORT)
+    bool avx2 = vCpuSupportsAvx2();
+    if (avx2)
+        measure("memfill32", "AVX2", rounds, [](uint32_t *d, const uint32_t *) {
+            memfill32_avx2(d, 0xff336699, WIDTH);
+        });
+#endif
+
+    measureSolid("solid_Source(128)", "C", rounds, solidSource, 128);
+#if defined(__SSE2__)
+    measureSolid("solid_Source(128)", "SSE2", rounds,
+                 Vcomp_func_solid_Source_sse2, 128);
+#endif
+#if defined(VECTOR_AVX2_SUPPORT)
+    if (avx2)
+        measureSolid("solid_Source(128)", "AVX2", rounds,
+                     Vcomp_func_solid_Source_avx2, 128);
+#endif
+
+    measureSolid("solid_SourceOver(255)", "C", rounds, solidSourceOver, 255);
+#if defined(__SSE2__)
+    measureSolid("solid_SourceOver(255)", "SSE2", rounds,
+                 Vcomp_func_solid_SourceOver_sse2, 255);
+#endif
+#if defined(VECTOR_AVX2_SUPPORT)
+    if (avx2)
+        measureSolid("solid_SourceOver(255)", "AVX2", rounds,
+                     Vcomp_func_solid_SourceOver_avx2, 255);
+#endif
+
+    for (uint32_t constAlpha : {255u, 128u}) {
+        const char *kernel = constAlpha == 255 ? "SourceOver(255)" : "SourceOver(128)";
+        measureSpan(kernel, "C", rounds, sourceOver, constAlpha);
+#if defined(VECTOR_AVX2_SUPPORT)
+        if (avx2)
+            measureSpan(kernel, "AVX2", rounds, Vcomp_func_SourceOver_avx2,
+                        constAlpha);
+#endif
+    }
+
+    return 0;
+}
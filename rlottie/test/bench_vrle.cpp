@@ -0,0 +1,110 @@
+/*
+ * Times rle mask operations on sticker sized masks.
+ * Usage: rleBench [rounds]
+ * Masks are antialiased ellipses the way the rasterizer emits them: a
+ * span per edge pixel and one for the solid part of each row.
+ */
+#include "vrle.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <vector>
+
+namespace {
+
+constexpr int SIZE = 512;
+
+VRle ellipse(float cx, float cy, float rx, float ry)
+{
+    std::vector<VRle::Span> spans;
+    for (int y = 0; y < SIZE; y++) {
+        int runStart = 0, runCoverage = 0;
+        for (int x = 0; x <= SIZE; x++) {
+            int coverage = 0;
+            if (x < SIZE) {
+                // 4x4 samples per pixel
+                for (int sy = 0; sy < 4; sy++)
+                    for (int sx = 0; sx < 4; sx++) {
+                        float dx = (x + (sx + 0.5f) / 4 - cx) / rx;
+                        float dy = (y + (sy + 0.5f) / 4 - cy) / ry;
+                        if (dx * dx + dy * dy <= 1) coverage++;
+                    }
+                coverage = coverage * 255 / 16;
+            }
+            if (coverage != runCoverage || (coverage && coverage != 255)) {
+                if (runCoverage) {
+                    VRle::Span span;
+                    span.x = short(runStart);
+                    span.y = short(y);
+                    span.len = ushort(x - runStart);
+                    span.coverage = uchar(runCoverage);
+                    spans.push_back(span);
+                }
+                runStart = x;
+                runCoverage = coverage;
+            }
+        }
+    }
+    VRle rle;
+    rle.addSpan(spans.data(), spans.size());
+    return rle;
+}
+
+size_t countSpans(const VRle &rle)
+{
+    size_t count = 0;
+    rle.intersect(VRect(0, 0, SIZE, SIZE),
+                  [](size_t n, const VRle::Span *, void *data) {
+                      *static_cast<size_t *>(data) += n;
+                  },
+                  &count);
+    return count;
+}
+
+void measure(const char *name, int rounds, const std::function<VRle()> &op)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; round++) op();
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - start;
+    printf("%-24s %8.2f us/op, %zu spans\n", name, elapsed.count() / rounds,
+           countSpans(op()));
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 200;
+    if (rounds <= 0) rounds = 200;
+
+    // overlapping masks, like a face with eye holes cut out of it
+    VRle face = ellipse(256, 256, 220, 200);
+    VRle eye = ellipse(180, 200, 60, 90);
+    VRle blob = ellipse(330, 300, 150, 120);
+    VRle translucent = blob;
+    translucent *= 128;
+
+    measure("add", rounds, [&] { return face + blob; });
+    measure("add translucent", rounds, [&] { return face + translucent; });
+    measure("subtract", rounds, [&] { return face - eye; });
+    measure("xor", rounds, [&] { return face ^ blob; });
+    measure("intersect", rounds, [&] { return face & blob; });
+    measure("intersect in place", rounds, [&] {
+        VRle rle = face;
+        rle &= blob;
+        return rle;
+    });
+    measure("clip", rounds, [&] {
+        // what the painter does to draw with a clip
+        VRle result;
+        face.intersect(blob, [](size_t n, const VRle::Span *spans, void *data) {
+            static_cast<VRle *>(data)->addSpan(spans, n);
+        }, &result);
+        return result;
+    });
+
+    return 0;
+}
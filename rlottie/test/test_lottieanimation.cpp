@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 #include "rlottie.h"
+#include <mutex>
+#include <vector>
 
 class AnimationTest : public ::testing::Test {
 public:
@@ -32,3 +34,327 @@ TEST_F(AnimationTest, loadFromFile) {
     ASSERT_EQ(width, 500);
     ASSERT_EQ(height, 500);
 }
+
+namespace {
+
+// Rotation has hold keyframes, two of them at the same frame, position
+// moves along a path and scale keyframes are out of order.
+const char *keyFramesJson = R"({"v":"5.5.2","fr":30,"ip":0,"op":60,"w":100,"h":100,"layers":[
+{"ty":4,"ind":1,"ip":0,"op":60,"st":0,"sr":1,
+ "ks":{"o":{"a":0,"k":100},
+  "r":{"a":1,"k":[{"t":0,"s":[0],"h":1},{"t":10,"s":[45],"h":1},
+                  {"t":10,"s":[30],"i":{"x":[0.3],"y":[1]},"o":{"x":[0.7],"y":[0]}},
+                  {"t":40,"s":[90],"h":1}]},
+  "p":{"a":1,"k":[{"t":0,"s":[50,50],"e":[60,40],"to":[5,0],"ti":[0,5],
+                   "i":{"x":0.5,"y":0.5},"o":{"x":0.5,"y":0.5}},
+                  {"t":25,"s":[60,40],"e":[40,60],"i":{"x":0.5,"y":0.5},"o":{"x":0.5,"y":0.5}},
+                  {"t":50}]},
+  "a":{"a":0,"k":[0,0]},
+  "s":{"a":1,"k":[{"t":20,"s":[100,100],"i":{"x":[0.5],"y":[0.5]},"o":{"x":[0.5],"y":[0.5]}},
+                  {"t":5,"s":[50,150],"i":{"x":[0.5],"y":[0.5]},"o":{"x":[0.5],"y":[0.5]}},
+                  {"t":45,"s":[120,80]}]}},
+ "shapes":[{"ty":"gr","it":[
+  {"ty":"rc","d":1,"p":{"a":0,"k":[0,0]},"r":{"a":0,"k":4},
+   "s":{"a":1,"k":[{"t":0,"s":[30,20],"i":{"x":[0.5],"y":[0.5]},"o":{"x":[0.5],"y":[0.5]}},
+                   {"t":30,"s":[40,40],"i":{"x":[0.5],"y":[0.5]},"o":{"x":[0.5],"y":[0.5]}},
+                   {"t":60,"s":[30,20]}]}},
+  {"ty":"fl","r":1,"o":OPACITY,"c":COLOR},
+  {"ty":"tr","p":{"a":0,"k":[0,0]},"a":{"a":0,"k":[0,0]},"s":{"a":0,"k":[100,100]},
+   "r":{"a":0,"k":0},"o":{"a":0,"k":100}}]}]}]})";
+
+std::string keyFramesAnimation(const std::string &opacity, const std::string &color)
+{
+    std::string json = keyFramesJson;
+    json.replace(json.find("OPACITY"), 7, opacity);
+    json.replace(json.find("COLOR"), 5, color);
+    return json;
+}
+
+std::vector<std::vector<uint32_t>> renderFrames(rlottie::Animation &animation,
+                                                const std::vector<size_t> &order)
+{
+    std::vector<std::vector<uint32_t>> frames(animation.totalFrame());
+    for (size_t frameNo : order) {
+        frames[frameNo].resize(100 * 100);
+        rlottie::Surface surface(frames[frameNo].data(), 100, 100, 100 * 4);
+        animation.renderSync(frameNo, surface);
+    }
+    return frames;
+}
+
+}
+
+TEST(KeyFrameTest, frameOrder) {
+    std::string json = keyFramesAnimation(R"({"a":0,"k":80})", R"({"a":0,"k":[1,0,0,1]})");
+    auto forward = rlottie::Animation::loadFromData(json, "forward", "", false);
+    auto backward = rlottie::Animation::loadFromData(json, "backward", "", false);
+    ASSERT_TRUE(forward && backward);
+
+    // Walking backwards and jumping around misses the keyframe looked up last time
+    std::vector<size_t> order, reverse, jumps;
+    for (size_t i = 0; i < forward->totalFrame(); i++) {
+        order.push_back(i);
+        reverse.insert(reverse.begin(), i);
+        jumps.push_back(i * 37 % forward->totalFrame());
+    }
+    auto expected = renderFrames(*forward, order);
+    EXPECT_NE(std::vector<uint32_t>(100 * 100), expected[0]);
+    EXPECT_EQ(expected, renderFrames(*backward, reverse));
+    EXPECT_EQ(expected, renderFrames(*backward, jumps));
+}
+
+TEST(KeyFrameTest, constantKeyFrames) {
+    auto animated = rlottie::Animation::loadFromData(
+        keyFramesAnimation(
+            R"({"a":1,"k":[{"t":0,"s":[80],"i":{"x":[0.5],"y":[0.5]},"o":{"x":[0.5],"y":[0.5]}},
+                           {"t":20,"s":[80],"h":1},{"t":50,"s":[80]}]})",
+            R"({"a":1,"k":[{"t":0,"s":[1,0,0,1],"i":{"x":[0.5],"y":[0.5]},"o":{"x":[0.5],"y":[0.5]}},
+                           {"t":59,"s":[1,0,0,1]}]})"),
+        "animated", "", false);
+    auto constant = rlottie::Animation::loadFromData(
+        keyFramesAnimation(R"({"a":0,"k":80})", R"({"a":0,"k":[1,0,0,1]})"),
+        "constant", "", false);
+    ASSERT_TRUE(animated && constant);
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < animated->totalFrame(); i++)
+        order.push_back(i);
+    EXPECT_EQ(renderFrames(*constant, order), renderFrames(*animated, order));
+}
+
+TEST(PartialRenderTest, sameAsFull) {
+    std::string json = keyFramesAnimation(R"({"a":0,"k":80})", R"({"a":0,"k":[1,0,0,1]})");
+    auto full = rlottie::Animation::loadFromData(json, "full", "", false);
+    auto partial = full->clone();
+    partial->setPartialRender(true);
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < full->totalFrame(); i++)
+        order.push_back(i * 37 % full->totalFrame());
+    auto expected = renderFrames(*full, order);
+
+    std::vector<uint32_t> buffer(100 * 100);
+    rlottie::Surface surface(buffer.data(), 100, 100, 100 * 4);
+    size_t x, y, width, height;
+    for (size_t frameNo : order) {
+        partial->renderSync(frameNo, surface);
+        EXPECT_EQ(expected[frameNo], buffer) << "frame " << frameNo;
+        // the rectangle moves around without ever covering everything
+        partial->damageRect(x, y, width, height);
+        if (frameNo != order[0]) {
+            EXPECT_LT(width * height, 100u * 100u) << "frame " << frameNo;
+            EXPECT_LE(x + width, 100u);
+            EXPECT_LE(y + height, 100u);
+        }
+    }
+
+    partial->renderSync(order.back(), surface);
+    partial->damageRect(x, y, width, height);
+    EXPECT_EQ(0u, width * height);
+
+    // some other buffer can't hold the previous frame
+    std::vector<uint32_t> other(100 * 100, 0xffffffff);
+    partial->renderSync(order[0], rlottie::Surface(other.data(), 100, 100, 100 * 4));
+    partial->damageRect(x, y, width, height);
+    EXPECT_EQ(100u, width);
+    EXPECT_EQ(100u, height);
+    EXPECT_EQ(expected[order[0]], other);
+}
+
+TEST(MovedShapeTest, sameAsRasterized) {
+    // A stroked star carried around by its layer: whole pixel steps, a
+    // sub-pixel slide, and out of view on both sides.
+    std::string json = R"({"v":"5.5.2","fr":30,"ip":0,"op":60,"w":100,"h":100,"layers":[
+{"ty":4,"ind":1,"ip":0,"op":60,"st":0,"sr":1,
+ "ks":{"o":{"a":0,"k":100},"r":{"a":0,"k":0},"a":{"a":0,"k":[0,0]},"s":{"a":0,"k":[100,100]},
+  "p":{"a":1,"k":[{"t":0,"s":[30,50],"h":1},{"t":5,"s":[31,50],"h":1},{"t":10,"s":[38,46],"h":1},
+                  {"t":15,"s":[38,46],"e":[40.5,47.25],"i":{"x":0.5,"y":0.5},"o":{"x":0.5,"y":0.5}},
+                  {"t":25,"s":[41,48],"h":1},{"t":30,"s":[90,48],"h":1},{"t":35,"s":[85,48],"h":1},
+                  {"t":40,"s":[10,5],"h":1},{"t":45,"s":[50,50],"h":1},{"t":50,"s":[52,51]}]}},
+ "shapes":[{"ty":"gr","it":[
+  {"ty":"sr","sy":1,"d":1,"pt":{"a":0,"k":5},"p":{"a":0,"k":[0,0]},"r":{"a":0,"k":0},
+   "ir":{"a":0,"k":10},"is":{"a":0,"k":20},"or":{"a":0,"k":25},"os":{"a":0,"k":10}},
+  {"ty":"st","lc":2,"lj":2,"ml":4,"o":{"a":0,"k":100},"w":{"a":0,"k":3},"c":{"a":0,"k":[0,0,1,1]}},
+  {"ty":"fl","r":1,"o":{"a":0,"k":100},"c":{"a":0,"k":[1,0,0,1]}},
+  {"ty":"tr","p":{"a":0,"k":[0,0]},"a":{"a":0,"k":[0,0]},"s":{"a":0,"k":[100,100]},
+   "r":{"a":0,"k":0},"o":{"a":0,"k":100}}]}]}]})";
+    auto animation = rlottie::Animation::loadFromData(json, "moved", "", false);
+    ASSERT_TRUE(animation);
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < animation->totalFrame(); i++) order.push_back(i);
+    auto frames = renderFrames(*animation, order);
+
+    // a fresh animation has nothing to move along
+    for (size_t frameNo : order) {
+        auto fresh = rlottie::Animation::loadFromData(json, "fresh", "", false);
+        EXPECT_EQ(renderFrames(*fresh, {frameNo})[frameNo], frames[frameNo])
+            << "frame " << frameNo;
+    }
+}
+
+TEST(ParserTest, sameModelAnyNotation) {
+    // Plain numbers in arrays are read by the parser itself, anything else
+    // by the json reader. Both ways have to give the same animation, however
+    // the numbers and arrays are written.
+    const char *layerJson = R"({"v":"5.5.2","fr":30,"ip":0,"op":60,"w":100,"h":100,"layers":[
+{"ty":4,"ind":1,"ip":0,"op":60,"st":0,"sr":1,
+ "ks":{"o":{"a":0,"k":100},"r":{"a":0,"k":0},"a":{"a":0,"k":[0,0]},"s":{"a":0,"k":[100,100]},
+  "p":POSITION},
+ "shapes":[{"ty":"gr","it":[
+  {"ty":"sh","d":1,"ks":{"a":0,"k":{"c":true,"v":VERTICES,
+   "i":[[0,0],[0,0],[0,0]],"o":[[0,0],[0,0],[0,0]]}}},
+  {"ty":"fl","r":1,"o":{"a":0,"k":100},"c":{"a":0,"k":COLOR}},
+  {"ty":"tr","p":{"a":0,"k":[0,0]},"a":{"a":0,"k":[0,0]},"s":{"a":0,"k":[100,100]},
+   "r":{"a":0,"k":0},"o":{"a":0,"k":100}}]}]}]})";
+    const char *numbers[] = {"25",     "33.5",   "4.25e1", "625E-1",
+                             "0.7e+2", "1e1",    "-0",     "77.125",
+                             "0.0",    "12.000000000000000000001",
+                             "81.03125", "19.99", "3e-0", "64.00000000001"};
+
+    std::string packed = "{\"a\":1,\"k\":[", split = "{\"s\":true,\"x\":{\"a\":0,\"k\":50},\"y\":{\"a\":1,\"k\":[";
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        std::string t = std::to_string(i * 4);
+        std::string y = numbers[i];
+        if (i) {
+            packed += ",";
+            split += ",";
+        }
+        packed += "{\"t\":" + t + ",\"s\":[" + (i % 2 ? " 50 ,\n\t" : "50,") + y +
+                  (i % 3 ? "]" : ",0]") + ",\"h\":1}";
+        split += "{\"t\":" + t + ",\"s\":" + y + ",\"h\":1}";
+    }
+    packed += "]}";
+    split += "]}}";
+
+    auto animation = [&](const std::string &position, const char *vertices,
+                         const char *color) {
+        std::string json = layerJson;
+        json.replace(json.find("POSITION"), 8, position);
+        json.replace(json.find("VERTICES"), 8, vertices);
+        json.replace(json.find("COLOR"), 5, color);
+        return rlottie::Animation::loadFromData(json, "parsed", "", false);
+    };
+    auto plain = animation(packed, "[[-20,-20],[20.5,-20],[0,25]]", "[1,0.5,0.25,1]");
+    auto spaced = animation(split, "[ [ -20 , -20 ] ,\r\n[2.05e1,-2e1],[0,25.0] ]",
+                            "[ 1.0,0.50000000000000000001,25e-2 ,1 ]");
+    auto mixed = animation(packed, "[[-20,-20],[20.5,-20.000000000000000000001],[0,25]]",
+                           "[1,0.5,0.25,1.00000000000000000000001]");
+    ASSERT_TRUE(plain && spaced && mixed);
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < plain->totalFrame(); i++) order.push_back(i);
+    auto expected = renderFrames(*plain, order);
+    EXPECT_EQ(expected, renderFrames(*spaced, order));
+    EXPECT_EQ(expected, renderFrames(*mixed, order));
+}
+
+TEST(BitmapPoolTest, reusedAcrossFrames) {
+    // an alpha matte and a luma one, each drawn through two bitmaps
+    std::string json = R"({"v":"5.5.2","fr":30,"ip":0,"op":10,"w":100,"h":100,"layers":[
+{"ty":4,"ind":1,"ip":0,"op":10,"st":0,"sr":1,"td":1,
+ "ks":{"o":{"a":0,"k":100},"r":{"a":1,"k":[{"t":0,"s":[0],"i":{"x":[0.5],"y":[0.5]},"o":{"x":[0.5],"y":[0.5]}},{"t":10,"s":[90]}]},
+  "a":{"a":0,"k":[0,0]},"s":{"a":0,"k":[100,100]},"p":{"a":0,"k":[50,50]}},
+ "shapes":[{"ty":"gr","it":[{"ty":"rc","d":1,"p":{"a":0,"k":[0,0]},"s":{"a":0,"k":[60,30]},"r":{"a":0,"k":0}},
+  {"ty":"fl","r":1,"o":{"a":0,"k":100},"c":{"a":0,"k":[1,1,1,1]}},
+  {"ty":"tr","p":{"a":0,"k":[0,0]},"a":{"a":0,"k":[0,0]},"s":{"a":0,"k":[100,100]},"r":{"a":0,"k":0},"o":{"a":0,"k":100}}]}]},
+{"ty":4,"ind":2,"ip":0,"op":10,"st":0,"sr":1,"tt":MATTE,
+ "ks":{"o":{"a":0,"k":100},"r":{"a":0,"k":0},"a":{"a":0,"k":[0,0]},"s":{"a":0,"k":[100,100]},"p":{"a":0,"k":[50,50]}},
+ "shapes":[{"ty":"gr","it":[{"ty":"el","d":1,"p":{"a":0,"k":[0,0]},"s":{"a":0,"k":[70,70]}},
+  {"ty":"fl","r":1,"o":{"a":0,"k":100},"c":{"a":0,"k":[0,0.5,1,1]}},
+  {"ty":"tr","p":{"a":0,"k":[0,0]},"a":{"a":0,"k":[0,0]},"s":{"a":0,"k":[100,100]},"r":{"a":0,"k":0},"o":{"a":0,"k":100}}]}]}]})";
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < 10; i++) order.push_back(i);
+
+    for (const char *matte : {"1", "3"}) {
+        std::string source = json;
+        source.replace(source.find("MATTE"), 5, matte);
+        auto animation = rlottie::Animation::loadFromData(source, matte, "", false);
+        ASSERT_TRUE(animation);
+
+        renderFrames(*animation, {0});
+        auto before = rlottie::bitmapPoolStats();
+        auto pooled = renderFrames(*animation, order);
+        auto after = rlottie::bitmapPoolStats();
+        EXPECT_EQ(before.misses, after.misses) << "matte " << matte;
+        EXPECT_EQ(before.hits + 2 * order.size(), after.hits) << "matte " << matte;
+        EXPECT_GE(after.peakBytes, 2u * 100 * 100 * 4);
+
+        // nothing kept, the same pictures
+        rlottie::configureBitmapPoolMemoryLimit(0);
+        EXPECT_EQ(0u, rlottie::bitmapPoolStats().bytes);
+        EXPECT_EQ(pooled, renderFrames(*animation, order)) << "matte " << matte;
+        EXPECT_EQ(0u, rlottie::bitmapPoolStats().bytes);
+        rlottie::configureBitmapPoolMemoryLimit(8 * 1024 * 1024);
+    }
+}
+
+TEST(SchedulerTest, executor) {
+    std::string json = keyFramesAnimation(R"({"a":0,"k":80})", R"({"a":0,"k":[1,0,0,1]})");
+    auto animation = rlottie::Animation::loadFromData(json, "scheduler", "", false);
+    auto expected = renderFrames(*animation, {0, 20, 40});
+
+    std::vector<std::function<void()>> queue;
+    std::mutex                         lock;
+    rlottie::configureExecutor([&](std::function<void()> task) {
+        std::lock_guard<std::mutex> guard(lock);
+        queue.push_back(std::move(task));
+    });
+
+    rlottie::SchedulerStats render = rlottie::renderSchedulerStats();
+    rlottie::SchedulerStats raster = rlottie::rasterSchedulerStats();
+    size_t executed = 0;
+    std::vector<uint32_t> buffer(100 * 100);
+    for (size_t frameNo : {0, 20, 40}) {
+        auto result = animation->render(frameNo, rlottie::Surface(buffer.data(), 100, 100, 100 * 4));
+        // shapes queued while the frame renders are run by the render task itself
+        while (true) {
+            std::function<void()> task;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (queue.empty()) break;
+                task = std::move(queue.front());
+                queue.erase(queue.begin());
+            }
+            task();
+            executed++;
+        }
+        result.get();
+        EXPECT_EQ(expected[frameNo], buffer) << "frame " << frameNo;
+    }
+    rlottie::configureExecutor(nullptr);
+
+    // without thread support there is nothing to count
+    rlottie::SchedulerStats renderAfter = rlottie::renderSchedulerStats();
+    rlottie::SchedulerStats rasterAfter = rlottie::rasterSchedulerStats();
+    EXPECT_EQ(executed, (renderAfter.tasks - render.tasks) + (rasterAfter.tasks - raster.tasks));
+    EXPECT_EQ(rasterAfter.tasks - raster.tasks, rasterAfter.callerRuns - raster.callerRuns);
+    EXPECT_EQ(0u, renderAfter.queueDepth);
+    EXPECT_EQ(0u, rasterAfter.queueDepth);
+    EXPECT_EQ(0u, renderAfter.threads);
+}
+
+TEST(SchedulerTest, threads) {
+    std::string json = keyFramesAnimation(R"({"a":0,"k":80})", R"({"a":0,"k":[1,0,0,1]})");
+    auto animation = rlottie::Animation::loadFromData(json, "scheduler", "", false);
+    std::vector<size_t> order;
+    for (size_t i = 0; i < animation->totalFrame(); i++)
+        order.push_back(i);
+    auto expected = renderFrames(*animation, order);
+
+    rlottie::configureThreads(2, 2);
+    EXPECT_LE(rlottie::renderSchedulerStats().threads, 2u);
+    EXPECT_LE(rlottie::rasterSchedulerStats().threads, 2u);
+
+    std::vector<uint32_t> buffer(100 * 100);
+    for (size_t frameNo : order) {
+        animation->render(frameNo, rlottie::Surface(buffer.data(), 100, 100, 100 * 4)).get();
+        EXPECT_EQ(expected[frameNo], buffer) << "frame " << frameNo;
+    }
+
+    rlottie::configureThreads(0, 0);
+    EXPECT_EQ(0u, rlottie::renderSchedulerStats().threads);
+    EXPECT_EQ(0u, rlottie::rasterSchedulerStats().threads);
+    EXPECT_EQ(0u, rlottie::rasterSchedulerStats().queueDepth);
+}
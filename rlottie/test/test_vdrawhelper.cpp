@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include "vdrawhelper.h"
+#include <random>
+#include <vector>
+
+#if defined(VECTOR_AVX2_SUPPORT)
+
+/*
+ * The AVX2 kernels must give exactly what the C ones in
+ * vcompositionfunctions.cpp give, which are repeated here as reference.
+ */
+namespace {
+
+void refSolid(uint32_t *dest, int length, uint32_t color, uint32_t ialpha)
+{
+    for (int i = 0; i < length; ++i) dest[i] = color + BYTE_MUL(dest[i], ialpha);
+}
+
+void refSolidSource(uint32_t *dest, int length, uint32_t color,
+                    uint32_t const_alpha)
+{
+    if (const_alpha == 255)
+        memfill32_C(dest, color, length);
+    else
+        refSolid(dest, length, BYTE_MUL(color, const_alpha), 255 - const_alpha);
+}
+
+void refSolidSourceOver(uint32_t *dest, int length, uint32_t color,
+                        uint32_t const_alpha)
+{
+    if (const_alpha != 255) color = BYTE_MUL(color, const_alpha);
+    refSolid(dest, length, color, 255 - vAlpha(color));
+}
+
+void refSourceOver(uint32_t *dest, const uint32_t *src, int length,
+                   uint32_t const_alpha)
+{
+    for (int i = 0; i < length; ++i) {
+        uint32_t s = src[i];
+        if (const_alpha != 255)
+            s = BYTE_MUL(s, const_alpha);
+        else if (s == 0)
+            continue;
+        dest[i] = s + BYTE_MUL(dest[i], vAlpha(~s));
+    }
+}
+
+// Random premultiplied pixels, with runs of transparent and opaque ones
+std::vector<uint32_t> makePixels(size_t count, std::mt19937 &random)
+{
+    std::vector<uint32_t> pixels(count);
+    for (size_t i = 0; i < count; i++) {
+        uint32_t alpha;
+        switch ((i / 11) % 3) {
+        case 0: alpha = 0; break;
+        case 1: alpha = 255; break;
+        default: alpha = random() % 256; break;
+        }
+        uint32_t pixel = alpha << 24;
+        for (int shift = 0; shift < 24; shift += 8)
+            pixel |= (alpha ? random() % (alpha + 1) : 0) << shift;
+        pixels[i] = pixel;
+    }
+    return pixels;
+}
+
+const uint32_t constAlphas[] = {0, 1, 128, 254, 255};
+const uint32_t colors[] = {0, 0xff000000, 0xffffffff, 0x80402010, 0x01010101};
+
+class DrawHelperAvx2Test : public ::testing::Test {
+public:
+    void SetUp()
+    {
+        if (!vCpuSupportsAvx2()) GTEST_SKIP() << "no AVX2 on this cpu";
+    }
+};
+
+}
+
+TEST_F(DrawHelperAvx2Test, memfill) {
+    std::vector<uint32_t> expected(100), actual(100);
+    for (int offset = 0; offset < 8; offset++) {
+        for (int length = 0; length + offset <= 100; length++) {
+            expected.assign(100, 0x12345678);
+            actual = expected;
+            memfill32_C(&expected[offset], 0xdeadbeef, length);
+            memfill32_avx2(&actual[offset], 0xdeadbeef, length);
+            ASSERT_EQ(expected, actual) << "offset " << offset << " length " << length;
+        }
+    }
+}
+
+TEST_F(DrawHelperAvx2Test, solid) {
+    std::mt19937 random(1);
+    std::vector<uint32_t> background = makePixels(80, random);
+    std::vector<uint32_t> expected, actual;
+
+    for (uint32_t color : colors) {
+        for (uint32_t constAlpha : constAlphas) {
+            for (int length = 0; length + 3 <= 80; length += 5) {
+                expected = actual = background;
+                refSolidSource(&expected[3], length, color, constAlpha);
+                Vcomp_func_solid_Source_avx2(&actual[3], length, color, constAlpha);
+                ASSERT_EQ(expected, actual) << "Source " << color << " " << constAlpha;
+
+                expected = actual = background;
+                refSolidSourceOver(&expected[3], length, color, constAlpha);
+                Vcomp_func_solid_SourceOver_avx2(&actual[3], length, color, constAlpha);
+                ASSERT_EQ(expected, actual) << "SourceOver " << color << " " << constAlpha;
+            }
+        }
+    }
+}
+
+TEST_F(DrawHelperAvx2Test, sourceOver) {
+    std::mt19937 random(2);
+    std::vector<uint32_t> background = makePixels(300, random);
+    std::vector<uint32_t> source = makePixels(300, random);
+    std::vector<uint32_t> expected, actual;
+
+    for (uint32_t constAlpha : constAlphas) {
+        for (int offset = 0; offset < 8; offset++) {
+            for (int length : {0, 1, 7, 8, 9, 31, 64, 200, 290}) {
+                expected = actual = background;
+                refSourceOver(&expected[offset], &source[8 - offset], length, constAlpha);
+                Vcomp_func_SourceOver_avx2(&actual[offset], &source[8 - offset],
+                                           length, constAlpha);
+                ASSERT_EQ(expected, actual)
+                    << constAlpha << " " << offset << " " << length;
+            }
+        }
+    }
+}
+
+#endif
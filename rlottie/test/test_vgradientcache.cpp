@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include "vgradientcache.h"
+#include <thread>
+#include <vector>
+
+namespace {
+
+VGradient gradient(const VGradientStops &stops, float alpha = 1.0f)
+{
+    VGradient gradient(VGradient::Type::Linear);
+    gradient.setStops(stops);
+    gradient.setAlpha(alpha);
+    return gradient;
+}
+
+void expectTable(const VGradient &gradient, const VGradientCache::VCacheData &table)
+{
+    ASSERT_TRUE(table);
+    VColorTable expected;
+    expected.alpha = VGradientCache::generateGradientColorTable(
+        gradient.mStops, gradient.alpha(), expected.buffer32,
+        VGradient::colorTableSize);
+    EXPECT_EQ(expected.alpha, table->alpha);
+    EXPECT_EQ(0, memcmp(expected.buffer32, table->buffer32, sizeof(expected.buffer32)));
+}
+
+class GradientCacheTest : public ::testing::Test {
+public:
+    void SetUp() { cache().configureCacheSize(0); cache().configureCacheSize(60); }
+    void TearDown() { cache().configureCacheSize(60); }
+
+    static VGradientCache &cache() { return VGradientCache::instance(); }
+};
+
+const VColor red(255, 0, 0), blue(0, 0, 255), clear(0, 255, 0, 0);
+
+}
+
+TEST_F(GradientCacheTest, sameGradientSameTable) {
+    VGradient a = gradient({{0, red}, {1, blue}});
+    VGradient b = gradient({{0, red}, {1, blue}});
+    auto before = cache().stats();
+    auto table = cache().getBuffer(a);
+    expectTable(a, table);
+    EXPECT_EQ(table, cache().getBuffer(b));
+
+    auto after = cache().stats();
+    EXPECT_EQ(before.misses + 1, after.misses);
+    EXPECT_EQ(before.hits + 1, after.hits);
+    EXPECT_EQ(1u, after.entries);
+}
+
+TEST_F(GradientCacheTest, everyStopAndOpacityCount) {
+    // the same colors in another order, or further along, or drawn with
+    // another opacity, all need tables of their own
+    std::vector<VGradient> gradients = {
+        gradient({{0, red}, {1, blue}}),
+        gradient({{0, blue}, {1, red}}),
+        gradient({{0, red}, {0.5, blue}}),
+        gradient({{0, red}, {0.5, clear}, {1, blue}}),
+        gradient({{0, red}, {0.5, clear}, {1, red}}),
+        gradient({{0, red}, {1, blue}}, 0.5f),
+        gradient({{0, red}, {1, blue}}, 0.25f),
+    };
+    for (int round = 0; round < 2; round++) {
+        for (const auto &g : gradients) expectTable(g, cache().getBuffer(g));
+    }
+    EXPECT_EQ(gradients.size(), cache().stats().entries);
+}
+
+TEST_F(GradientCacheTest, size) {
+    cache().configureCacheSize(16);
+    auto before = cache().stats();
+    std::vector<VGradient> gradients;
+    for (int i = 0; i < 100; i++)
+        gradients.push_back(gradient({{0, VColor(uchar(i), 0, 0)}, {1, blue}}));
+    for (const auto &g : gradients) expectTable(g, cache().getBuffer(g));
+
+    auto after = cache().stats();
+    EXPECT_LE(after.entries, 16u);
+    EXPECT_EQ(100u, after.entries + after.evictions - before.evictions);
+
+    // the last one used is still there
+    cache().getBuffer(gradients.back());
+    EXPECT_EQ(after.hits + 1, cache().stats().hits);
+
+    cache().configureCacheSize(0);
+    EXPECT_EQ(0u, cache().stats().entries);
+    expectTable(gradients[0], cache().getBuffer(gradients[0]));
+    expectTable(gradients[0], cache().getBuffer(gradients[0]));
+    EXPECT_EQ(0u, cache().stats().entries);
+    EXPECT_EQ(after.hits + 1, cache().stats().hits);
+}
+
+TEST_F(GradientCacheTest, threads) {
+    std::vector<VGradient> gradients;
+    for (int i = 0; i < 20; i++)
+        gradients.push_back(gradient({{0, VColor(0, uchar(i), 0)}, {1, red}}, 0.5f));
+    auto before = cache().stats();
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&gradients, t] {
+            for (int i = 0; i < 500; i++) {
+                const VGradient &g = gradients[(i * 7 + t) % gradients.size()];
+                expectTable(g, cache().getBuffer(g));
+            }
+        });
+    }
+    for (auto &thread : threads) thread.join();
+
+    auto after = cache().stats();
+    EXPECT_EQ(2000u, after.hits + after.misses - before.hits - before.misses);
+    EXPECT_EQ(gradients.size(), after.entries);
+    EXPECT_EQ(before.evictions, after.evictions);
+}
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include "vrle.h"
+#include <random>
+#include <vector>
+
+/*
+ * Rle operations are checked pixel by pixel against the blending they
+ * stand for, on random rles shaped like rasterizer output: rows in order,
+ * spans in a row sorted and not overlapping, touching now and then.
+ */
+namespace {
+
+constexpr int WIDTH = 300;
+constexpr int HEIGHT = 40;
+
+using Coverage = std::vector<uchar>;
+
+uchar divBy255(int x)
+{
+    return (x + (x >> 8) + 0x80) >> 8;
+}
+
+VRle randomRle(std::mt19937 &random)
+{
+    VRle                    rle;
+    std::vector<VRle::Span> spans;
+    int top = random() % HEIGHT;
+    int bottom = top + random() % (HEIGHT - top);
+    for (int y = top; y <= bottom; y++) {
+        if (random() % 4 == 0) continue;
+        int x = random() % 20;
+        while (true) {
+            VRle::Span span;
+            span.x = short(x);
+            span.y = short(y);
+            span.len = ushort(1 + random() % 40);
+            span.coverage = uchar(random() % 3 ? 255 : 1 + random() % 255);
+            if (span.x + span.len > WIDTH) break;
+            spans.push_back(span);
+            x = span.x + span.len + (random() % 3 ? random() % 30 : 0);
+        }
+    }
+    if (!spans.empty()) rle.addSpan(spans.data(), spans.size());
+    return rle;
+}
+
+Coverage toCoverage(const VRle &rle)
+{
+    Coverage coverage(WIDTH * HEIGHT);
+    rle.intersect(VRect(0, 0, WIDTH, HEIGHT),
+                  [](size_t count, const VRle::Span *spans, void *data) {
+                      auto &pixels = *static_cast<Coverage *>(data);
+                      for (size_t i = 0; i < count; i++) {
+                          uchar *row = &pixels[spans[i].y * WIDTH + spans[i].x];
+                          for (int x = 0; x < spans[i].len; x++) {
+                              EXPECT_EQ(0, row[x]) << "overlapping spans";
+                              row[x] = spans[i].coverage;
+                          }
+                      }
+                  },
+                  &coverage);
+    return coverage;
+}
+
+void checkOrder(const VRle &rle)
+{
+    struct Last {
+        int y{-1};
+        int end{0};
+    } last;
+    rle.intersect(VRect(0, 0, WIDTH, HEIGHT),
+                  [](size_t count, const VRle::Span *spans, void *data) {
+                      auto &last = *static_cast<Last *>(data);
+                      for (size_t i = 0; i < count; i++) {
+                          if (spans[i].y == last.y)
+                              EXPECT_GE(spans[i].x, last.end);
+                          else
+                              EXPECT_GT(spans[i].y, last.y);
+                          last.y = spans[i].y;
+                          last.end = spans[i].x + spans[i].len;
+                      }
+                  },
+                  &last);
+}
+
+template <typename Blend>
+void check(const char *name, VRle result, const VRle &a, const VRle &b, Blend blend)
+{
+    Coverage ca = toCoverage(a), cb = toCoverage(b), actual = toCoverage(result);
+    for (int i = 0; i < WIDTH * HEIGHT; i++)
+        ASSERT_EQ(int(blend(ca[i], cb[i])), int(actual[i]))
+            << name << " at " << i % WIDTH << "," << i / WIDTH;
+    checkOrder(result);
+}
+
+}
+
+TEST(VRleTest, operations) {
+    std::mt19937 random(5);
+    for (int round = 0; round < 300; round++) {
+        VRle a = randomRle(random), b = randomRle(random);
+
+        check("add", a + b, a, b,
+              [](uchar a, uchar b) { return uchar(b + divBy255((255 - b) * a)); });
+        check("subtract", a - b, a, b,
+              [](uchar a, uchar b) { return divBy255((255 - b) * a); });
+        check("xor", a ^ b, a, b,
+              [](uchar a, uchar b) { return divBy255((255 - b) * a + b * (255 - a)); });
+        check("intersect", a & b, a, b, [](uchar a, uchar b) { return divBy255(a * b); });
+
+        VRle c = a;
+        c &= b;
+        check("intersect in place", c, a, b,
+              [](uchar a, uchar b) { return divBy255(a * b); });
+    }
+}
+
+TEST(VRleTest, sharedRows) {
+    // b has every row, so no row of a is copied over unchanged
+    std::mt19937 random(6);
+    for (int round = 0; round < 100; round++) {
+        VRle a = randomRle(random);
+        VRle b = VRle::toRle(VRect(0, 0, WIDTH, HEIGHT));
+        b *= uchar(random() % 256);
+        b = b ^ randomRle(random);
+
+        check("add", a + b, a, b,
+              [](uchar a, uchar b) { return uchar(b + divBy255((255 - b) * a)); });
+        check("subtract", a - b, a, b,
+              [](uchar a, uchar b) { return divBy255((255 - b) * a); });
+        check("xor", a ^ b, a, b,
+              [](uchar a, uchar b) { return divBy255((255 - b) * a + b * (255 - a)); });
+    }
+}
@@ -0,0 +1,964 @@
+#include "sticker-convert.h"
+#include "buildopt.h"
+#include "worker-pool.h"
+#include "pixel-convert.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <vector>
+
+#ifndef NoWebp
+#include <png.h>
+#include <zlib.h>
+#include <webp/decode.h>
+#endif
+
+#ifndef NoLottie
+#include "animation-encoder.h"
+#include <zlib.h>
+#include <rlottie.h>
+#include <unistd.h>
+#endif
+
+AnimationProfile getAnimationProfile(AnimationQuality quality)
+{
+    switch (quality) {
+    case AnimationQuality::Medium:
+        return {25, ANIMATED_WIDTH, ANIMATED_HEIGHT, 384 * 1024};
+    case AnimationQuality::Low:
+        return {15, 128, 128, 128 * 1024};
+    case AnimationQuality::High:
+        break;
+    }
+    return {50, ANIMATED_WIDTH, ANIMATED_HEIGHT, 0};
+}
+
+const char *getAnimationQualityName(AnimationQuality quality)
+{
+    switch (quality) {
+    case AnimationQuality::High:
+        return "high";
+    case AnimationQuality::Medium:
+        return "medium";
+    case AnimationQuality::Low:
+        return "low";
+    }
+    return "";
+}
+
+#ifndef NoWebp
+
+static void pngMemWrite(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+    GByteArray *png_mem = (GByteArray *) png_get_io_ptr(png_ptr);
+    g_byte_array_append(png_mem, data, length);
+}
+
+static void pngMemFlush(png_structp png_ptr)
+{
+}
+
+GByteArray *encodePng(const uint8_t *rgba, unsigned width, unsigned height, std::string &errorMessage)
+{
+    png_structp png_ptr  = NULL;
+    png_infop   info_ptr = NULL;
+
+    png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (png_ptr == NULL) {
+        errorMessage = "error encoding png (create_write_struct failed)";
+        return NULL;
+    }
+
+    info_ptr = png_create_info_struct(png_ptr);
+    if (info_ptr == NULL) {
+        png_destroy_write_struct(&png_ptr, NULL);
+        errorMessage = "error encoding png (create_info_struct failed)";
+        return NULL;
+    }
+
+    // Sticker-like images rarely compress below half of raw size at the fastest zlib level,
+    // so with this much reserved the array normally never has to grow
+    GByteArray *png_mem = g_byte_array_sized_new(width * height * 2 + 1024);
+    png_bytepp  rows    = g_new(png_bytep, height);
+
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        g_free(rows);
+        g_byte_array_free(png_mem, TRUE);
+        errorMessage = "error while writing png";
+        return NULL;
+    }
+
+    png_set_IHDR(png_ptr, info_ptr, width, height,
+                 8, PNG_COLOR_TYPE_RGBA, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    // Result only lives in imgstore, so trade size for speed: cheapest useful row filter
+    // instead of trying all five on every row, and fastest deflate level
+    png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+    png_set_compression_level(png_ptr, Z_BEST_SPEED);
+
+    for (unsigned i = 0; i < height; i++)
+        rows[i] = (png_bytep)(rgba + i * width * 4);
+
+    png_set_write_fn(png_ptr, png_mem, pngMemWrite, pngMemFlush);
+    png_set_rows(png_ptr, info_ptr, rows);
+    png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    g_free(rows);
+
+    return png_mem;
+}
+
+GByteArray *convertWebpToPng(const char *filename, const ConversionLimits &limits,
+                             std::string &errorMessage)
+{
+    const uint8_t *data = NULL;
+    size_t len;
+    GError *err = NULL;
+    g_file_get_contents(filename, (gchar **) &data, &len, &err);
+    if (err) {
+        errorMessage = std::string("cannot open file: ") + err->message;
+        g_error_free(err);
+        return NULL;
+    }
+
+    // downscale oversized sticker images displayed in chat, otherwise it would harm readabillity
+    WebPDecoderConfig config;
+    WebPInitDecoderConfig (&config);
+    if (WebPGetFeatures(data, len, &config.input) != VP8_STATUS_OK) {
+        errorMessage = "error reading webp bitstream";
+        g_free ((gchar *)data);
+        return NULL;
+    }
+    if ((limits.maxWidth && ((unsigned)config.input.width > limits.maxWidth)) ||
+        (limits.maxHeight && ((unsigned)config.input.height > limits.maxHeight)))
+    {
+        errorMessage = "image too large";
+        g_free ((gchar *)data);
+        return NULL;
+    }
+
+    config.options.use_scaling = 0;
+    config.options.scaled_width = config.input.width;
+    config.options.scaled_height = config.input.height;
+    if ((unsigned)config.options.scaled_width > STICKER_MAX_WIDTH ||
+        (unsigned)config.options.scaled_height > STICKER_MAX_HEIGHT)
+    {
+        const float max_scale_width = STICKER_MAX_WIDTH * 1.0f / config.options.scaled_width;
+        const float max_scale_height = STICKER_MAX_HEIGHT * 1.0f / config.options.scaled_height;
+        if (max_scale_width < max_scale_height) {
+        // => the width is most limiting
+        config.options.scaled_width = STICKER_MAX_WIDTH;
+        // Can't use ' *= ', because we need to do the multiplication in float
+        // (or double), and only THEN cast back to int.
+        config.options.scaled_height = (int) (config.options.scaled_height * max_scale_width);
+        } else {
+        // => the height is most limiting
+        config.options.scaled_height = STICKER_MAX_HEIGHT;
+        // Can't use ' *= ', because we need to do the multiplication in float
+        // (or double), and only THEN cast back to int.
+        config.options.scaled_width = (int) (config.options.scaled_width * max_scale_height);
+        }
+        config.options.use_scaling = 1;
+    }
+    config.output.colorspace = MODE_RGBA;
+    if (WebPDecode(data, len, &config) != VP8_STATUS_OK) {
+        errorMessage = "error decoding webp";
+        g_free ((gchar *)data);
+        return NULL;
+    }
+    g_free ((gchar *)data);
+    const uint8_t *decoded = config.output.u.RGBA.rgba;
+
+    GByteArray *png = encodePng(decoded, config.options.scaled_width, config.options.scaled_height,
+                                errorMessage);
+    WebPFreeDecBuffer (&config.output);
+    return png;
+}
+
+#else
+
+GByteArray *encodePng(const uint8_t *rgba, unsigned width, unsigned height, std::string &errorMessage)
+{
+    errorMessage = "Not supported";
+    return NULL;
+}
+
+GByteArray *convertWebpToPng(const char *filename, const ConversionLimits &limits,
+                             std::string &errorMessage)
+{
+    errorMessage = "Not supported";
+    return NULL;
+}
+
+#endif
+
+#ifndef NoLottie
+
+// Largest output deflate can produce from given input
+constexpr size_t DEFLATE_MAX_RATIO = 1032;
+// Trailer of a single-member gzip file: CRC32, then uncompressed size modulo 2^32
+constexpr size_t GZIP_TRAILER_SIZE = 8;
+
+// Output buffer is allocated once, using uncompressed size from gzip trailer, and inflated
+// straight into. zlib only checks the trailer at the end, so until then it's only trusted as far
+// as it's plausible, and the buffer can still grow, though never past maxOutputSize.
+bool gunzip(const uint8_t *compressedData, size_t compressedSize, size_t maxOutputSize,
+            std::string &output, std::string &errorMessage)
+{
+    z_stream strm;
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    strm.avail_in = 0;
+    strm.next_in = Z_NULL;
+    int unzipResult = inflateInit2(&strm, MAX_WBITS + 16);
+    if (unzipResult != Z_OK) {
+        // Unlikely error message not worth translating
+        errorMessage = "Failed to initialize unzip stream";
+        return false;
+    }
+
+    size_t outputSize = 0;
+    if (compressedSize >= GZIP_TRAILER_SIZE) {
+        const uint8_t *trailer = compressedData + compressedSize - 4;
+        outputSize = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((size_t)trailer[3] << 24);
+    }
+    outputSize = std::min(outputSize, compressedSize * DEFLATE_MAX_RATIO);
+    if (maxOutputSize)
+        outputSize = std::min(outputSize, maxOutputSize);
+    // One extra byte so that inflate can report the end of stream without running out of space,
+    // or, at the size limit, so that going over the limit is detected
+    output.resize(outputSize + 1);
+
+    bool tooLarge = false;
+    strm.next_in  = const_cast<uint8_t *>(compressedData);
+    strm.avail_in = compressedSize;
+    while (strm.avail_in) {
+        if (strm.total_out == output.size()) {
+            if (maxOutputSize && (output.size() > maxOutputSize)) {
+                tooLarge = true;
+                break;
+            }
+            size_t newSize = output.size() * 2;
+            if (maxOutputSize)
+                newSize = std::min(newSize, maxOutputSize + 1);
+            output.resize(newSize);
+        }
+        strm.next_out  = reinterpret_cast<uint8_t *>(&output[strm.total_out]);
+        strm.avail_out = output.size() - strm.total_out;
+        unzipResult = inflate(&strm, Z_NO_FLUSH);
+        if (unzipResult != Z_OK)
+            break;
+    }
+    output.resize(strm.total_out);
+    (void)inflateEnd(&strm);
+
+    if (tooLarge || (maxOutputSize && (output.size() > maxOutputSize))) {
+        // Unlikely error message not worth translating
+        errorMessage = "Animation data too large";
+        output.clear();
+        return false;
+    }
+    if (unzipResult != Z_STREAM_END) {
+        // Unlikely error message not worth translating
+        errorMessage = "Decompression error";
+        return false;
+    }
+    return true;
+}
+
+// Output is assembled in memory, so that it can be abandoned if it grows over the size limit.
+// Writes it into fd, which gets closed.
+static bool saveOutput(int fd, const std::vector<uint8_t> &data)
+{
+    FILE *f = fdopen(fd, "wb");
+    if (!f) {
+        close(fd);
+        return false;
+    }
+    bool success = (fwrite(data.data(), 1, data.size(), f) == data.size());
+    if (fclose(f) != 0)
+        success = false;
+    return success;
+}
+
+namespace {
+
+// Frame of the output animation
+struct OutputFrame {
+    size_t   frameNo; // in the animation
+    unsigned delay;   // hundredths of a second
+};
+
+// Frames are rendered in a ring of slots: output frame N goes to slot N % slotCount once frame
+// N - slotCount has been encoded. Each slot has its own Animation instance, because one instance
+// can only render one frame at a time, while the parsed model is shared between them. Slots keep
+// their last frame, so that only what changed since gets painted and converted.
+class FramePipeline {
+public:
+    FramePipeline(std::vector<std::unique_ptr<rlottie::Animation>> &&players,
+                  const std::vector<OutputFrame> &frames, unsigned width, unsigned height,
+                  const std::string &jobOwner);
+
+    // Marks frame as wanted in its slot and, if background is true, asks a worker thread to render it
+    static void schedule(const std::shared_ptr<FramePipeline> &pipeline, size_t index, bool background);
+    // Returns rendered frame as RGBA pixels, rendering it on calling thread if no worker has
+    // picked it up yet. Frame stays valid until the slot is scheduled again. Changed is set to the
+    // area where it differs from the previous frame of the same slot.
+    const uint8_t   *waitFrame(size_t index, FrameRect &changed);
+    // Drops frames not being rendered yet and waits for the rest
+    void             cancel();
+    size_t           slotCount() const { return m_slots.size(); }
+private:
+    enum class SlotState {
+        Idle,
+        Pending,
+        Rendering,
+        Ready
+    };
+
+    struct Slot {
+        std::unique_ptr<rlottie::Animation> player;
+        std::unique_ptr<uint32_t[]>         buffer; // as rendered
+        std::unique_ptr<uint32_t[]>         output; // RGBA
+        FrameRect                           changed = {0, 0, 0, 0};
+        size_t                              index = 0;
+        SlotState                           state = SlotState::Idle;
+    };
+
+    std::vector<Slot>       m_slots;
+    std::vector<size_t>     m_frameNumbers;
+    unsigned                m_width;
+    unsigned                m_height;
+    std::string             m_jobOwner;
+    std::mutex              m_mutex;
+    std::condition_variable m_frameReady;
+
+    Slot            &slotFor(size_t index) { return m_slots[index % m_slots.size()]; }
+    rlottie::Surface surfaceFor(Slot &slot) { return rlottie::Surface(slot.buffer.get(), m_width, m_height, m_width * 4); }
+    // Renders given frame unless it is being rendered already or has been superseded
+    void             tryRender(size_t index);
+    void             render(Slot &slot);
+};
+
+FramePipeline::FramePipeline(std::vector<std::unique_ptr<rlottie::Animation>> &&players,
+                             const std::vector<OutputFrame> &frames, unsigned width,
+                             unsigned height, const std::string &jobOwner)
+: m_slots(players.size()), m_width(width), m_height(height), m_jobOwner(jobOwner)
+{
+    for (size_t i = 0; i < players.size(); i++) {
+        m_slots[i].player = std::move(players[i]);
+        m_slots[i].player->setPartialRender(true);
+        m_slots[i].buffer.reset(new uint32_t[width * height]);
+        m_slots[i].output.reset(new uint32_t[width * height]);
+    }
+    for (const OutputFrame &frame: frames)
+        m_frameNumbers.push_back(frame.frameNo);
+}
+
+void FramePipeline::schedule(const std::shared_ptr<FramePipeline> &pipeline, size_t index, bool background)
+{
+    {
+        std::unique_lock<std::mutex> lock(pipeline->m_mutex);
+        Slot &slot = pipeline->slotFor(index);
+        slot.index = index;
+        slot.state = SlotState::Pending;
+    }
+
+    if (background) {
+        // Job may only get to run after the whole conversion is over, and mustn't keep slot
+        // buffers and players alive until then. Whoever waits for the frame renders it if the
+        // job hasn't, so it can also be cancelled along with the rest of owner's jobs.
+        WorkerPool::Job job;
+        job.owner = pipeline->m_jobOwner;
+        job.run   = [weakPipeline = std::weak_ptr<FramePipeline>(pipeline), index]() {
+            if (std::shared_ptr<FramePipeline> pipeline = weakPipeline.lock())
+                pipeline->tryRender(index);
+        };
+        // If the queue is full the frame will be rendered by whoever waits for it
+        WorkerPool::instance().submit(std::move(job), WorkerPool::Priority::Helper);
+    }
+}
+
+void FramePipeline::tryRender(size_t index)
+{
+    Slot &slot = slotFor(index);
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if ((slot.index != index) || (slot.state != SlotState::Pending))
+            return;
+        slot.state = SlotState::Rendering;
+    }
+
+    render(slot);
+}
+
+void FramePipeline::render(Slot &slot)
+{
+    rlottie::Surface surface = surfaceFor(slot);
+    slot.player->renderSync(m_frameNumbers[slot.index], surface);
+    size_t x, y, width, height;
+    slot.player->damageRect(x, y, width, height);
+    slot.changed = {unsigned(x), unsigned(y), unsigned(width), unsigned(height)};
+
+    for (size_t row = y; row < y + height; row++) {
+        uint32_t *pixels = &slot.output[row * m_width + x];
+        std::copy(&slot.buffer[row * m_width + x], &slot.buffer[row * m_width + x + width], pixels);
+        // None of the output formats is used with transparency, so it's composited onto white
+        argbToRgba(pixels, width, {0xff, 0xff, 0xff}, false);
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    slot.state = SlotState::Ready;
+    m_frameReady.notify_all();
+}
+
+const uint8_t *FramePipeline::waitFrame(size_t index, FrameRect &changed)
+{
+    Slot &slot = slotFor(index);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (slot.state == SlotState::Pending) {
+        slot.state = SlotState::Rendering;
+        lock.unlock();
+        render(slot);
+    } else
+        m_frameReady.wait(lock, [&slot]() { return slot.state == SlotState::Ready; });
+
+    changed = slot.changed;
+    return reinterpret_cast<const uint8_t *>(slot.output.get());
+}
+
+void FramePipeline::cancel()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (Slot &slot: m_slots)
+        if (slot.state == SlotState::Pending)
+            slot.state = SlotState::Idle;
+    m_frameReady.wait(lock, [this]() {
+        return std::none_of(m_slots.begin(), m_slots.end(),
+                            [](const Slot &slot) { return slot.state == SlotState::Rendering; });
+    });
+}
+
+// Delays are in hundredths of a second in every output format, and many GIF viewers slow down
+// anything below 2
+constexpr double   OUTPUT_MAX_FPS = 50;
+// Below this, frame rate isn't reduced any further to meet size limit; size is reduced instead
+constexpr unsigned BUDGET_MIN_FPS = 10;
+constexpr unsigned MAX_ATTEMPTS   = 3;
+
+// Picks frames so that playback follows animation's own speed at no more than maxFps
+std::vector<OutputFrame> planFrames(size_t totalFrames, double frameRate, double maxFps)
+{
+    std::vector<OutputFrame> frames;
+    if (totalFrames == 0)
+        return frames;
+    if (!std::isfinite(frameRate) || (frameRate <= 0))
+        frameRate = OUTPUT_MAX_FPS;
+
+    const double fps = std::min(frameRate, std::max(1.0, std::min(maxFps, OUTPUT_MAX_FPS)));
+    // Frame boundaries are rounded from exact times, so that rounding errors don't add up
+    const long   end = std::max(2L, std::lround(totalFrames * 100 / frameRate));
+
+    for (size_t i = 0; ; i++) {
+        long start = std::lround(i * 100 / fps);
+        if (start >= end)
+            break;
+        long   next    = std::min(end, std::lround((i + 1) * 100 / fps));
+        size_t frameNo = std::min<size_t>(totalFrames - 1, i * frameRate / fps + 1e-6);
+        if (!frames.empty() && ((frames.back().frameNo == frameNo) || (next - start < 2)))
+            frames.back().delay += next - start;
+        else
+            frames.push_back({frameNo, unsigned(next - start)});
+    }
+
+    return frames;
+}
+
+// Wall time budget and cancellation of a conversion
+class ConversionBudget {
+public:
+    ConversionBudget(const ConversionLimits &limits, const CancellationToken *cancellation)
+    : m_cancellation(cancellation), m_hasDeadline(limits.maxTimeMs != 0),
+      m_deadline(Clock::now() + std::chrono::milliseconds(limits.maxTimeMs)) {}
+
+    // Returns true, with errorMessage set, if conversion should be given up
+    bool exhausted(std::string &errorMessage) const
+    {
+        // Unlikely error messages not worth translating
+        if (m_cancellation && m_cancellation->isCancelled()) {
+            errorMessage = "Conversion cancelled";
+            return true;
+        }
+        if (m_hasDeadline && (Clock::now() > m_deadline)) {
+            errorMessage = "Conversion took too long";
+            return true;
+        }
+        return false;
+    }
+private:
+    using Clock = std::chrono::steady_clock;
+    const CancellationToken *m_cancellation;
+    bool                     m_hasDeadline;
+    Clock::time_point        m_deadline;
+};
+
+// Fits animation into given bounds, keeping aspect ratio
+void fitSize(size_t animationWidth, size_t animationHeight, double maxWidth, double maxHeight,
+             unsigned &width, unsigned &height)
+{
+    double scale = 1;
+    if (animationWidth && animationHeight)
+        scale = std::min(maxWidth / animationWidth, maxHeight / animationHeight);
+    else {
+        animationWidth  = maxWidth;
+        animationHeight = maxHeight;
+    }
+    width  = std::max(1L, std::lround(animationWidth * scale));
+    height = std::max(1L, std::lround(animationHeight * scale));
+}
+
+// Maps .tgs file and makes the key that animations made from it are cached by: hash of file
+// contents, because the same sticker arrives as a different file for each account, or again after
+// tdlib has cleaned up its files. Returns NULL on failure.
+GMappedFile *mapAnimation(const char *fileName, std::string &cacheKey, std::string &errorMessage)
+{
+    GError      *error = NULL;
+    GMappedFile *file = g_mapped_file_new(fileName, FALSE, &error);
+    if (error) {
+        errorMessage = error->message;
+        g_error_free(error);
+        return NULL;
+    }
+
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(g_mapped_file_get_contents(file));
+    gchar         *hash = g_compute_checksum_for_data(G_CHECKSUM_SHA1, data, g_mapped_file_get_length(file));
+    cacheKey = std::string("tgs:") + (hash ? hash : fileName);
+    g_free(hash);
+    return file;
+}
+
+// Parses mapped .tgs file, unless the parsed model is in cache already. File is decompressed in
+// one go and handed over to rlottie, which parses the JSON in place, so sticker data is never copied.
+std::unique_ptr<rlottie::Animation> loadAnimation(GMappedFile *file, const std::string &cacheKey,
+                                                  const ConversionLimits &limits,
+                                                  std::string &errorMessage)
+{
+    std::unique_ptr<rlottie::Animation> animation = rlottie::Animation::loadFromCache(cacheKey);
+    if (animation)
+        return animation;
+
+    std::string lottieData;
+    if (!gunzip(reinterpret_cast<const uint8_t *>(g_mapped_file_get_contents(file)),
+                g_mapped_file_get_length(file), limits.maxDataSize, lottieData, errorMessage))
+        return nullptr;
+
+    animation = rlottie::Animation::loadFromData(std::move(lottieData), cacheKey);
+    if (!animation)
+        // Unlikely error message not worth translating
+        errorMessage = "Could not render animation";
+    return animation;
+}
+
+// Checks parsed animation against limits. Its declared size only matters for aspect ratio, as
+// frames are rendered at output size, but nothing that big is a real sticker either.
+bool checkAnimation(const rlottie::Animation &animation, const ConversionLimits &limits,
+                    std::string &errorMessage)
+{
+    size_t width = 0, height = 0;
+    animation.size(width, height);
+    // Unlikely error messages not worth translating
+    if (limits.maxFrames && (animation.totalFrame() > limits.maxFrames)) {
+        errorMessage = "Too many frames in animation";
+        return false;
+    }
+    if ((limits.maxWidth && (width > limits.maxWidth)) || (limits.maxHeight && (height > limits.maxHeight))) {
+        errorMessage = "Animation too large";
+        return false;
+    }
+    return true;
+}
+
+enum class EncodeResult {
+    Done,
+    // maxBytes has been exceeded, projectedSize is the estimated size of the whole animation
+    TooBig,
+    // Out of time or cancelled, errorMessage is set
+    Stopped
+};
+
+// Only formats whose encoder reports size as it goes can be abandoned early for exceeding
+// maxBytes (unless 0); for others, the limit is checked once the output is complete.
+EncodeResult encodeFrames(std::vector<std::unique_ptr<rlottie::Animation>> &&players,
+                          const std::vector<OutputFrame> &frames, unsigned width, unsigned height,
+                          size_t maxBytes, const ConversionBudget &budget, AnimationEncoder &encoder,
+                          const std::string &jobOwner, size_t &projectedSize, std::string &errorMessage)
+{
+    bool background = (players.size() > 1);
+    auto pipeline = std::make_shared<FramePipeline>(std::move(players), frames, width, height, jobOwner);
+
+    for (size_t i = 0; (i < pipeline->slotCount()) && (i < frames.size()); i++)
+        // Encoder gets to frame 0 right away, no point in handing it over
+        FramePipeline::schedule(pipeline, i, background && (i != 0));
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        if (budget.exhausted(errorMessage)) {
+            pipeline->cancel();
+            return EncodeResult::Stopped;
+        }
+        FrameRect      changed;
+        const uint8_t *rgba = pipeline->waitFrame(i, changed);
+        // Only with one slot is the previous frame of the slot the one encoder got last
+        encoder.writeFrame(rgba, frames[i].delay, (pipeline->slotCount() == 1) ? &changed : nullptr);
+        if (maxBytes && (encoder.size() > maxBytes)) {
+            pipeline->cancel();
+            projectedSize = encoder.size() * frames.size() / (i + 1);
+            return EncodeResult::TooBig;
+        }
+        if (i + pipeline->slotCount() < frames.size())
+            FramePipeline::schedule(pipeline, i + pipeline->slotCount(), background);
+    }
+
+    return EncodeResult::Done;
+}
+
+// Conversions rendering at the same time split renderThreads between them. Helper jobs go ahead
+// of everything queued, so otherwise each conversion would put a whole pool's worth of them in
+// front of the conversions still waiting for a thread. A share of 1 means no helpers at all.
+class RenderShare {
+public:
+    explicit RenderShare(unsigned renderThreads)
+    : m_threads(std::max(1u, renderThreads / ++s_rendering)) {}
+    ~RenderShare() { s_rendering--; }
+    RenderShare(const RenderShare &) = delete;
+    RenderShare &operator=(const RenderShare &) = delete;
+
+    unsigned threads() const { return m_threads; }
+private:
+    static std::atomic<unsigned> s_rendering;
+    unsigned                     m_threads;
+};
+
+std::atomic<unsigned> RenderShare::s_rendering{0};
+
+bool renderAnimation(GMappedFile *file, const std::string &cacheKey, const AnimationProfile &profile,
+                     const ConversionLimits &limits, unsigned renderThreads,
+                     const ConversionBudget &budget, const std::string &jobOwner,
+                     std::vector<uint8_t> &output, std::string &errorMessage)
+{
+    std::unique_ptr<rlottie::Animation> animation = loadAnimation(file, cacheKey, limits, errorMessage);
+    if (!animation || !checkAnimation(*animation, limits, errorMessage))
+        return false;
+    const size_t totalFrames = animation->totalFrame();
+    const double frameRate   = animation->frameRate();
+    size_t       animationWidth = 0, animationHeight = 0;
+    animation->size(animationWidth, animationHeight);
+    double       maxFps = profile.maxFps;
+    unsigned     w, h;
+    fitSize(animationWidth, animationHeight, profile.maxWidth, profile.maxHeight, w, h);
+    RenderShare share(renderThreads);
+
+    for (unsigned attempt = 1; ; attempt++) {
+        std::vector<OutputFrame> frames = planFrames(totalFrames, frameRate, maxFps);
+        // One more slot than threads so that encoder has the next frame ready when done with current one
+        size_t slotCount = 1;
+        if (share.threads() > 1)
+            slotCount = std::max<size_t>(1, std::min<size_t>(frames.size(), share.threads() + 1));
+        // Each slot needs its own instance, all sharing the parsed model
+        std::vector<std::unique_ptr<rlottie::Animation>> players;
+        for (size_t i = 0; i < slotCount; i++)
+            players.push_back(animation->clone());
+
+        // Last attempt has to do whatever the size
+        size_t maxBytes = (attempt < MAX_ATTEMPTS) ? profile.maxBytes : 0;
+        size_t projectedSize = 0;
+        std::unique_ptr<AnimationEncoder> encoder = createAnimationEncoder(profile.format, w, h);
+        if (!encoder) {
+            // Unlikely error message not worth translating
+            errorMessage = "Animation format not supported";
+            return false;
+        }
+        EncodeResult result = encodeFrames(std::move(players), frames, w, h, maxBytes, budget,
+                                           *encoder, jobOwner, projectedSize, errorMessage);
+        if (result == EncodeResult::Stopped)
+            return false;
+        if (result == EncodeResult::Done) {
+            if (!encoder->finish(output, errorMessage))
+                return false;
+            if (!maxBytes || (output.size() <= maxBytes))
+                return true;
+            projectedSize = output.size();
+        }
+
+        // Size is roughly proportional to frame count and to area. Frame rate goes first, then size.
+        double reduction  = 1.1 * projectedSize / maxBytes;
+        double fps        = std::min({frameRate, maxFps, OUTPUT_MAX_FPS});
+        double fpsFactor  = std::max(1.0, std::min(reduction, fps / BUDGET_MIN_FPS));
+        maxFps            = fps / fpsFactor;
+        double sizeFactor = std::sqrt(reduction / fpsFactor);
+        if (sizeFactor > 1)
+            fitSize(animationWidth, animationHeight, std::max(16.0, w / sizeFactor),
+                    std::max(16.0, h / sizeFactor), w, h);
+    }
+}
+
+using AnimationOutput = std::shared_ptr<const std::vector<uint8_t>>;
+
+// Encoded animations by sticker and profile, shared by all accounts. While a conversion is in
+// progress, others asking for the same output wait for it instead of doing the same work again.
+class OutputCache {
+public:
+    enum class Lookup {
+        Found,
+        // Caller has to do the conversion and then call finish
+        Convert,
+        // Out of time or cancelled while waiting, errorMessage is set
+        Stopped
+    };
+
+    static OutputCache &instance()
+    {
+        static OutputCache cache;
+        return cache;
+    }
+
+    Lookup lookup(const std::string &key, const ConversionBudget &budget, AnimationOutput &output,
+                  std::string &errorMessage);
+    // Ends conversion that lookup has handed to the caller. Output is NULL if conversion failed,
+    // in which case one of those waiting for it gets to try instead.
+    void   finish(const std::string &key, AnimationOutput output);
+    void   configure(size_t maxBytes);
+    AnimationOutputCacheStats stats();
+private:
+    struct Entry {
+        std::string     key;
+        AnimationOutput output;
+    };
+    using EntryList = std::list<Entry>;
+
+    struct Conversion {
+        bool            done = false;
+        AnimationOutput output;
+    };
+
+    std::mutex                                               m_mutex;
+    std::condition_variable                                  m_finished;
+    EntryList                                                m_entries; // most recently used first
+    std::unordered_map<std::string, EntryList::iterator>     m_index;
+    std::unordered_map<std::string, std::shared_ptr<Conversion>> m_inProgress;
+    size_t                                                   m_maxBytes = 0;
+    AnimationOutputCacheStats                                m_stats = {0, 0, 0, 0, 0, 0};
+
+    void trim();
+};
+
+// How often waiting conversions check for cancellation
+constexpr unsigned OUTPUT_WAIT_POLL_MS = 100;
+
+OutputCache::Lookup OutputCache::lookup(const std::string &key, const ConversionBudget &budget,
+                                        AnimationOutput &output, std::string &errorMessage)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            m_entries.splice(m_entries.begin(), m_entries, it->second);
+            output = it->second->output;
+            m_stats.hits++;
+            return Lookup::Found;
+        }
+
+        auto inProgress = m_inProgress.find(key);
+        if (inProgress == m_inProgress.end()) {
+            m_inProgress.emplace(key, std::make_shared<Conversion>());
+            m_stats.misses++;
+            return Lookup::Convert;
+        }
+
+        // Conversion stays alive for as long as somebody waits for it, even once finished
+        std::shared_ptr<Conversion> conversion = inProgress->second;
+        while (!conversion->done) {
+            if (budget.exhausted(errorMessage))
+                return Lookup::Stopped;
+            m_finished.wait_for(lock, std::chrono::milliseconds(OUTPUT_WAIT_POLL_MS));
+        }
+        if (conversion->output) {
+            output = conversion->output;
+            m_stats.joined++;
+            return Lookup::Found;
+        }
+        // Failed, possibly because whoever was doing it got cancelled, so start over
+    }
+}
+
+void OutputCache::finish(const std::string &key, AnimationOutput output)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto inProgress = m_inProgress.find(key);
+    if (inProgress != m_inProgress.end()) {
+        inProgress->second->done   = true;
+        inProgress->second->output = output;
+        m_inProgress.erase(inProgress);
+    }
+    m_finished.notify_all();
+
+    if (output && (output->size() <= m_maxBytes) && (m_index.find(key) == m_index.end())) {
+        m_entries.push_front({key, output});
+        m_index.emplace(key, m_entries.begin());
+        m_stats.entries++;
+        m_stats.bytes += output->size();
+        trim();
+    }
+}
+
+// Drops least recently used animations until within memory limit
+void OutputCache::trim()
+{
+    while (m_stats.bytes > m_maxBytes) {
+        const Entry &entry = m_entries.back();
+        m_stats.entries--;
+        m_stats.bytes -= entry.output->size();
+        m_stats.evictions++;
+        m_index.erase(entry.key);
+        m_entries.pop_back();
+    }
+}
+
+void OutputCache::configure(size_t maxBytes)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_maxBytes = maxBytes;
+    trim();
+}
+
+AnimationOutputCacheStats OutputCache::stats()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+// Everything in the profile shapes the output
+std::string getOutputKey(const std::string &cacheKey, const AnimationProfile &profile)
+{
+    return cacheKey + '/' + std::to_string(profile.maxWidth) + 'x' + std::to_string(profile.maxHeight) +
+           '/' + std::to_string(profile.maxFps) + '/' + std::to_string(profile.maxBytes) +
+           '/' + std::to_string(static_cast<int>(profile.format));
+}
+
+}
+
+bool convertTgsToAnimation(const char *inputFileName, std::string &outputFileName,
+                           const AnimationProfile &profile, const ConversionLimits &limits,
+                           unsigned renderThreads, const CancellationToken *cancellation,
+                           std::string &errorMessage, const std::string &jobOwner)
+{
+    ConversionBudget budget(limits, cancellation);
+    if (budget.exhausted(errorMessage))
+        return false;
+    std::string  cacheKey;
+    GMappedFile *file = mapAnimation(inputFileName, cacheKey, errorMessage);
+    if (!file)
+        return false;
+
+    const std::string   outputKey = getOutputKey(cacheKey, profile);
+    AnimationOutput     output;
+    OutputCache::Lookup lookup = OutputCache::instance().lookup(outputKey, budget, output, errorMessage);
+    if (lookup == OutputCache::Lookup::Convert) {
+        std::vector<uint8_t> encoded;
+        if (renderAnimation(file, cacheKey, profile, limits, renderThreads, budget, jobOwner, encoded,
+                            errorMessage))
+            output = std::make_shared<const std::vector<uint8_t>>(std::move(encoded));
+        OutputCache::instance().finish(outputKey, output);
+    }
+    g_mapped_file_unref(file);
+    if (!output)
+        return false;
+
+    char *tempFileName = NULL;
+    int fd = g_file_open_tmp("tdlib_sticker_XXXXXX", &tempFileName, NULL);
+    if (fd < 0) {
+        // Unlikely error message not worth translating
+        errorMessage = "Could not create temporary file";
+        return false;
+    }
+    outputFileName = tempFileName;
+    g_free(tempFileName);
+
+    if (!saveOutput(fd, *output)) {
+        // Unlikely error message not worth translating
+        errorMessage = "Could not write temporary file";
+        remove(outputFileName.c_str());
+        outputFileName.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void configureAnimationCache(size_t maxEntries, size_t maxBytes)
+{
+    rlottie::configureModelCacheSize(maxEntries);
+    rlottie::configureModelCacheMemoryLimit(maxBytes);
+}
+
+AnimationCacheStats getAnimationCacheStats()
+{
+    rlottie::ModelCacheStats stats = rlottie::modelCacheStats();
+    return {stats.entries, stats.bytes, stats.hits, stats.misses, stats.evictions};
+}
+
+void configureAnimationOutputCache(size_t maxBytes)
+{
+    OutputCache::instance().configure(maxBytes);
+}
+
+AnimationOutputCacheStats getAnimationOutputCacheStats()
+{
+    return OutputCache::instance().stats();
+}
+
+#else
+
+bool gunzip(const uint8_t *compressedData, size_t compressedSize, size_t maxOutputSize,
+            std::string &output, std::string &errorMessage)
+{
+    errorMessage = "Not supported";
+    return false;
+}
+
+bool convertTgsToAnimation(const char *inputFileName, std::string &outputFileName,
+                           const AnimationProfile &profile, const ConversionLimits &limits,
+                           unsigned renderThreads, const CancellationToken *cancellation,
+                           std::string &errorMessage, const std::string &jobOwner)
+{
+    errorMessage = "Not supported";
+    return false;
+}
+
+void configureAnimationCache(size_t maxEntries, size_t maxBytes)
+{
+}
+
+AnimationCacheStats getAnimationCacheStats()
+{
+    return {0, 0, 0, 0, 0};
+}
+
+void configureAnimationOutputCache(size_t maxBytes)
+{
+}
+
+AnimationOutputCacheStats getAnimationOutputCacheStats()
+{
+    return {0, 0, 0, 0, 0, 0};
+}
+
+#endif
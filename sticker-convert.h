@@ -0,0 +1,111 @@
+#ifndef _STICKER_CONVERT_H
+#define _STICKER_CONVERT_H
+
+// Sticker and image conversion routines. Nothing here touches libpurple or tdlib, so all of it can
+// be called from worker threads.
+
+#include "animation-encoder.h"
+#include <glib.h>
+#include <string>
+#include <stdint.h>
+
+// Static stickers bigger than this are downscaled, otherwise they would harm readability
+constexpr unsigned STICKER_MAX_WIDTH  = 256;
+constexpr unsigned STICKER_MAX_HEIGHT = 256;
+
+// Animated stickers are rendered at most at this size
+constexpr unsigned ANIMATED_WIDTH  = 200;
+constexpr unsigned ANIMATED_HEIGHT = 200;
+
+// Limits for animated sticker conversion. Frames are picked to follow sticker's own frame rate,
+// as far as maxFps and delay granularity (1/100 s) allow. If the result doesn't fit in maxBytes,
+// conversion is repeated with lower frame rate, and then smaller size.
+struct AnimationProfile {
+    unsigned        maxFps;
+    unsigned        maxWidth;
+    unsigned        maxHeight;
+    size_t          maxBytes;  // 0 for no limit
+    AnimationFormat format = AnimationFormat::Gif;
+};
+
+enum class AnimationQuality {
+    High,
+    Medium,
+    Low
+};
+
+AnimationProfile getAnimationProfile(AnimationQuality quality);
+const char      *getAnimationQualityName(AnimationQuality quality);
+
+// Bounds on what a single conversion may cost, so that a broken or hostile sticker can't exhaust
+// memory or keep a worker thread busy indefinitely. Sizes are as declared by the sticker file and
+// are checked before anything gets decoded at that size. 0 means no limit.
+struct ConversionLimits {
+    size_t   maxDataSize = 16 * 1024 * 1024; // uncompressed animation data
+    unsigned maxFrames   = 1800;             // frames in the animation, e.g. 30 s at 60 fps
+    unsigned maxWidth    = 4096;
+    unsigned maxHeight   = 4096;
+    unsigned maxTimeMs   = 30000;            // wall time, checked between frames
+};
+
+class CancellationToken;
+
+// Encodes RGBA bitmap as PNG. Compression is tuned for speed rather than size since the result is
+// only kept in imgstore for display. Returns NULL on failure, otherwise the caller owns the array.
+GByteArray *encodePng(const uint8_t *rgba, unsigned width, unsigned height, std::string &errorMessage);
+
+// Decodes webp file, downscaling it if necessary, and re-encodes it as PNG.
+// Returns NULL on failure, otherwise the caller owns the array.
+GByteArray *convertWebpToPng(const char *filename, const ConversionLimits &limits,
+                             std::string &errorMessage);
+
+// Decompresses .tgs file contents, failing if output would exceed maxOutputSize (unless 0).
+// Only exposed on its own for benchmarking.
+bool gunzip(const uint8_t *compressedData, size_t compressedSize, size_t maxOutputSize,
+            std::string &output, std::string &errorMessage);
+
+// Renders .tgs animated sticker into animation in profile's format, written to a new temporary
+// file whose name is returned in outputFileName. With renderThreads > 1, upcoming frames are
+// rendered on WorkerPool threads while earlier ones are being encoded; output is the same either way.
+// Conversions running at the same time split renderThreads between them.
+// Those helper jobs are submitted as jobOwner's, so that cancelling the owner's jobs drops them too.
+// Conversion is abandoned if cancellation (unless NULL) is signalled.
+bool convertTgsToAnimation(const char *inputFileName, std::string &outputFileName,
+                           const AnimationProfile &profile, const ConversionLimits &limits,
+                           unsigned renderThreads, const CancellationToken *cancellation,
+                           std::string &errorMessage, const std::string &jobOwner = std::string());
+
+// Parsed animations are kept in a process-wide cache, so that a sticker that keeps coming up is
+// only parsed once. Memory use of an animation is estimated as the size of its uncompressed data.
+struct AnimationCacheStats {
+    size_t   entries;
+    size_t   bytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+};
+
+constexpr size_t ANIMATION_CACHE_MAX_ENTRIES = 256;
+
+// maxBytes of 0 means no memory limit, maxEntries of 0 disables the cache
+void                configureAnimationCache(size_t maxEntries, size_t maxBytes);
+AnimationCacheStats getAnimationCacheStats();
+
+// Converted animations are kept in a process-wide cache as well, by sticker file contents and
+// AnimationProfile, so that a sticker showing up again, in any account, isn't rendered and encoded
+// again at the same profile. Conversions of the same sticker at the same profile that overlap wait
+// for the first one to finish and share its result; those are counted as joined.
+struct AnimationOutputCacheStats {
+    size_t   entries;
+    size_t   bytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t joined;
+    uint64_t evictions;
+};
+
+// maxBytes of 0 disables the cache, which is the default; overlapping conversions are still shared
+void                      configureAnimationOutputCache(size_t maxBytes);
+AnimationOutputCacheStats getAnimationOutputCacheStats();
+
+#endif
@@ -2,36 +2,59 @@
 #define _STICKER_H
 
 #include "client-utils.h"
+#include "sticker-convert.h"
 
-void showWebpSticker(const td::td_api::chat &chat, const TgMessageInfo &message,
-                     const std::string &filePath, const std::string &fileDescription,
-                     TdAccountData &account);
-
+// Converts a sticker into something libpurple can display: .tgs are rendered into GIF, WebP or APNG
+// animation (written to a temporary file), everything else is decoded as webp and re-encoded into
+// PNG in memory.
 class StickerConversionThread: public AccountThread {
 private:
     std::string   m_errorMessage;
     std::string   m_outputFileName;
+    GByteArray   *m_imageData = nullptr;
+    // Read from account settings on main thread, as those can't be accessed from run()
+    AnimationProfile m_profile;
+    ConversionLimits m_limits;
+    // Static thumbnail of animated sticker, shown instead if conversion fails
+    int32_t          m_thumbnailId = 0;
+    std::string      m_thumbnailPath;
     void run() override;
+    void reject(const char *reason) override;
 
     static Callback g_callback;
     void callback(PurpleTdClient *tdClient) override;
+    static AnimationProfile getProfile(PurpleAccount *purpleAccount);
     TgMessageInfo m_message;
 public:
     const std::string inputFileName;
+    const std::string fileDescription;
     const ChatId chatId;
     StickerConversionThread(PurpleAccount *purpleAccount, const std::string &filename,
-                            ChatId chatId, TgMessageInfo &&message)
-    : AccountThread(purpleAccount), m_message(std::move(message)), inputFileName(filename),
+                            const std::string &fileDescription, ChatId chatId,
+                            TgMessageInfo &&message)
+    : AccountThread(purpleAccount), m_profile(getProfile(purpleAccount)),
+        m_message(std::move(message)), inputFileName(filename), fileDescription(fileDescription),
         chatId(chatId) {}
     StickerConversionThread(PurpleAccount *purpleAccount, const std::string &filename,
-                            ChatId chatId, const TgMessageInfo *message)
-    : AccountThread(purpleAccount), inputFileName(filename), chatId(chatId)
+                            const std::string &fileDescription, ChatId chatId,
+                            const TgMessageInfo *message)
+    : AccountThread(purpleAccount), m_profile(getProfile(purpleAccount)), inputFileName(filename),
+        fileDescription(fileDescription), chatId(chatId)
     {
         if (message)
             m_message.assign(*message);
     }
+    ~StickerConversionThread();
 
+    bool isAnimated() const;
+    void setThumbnail(const td::td_api::file *thumbnail);
+    // File id is 0 if there is no thumbnail, path is empty unless it has been downloaded
+    int32_t getThumbnailId() const { return m_thumbnailId; }
+    const std::string &getThumbnailPath() const { return m_thumbnailPath; }
     const std::string &getOutputFileName() const { return m_outputFileName; }
+    // For static stickers, converted image is kept in memory rather than in output file.
+    // Ownership of the data is passed to the caller.
+    GByteArray *takeImageData() { GByteArray *data = m_imageData; m_imageData = nullptr; return data; }
     const std::string &getErrorMessage()   const { return m_errorMessage; }
     const TgMessageInfo &message()         const { return m_message; }
 
@@ -8,6 +8,7 @@
 #include "secret-chat.h"
 #include "sticker.h"
 #include "receiving.h"
+#include "worker-pool.h"
 #include <unistd.h>
 #include <stdlib.h>
 #include <algorithm>
@@ -18,17 +19,50 @@ enum {
     SUPERGROUP_MEMBER_LIMIT      = 200,
 };
 
+// Worker threads and the animation caches are shared by all accounts in the process. Each
+// connected account asks for its own size and the biggest request wins, so that one account
+// connecting or disconnecting doesn't leave the others with less than they asked for.
+static std::vector<PurpleAccount *> g_connectedAccounts;
+
+static void configureSharedResources()
+{
+    if (g_connectedAccounts.empty())
+        return;
+
+    unsigned threadCount = 0;
+    unsigned cacheSize   = 0;
+    for (PurpleAccount *account: g_connectedAccounts) {
+        unsigned count = getWorkerThreadCount(account);
+        threadCount = std::max(threadCount, count ? count : WorkerPool::getDefaultThreadCount());
+        cacheSize   = std::max(cacheSize, getStickerCacheSize(account));
+    }
+    if (!AccountThread::isSingleThread())
+        AccountThread::setThreadCount(threadCount);
+
+    configureAnimationCache(cacheSize ? ANIMATION_CACHE_MAX_ENTRIES : 0, cacheSize * 1024 * 1024);
+    // Converted animations are a small fraction of the size of parsed ones, so a quarter on top
+    // of that is plenty for them
+    configureAnimationOutputCache(cacheSize * 1024 * 1024 / 4);
+}
+
 PurpleTdClient::PurpleTdClient(PurpleAccount *acct, ITransceiverBackend *testBackend)
 :   m_transceiver(this, acct, &PurpleTdClient::processUpdate, testBackend),
     m_data(acct, m_transceiver)
 {
-    StickerConversionThread::setCallback(&PurpleTdClient::onAnimatedStickerConverted);
+    StickerConversionThread::setCallback(&PurpleTdClient::onStickerConverted);
     m_account = acct;
+    g_connectedAccounts.push_back(acct);
+    configureSharedResources();
     setPurpleConnectionInProgress();
 }
 
 PurpleTdClient::~PurpleTdClient()
 {
+    AccountThread::cancelJobs(m_account);
+    g_connectedAccounts.erase(std::remove(g_connectedAccounts.begin(), g_connectedAccounts.end(), m_account),
+                              g_connectedAccounts.end());
+    configureSharedResources();
+
     std::vector<PurpleXfer *> transfers;
     m_data.removeAllFileTransfers(transfers);
     for (PurpleXfer *xfer: transfers) {
@@ -875,7 +909,7 @@ void PurpleTdClient::onChatListReady()
     purple_blist_add_account(m_account);
 }
 
-void PurpleTdClient::onAnimatedStickerConverted(AccountThread *arg)
+void PurpleTdClient::onStickerConverted(AccountThread *arg)
 {
     std::unique_ptr<AccountThread> baseThread(arg);
     StickerConversionThread *thread = dynamic_cast<StickerConversionThread *>(arg);
@@ -884,30 +918,50 @@ void PurpleTdClient::onAnimatedStickerConverted(AccountThread *arg)
         return;
     IncomingMessage *pendingMessage = m_data.pendingMessages.findPendingMessage(getId(*chat), thread->message().id);
 
+    if (thread->isAnimated()) {
+        AnimationCacheStats stats = getAnimationCacheStats();
+        purple_debug_misc(config::pluginId, "Animated sticker cache: %" G_GUINT64_FORMAT " hits, %"
+                          G_GUINT64_FORMAT " misses, %" G_GUINT64_FORMAT " evictions, %zu entries, %zu KB\n",
+                          stats.hits, stats.misses, stats.evictions, stats.entries, stats.bytes / 1024);
+        AnimationOutputCacheStats outputStats = getAnimationOutputCacheStats();
+        purple_debug_misc(config::pluginId, "Converted sticker cache: %" G_GUINT64_FORMAT " hits, %"
+                          G_GUINT64_FORMAT " misses, %" G_GUINT64_FORMAT " joined, %" G_GUINT64_FORMAT
+                          " evictions, %zu entries, %zu KB\n",
+                          outputStats.hits, outputStats.misses, outputStats.joined, outputStats.evictions,
+                          outputStats.entries, outputStats.bytes / 1024);
+    }
+
     std::string  errorMessage = thread->getErrorMessage();
     gchar       *imageData    =  NULL;
     gsize        imageSize    = 0;
     bool         success      = false;
     if (errorMessage.empty()) {
-        GError *error = NULL;
-
-        g_file_get_contents(thread->getOutputFileName().c_str(), &imageData, &imageSize, &error);
-        if (error) {
-            // unlikely error message not worth translating
-            errorMessage = formatMessage("Could not read converted file {}: {}", {
-                                            thread->getOutputFileName(), error->message});
-            g_error_free(error);
-        } else
+        GByteArray *convertedImage = thread->takeImageData();
+        if (convertedImage) {
+            imageSize = convertedImage->len;
+            imageData = reinterpret_cast<gchar *>(g_byte_array_free(convertedImage, FALSE));
             success = true;
-        remove(thread->getOutputFileName().c_str());
+        } else {
+            GError *error = NULL;
+
+            g_file_get_contents(thread->getOutputFileName().c_str(), &imageData, &imageSize, &error);
+            if (error) {
+                // unlikely error message not worth translating
+                errorMessage = formatMessage("Could not read converted file {}: {}", {
+                                                thread->getOutputFileName(), error->message});
+                g_error_free(error);
+            } else
+                success = true;
+            remove(thread->getOutputFileName().c_str());
+        }
     }
 
     if (success) {
         int id = purple_imgstore_add_with_id (imageData, imageSize, NULL);
         if (pendingMessage) {
-            pendingMessage->animatedStickerConverted = true;
-            pendingMessage->animatedStickerConvertSuccess = true;
-            pendingMessage->animatedStickerImageId = id;
+            pendingMessage->stickerConverted = true;
+            pendingMessage->stickerConvertSuccess = true;
+            pendingMessage->stickerImageId = id;
             checkMessageReady(pendingMessage, m_transceiver, m_data);
             pendingMessage = nullptr;
         } else {
@@ -915,17 +969,34 @@ void PurpleTdClient::onAnimatedStickerConverted(AccountThread *arg)
             showMessageText(m_data, *chat, thread->message(), text.c_str(), NULL, PURPLE_MESSAGE_IMAGES);
         }
     } else {
+        bool wasPending = (pendingMessage != nullptr);
         if (pendingMessage) {
-            pendingMessage->animatedStickerConverted = true;
-            pendingMessage->animatedStickerConvertSuccess = false;
+            pendingMessage->stickerConverted = true;
+            pendingMessage->stickerConvertSuccess = false;
             checkMessageReady(pendingMessage, m_transceiver, m_data);
             pendingMessage = nullptr;
         }
-        // TRANSLATOR: In-chat error message, arguments will be a file name and a proper reason
-        errorMessage = formatMessage(_("Could not read sticker file {0}: {1}"),
-                                        {thread->inputFileName, errorMessage});
-        errorMessage = makeNoticeWithSender(*chat, thread->message(), errorMessage.c_str(), m_account);
-        showMessageText(m_data, *chat, thread->message(), NULL, errorMessage.c_str());
+        if (thread->isAnimated() && thread->getThumbnailId()) {
+            purple_debug_misc(config::pluginId, "Could not convert sticker %s, showing thumbnail: %s\n",
+                              thread->inputFileName.c_str(), errorMessage.c_str());
+            TgMessageInfo message;
+            message.assign(thread->message());
+            showStickerThumbnail(*chat, message, thread->getThumbnailId(), thread->getThumbnailPath(),
+                                 thread->fileDescription, m_transceiver, m_data);
+        } else if (thread->isAnimated()) {
+            // TRANSLATOR: In-chat error message, arguments will be a file name and a proper reason
+            errorMessage = formatMessage(_("Could not read sticker file {0}: {1}"),
+                                            {thread->inputFileName, errorMessage});
+            errorMessage = makeNoticeWithSender(*chat, thread->message(), errorMessage.c_str(), m_account);
+            showMessageText(m_data, *chat, thread->message(), NULL, errorMessage.c_str());
+        } else {
+            purple_debug_misc(config::pluginId, "Could not decode sticker %s: %s\n",
+                              thread->inputFileName.c_str(), errorMessage.c_str());
+            // Pending message will show the link by itself
+            if (!wasPending)
+                showGenericFileInline(*chat, thread->message(), thread->inputFileName, NULL,
+                                      thread->fileDescription, m_data);
+        }
     }
 }
 
@@ -4,6 +4,7 @@
 #include "purple-info.h"
 #include "format.h"
 #include "buildopt.h"
+#include "animation-encoder.h"
 #include <purple.h>
 
 #include <cstdint>
@@ -1018,6 +1019,35 @@ static void tgprpl_init (PurplePlugin *plugin)
     opt = purple_account_option_bool_new(_("Show animated stickers"), AccountOptions::AnimatedStickers,
                                          AccountOptions::AnimatedStickersDefault);
     prpl_info.protocol_options = g_list_append(prpl_info.protocol_options, opt);
+
+    static_assert(AccountOptions::StickerQualityDefault == AccountOptions::StickerQualityHigh,
+                  "default choice must be first");
+    choices = NULL;
+    // TRANSLATOR: Account settings, value for animated sticker quality (full frame rate and size)
+    addChoice(choices, _("High"), AccountOptions::StickerQualityHigh);
+    // TRANSLATOR: Account settings, value for animated sticker quality
+    addChoice(choices, _("Medium"), AccountOptions::StickerQualityMedium);
+    // TRANSLATOR: Account settings, value for animated sticker quality (less CPU and memory)
+    addChoice(choices, _("Low"), AccountOptions::StickerQualityLow);
+    // TRANSLATOR: Account settings, key (choice)
+    opt = purple_account_option_list_new(_("Animated sticker quality"), AccountOptions::StickerQuality,
+                                         choices);
+    prpl_info.protocol_options = g_list_append(prpl_info.protocol_options, opt);
+
+    static_assert(AccountOptions::StickerFormatDefault == AccountOptions::StickerFormatGif,
+                  "default choice must be first");
+    choices = NULL;
+    // TRANSLATOR: Account settings, value for animated sticker format (image file format name)
+    addChoice(choices, _("GIF"), AccountOptions::StickerFormatGif);
+    if (isAnimationFormatSupported(AnimationFormat::Webp))
+        // TRANSLATOR: Account settings, value for animated sticker format (image file format name)
+        addChoice(choices, _("WebP"), AccountOptions::StickerFormatWebp);
+    // TRANSLATOR: Account settings, value for animated sticker format (image file format name)
+    addChoice(choices, _("APNG"), AccountOptions::StickerFormatApng);
+    // TRANSLATOR: Account settings, key (choice)
+    opt = purple_account_option_list_new(_("Animated sticker format"), AccountOptions::StickerFormat,
+                                         choices);
+    prpl_info.protocol_options = g_list_append(prpl_info.protocol_options, opt);
 #endif
 
     // TRANSLATOR: Account settings, key (boolean)
@@ -1032,6 +1062,20 @@ static void tgprpl_init (PurplePlugin *plugin)
         prpl_info.protocol_options = g_list_append(prpl_info.protocol_options, opt);
     }
 
+    // TRANSLATOR: Account settings, key (number)
+    opt = purple_account_option_string_new (_("Sticker conversion threads (0 for automatic)"),
+                                            AccountOptions::WorkerThreads,
+                                            AccountOptions::WorkerThreadsDefault);
+    prpl_info.protocol_options = g_list_append (prpl_info.protocol_options, opt);
+
+#ifndef NoLottie
+    // TRANSLATOR: Account settings, key (number)
+    opt = purple_account_option_string_new (_("Animated sticker cache size (MB, 0 to disable)"),
+                                            AccountOptions::StickerCacheSize,
+                                            AccountOptions::StickerCacheSizeDefault);
+    prpl_info.protocol_options = g_list_append (prpl_info.protocol_options, opt);
+#endif
+
     opt = purple_account_option_string_new (_("API ID"),
                                             AccountOptions::ApiId, "");
     prpl_info.protocol_options = g_list_append (prpl_info.protocol_options, opt);
@@ -0,0 +1,252 @@
+#include "animation-encoder.h"
+#include "gif-decoder.h"
+#include "buildopt.h"
+#include <gtest/gtest.h>
+#include <zlib.h>
+#include <algorithm>
+#include <random>
+#include <string.h>
+
+namespace {
+
+constexpr unsigned WIDTH  = 60;
+constexpr unsigned HEIGHT = 40;
+
+using Frame = std::vector<uint8_t>; // RGBA
+
+struct DecodedFrame {
+    Frame    rgba;
+    unsigned delay;
+};
+
+uint32_t get32(const uint8_t *p)
+{
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+bool inflateAll(const std::vector<uint8_t> &input, size_t outputSize, std::vector<uint8_t> &output)
+{
+    output.resize(outputSize);
+    uLongf length = outputSize;
+    return (uncompress(output.data(), &length, input.data(), input.size()) == Z_OK) &&
+           (length == outputSize);
+}
+
+// Minimal APNG decoder for what ApngEncoder produces: 8-bit RGB, no interlace, "none" disposal
+// and "source" blending. Checks chunk CRCs and sequence numbers along the way.
+bool decodeApng(const std::vector<uint8_t> &png, unsigned &width, unsigned &height,
+                std::vector<DecodedFrame> &frames)
+{
+    static const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if ((png.size() < 8) || memcmp(png.data(), signature, 8)) return false;
+
+    std::vector<uint8_t> canvas, data;
+    unsigned frameCount = 0, left = 0, top = 0, w = 0, h = 0, delay = 0;
+    uint32_t nextSequenceNo = 0;
+    bool     haveControl = false;
+
+    auto finishFrame = [&]() -> bool {
+        if (!haveControl) return true;
+        haveControl = false;
+        const size_t rowSize = 1 + w * 3;
+        std::vector<uint8_t> raw;
+        if (!inflateAll(data, rowSize * h, raw)) return false;
+        data.clear();
+        for (unsigned y = 0; y < h; y++) {
+            uint8_t *row = &raw[y * rowSize];
+            if ((row[0] == 2) && (y > 0)) {
+                for (unsigned i = 1; i < rowSize; i++)
+                    row[i] += row[i - rowSize];
+            } else if (row[0] != 0)
+                return false;
+            for (unsigned x = 0; x < w; x++) {
+                uint8_t *pixel = &canvas[((top + y) * width + left + x) * 4];
+                memcpy(pixel, &row[1 + x * 3], 3);
+            }
+        }
+        frames.push_back({canvas, delay});
+        return true;
+    };
+
+    for (size_t pos = 8; pos + 12 <= png.size(); ) {
+        uint32_t length = get32(&png[pos]);
+        if (pos + 12 + length > png.size()) return false;
+        const uint8_t *type  = &png[pos + 4];
+        const uint8_t *chunk = &png[pos + 8];
+        if (crc32(0, type, length + 4) != get32(chunk + length)) return false;
+        pos += 12 + length;
+
+        if (!memcmp(type, "IHDR", 4)) {
+            width  = get32(chunk);
+            height = get32(chunk + 4);
+            if ((length != 13) || (chunk[8] != 8) || (chunk[9] != 2) || chunk[12]) return false;
+            canvas.assign(width * height * 4, 0);
+        } else if (!memcmp(type, "acTL", 4))
+            frameCount = get32(chunk);
+        else if (!memcmp(type, "fcTL", 4)) {
+            if (!finishFrame() || (length != 26) || (get32(chunk) != nextSequenceNo++)) return false;
+            w     = get32(chunk + 4);
+            h     = get32(chunk + 8);
+            left  = get32(chunk + 12);
+            top   = get32(chunk + 16);
+            // Encoder always uses hundredths of a second
+            if ((chunk[22] << 8 | chunk[23]) != 100) return false;
+            delay = chunk[20] << 8 | chunk[21];
+            if ((left + w > width) || (top + h > height) || chunk[24] || chunk[25]) return false;
+            haveControl = true;
+        } else if (!memcmp(type, "IDAT", 4))
+            data.insert(data.end(), chunk, chunk + length);
+        else if (!memcmp(type, "fdAT", 4)) {
+            if (get32(chunk) != nextSequenceNo++) return false;
+            data.insert(data.end(), chunk + 4, chunk + length);
+        } else if (!memcmp(type, "IEND", 4))
+            return finishFrame() && (pos == png.size()) && (frames.size() == frameCount);
+    }
+
+    return false;
+}
+
+std::vector<uint8_t> encode(AnimationFormat format, const std::vector<Frame> &frames,
+                            const std::vector<unsigned> &delays,
+                            const std::vector<FrameRect> *changed = nullptr)
+{
+    std::vector<uint8_t> output;
+    std::string          errorMessage;
+    std::unique_ptr<AnimationEncoder> encoder = createAnimationEncoder(format, WIDTH, HEIGHT);
+    EXPECT_TRUE(encoder);
+    if (encoder) {
+        for (size_t i = 0; i < frames.size(); i++)
+            encoder->writeFrame(frames[i].data(), delays[i], changed ? &(*changed)[i] : nullptr);
+        EXPECT_TRUE(encoder->finish(output, errorMessage)) << errorMessage;
+    }
+    return output;
+}
+
+// Square moving over noise, with a pause in the middle
+std::vector<Frame> makeFrames(std::vector<unsigned> &delays)
+{
+    std::mt19937 random(7);
+    Frame background(WIDTH * HEIGHT * 4);
+    for (size_t i = 0; i < background.size(); i++)
+        background[i] = (i % 4 == 3) ? 255 : random() % 256;
+
+    std::vector<Frame> frames;
+    for (unsigned n = 0; n < 12; n++) {
+        unsigned position = (n < 4) ? n * 5 : (n < 8) ? 15 : (n - 4) * 5;
+        Frame frame = background;
+        for (unsigned y = 10; y < 25; y++)
+            for (unsigned x = position; x < position + 15; x++) {
+                uint8_t *pixel = &frame[(y * WIDTH + x) * 4];
+                pixel[0] = 250;
+                pixel[1] = 20;
+                pixel[2] = 30;
+            }
+        frames.push_back(std::move(frame));
+        delays.push_back(2 + n % 3);
+    }
+    return frames;
+}
+
+}
+
+TEST(AnimationEncoder, ApngRoundTrip)
+{
+    std::vector<unsigned> delays;
+    std::vector<Frame>    frames = makeFrames(delays);
+    std::vector<uint8_t>  png = encode(AnimationFormat::Apng, frames, delays);
+
+    unsigned width = 0, height = 0;
+    std::vector<DecodedFrame> decoded;
+    ASSERT_TRUE(decodeApng(png, width, height, decoded));
+    EXPECT_EQ(WIDTH, width);
+    EXPECT_EQ(HEIGHT, height);
+
+    // Lossless, and identical frames are merged into one with their delays added up
+    size_t next = 0;
+    for (size_t i = 0; i < frames.size(); ) {
+        ASSERT_LT(next, decoded.size());
+        unsigned delay = 0;
+        size_t   j = i;
+        for (; (j < frames.size()) && (frames[j] == frames[i]); j++)
+            delay += delays[j];
+        EXPECT_EQ(delay, decoded[next].delay) << "frame " << i;
+        for (size_t pixel = 0; pixel < WIDTH * HEIGHT; pixel++)
+            ASSERT_TRUE(!memcmp(&frames[i][pixel * 4], &decoded[next].rgba[pixel * 4], 3))
+                << "frame " << i << " pixel " << pixel;
+        i = j;
+        next++;
+    }
+    EXPECT_EQ(next, decoded.size());
+    EXPECT_EQ(8u, decoded.size());
+}
+
+TEST(AnimationEncoder, Gif)
+{
+    std::vector<unsigned> delays;
+    std::vector<Frame>    frames = makeFrames(delays);
+    std::vector<uint8_t>  gif = encode(AnimationFormat::Gif, frames, delays);
+
+    std::vector<GifDecoder::Frame> decoded;
+    GifDecoder decoder(gif);
+    ASSERT_TRUE(decoder.decode(decoded));
+    EXPECT_EQ(WIDTH, decoder.width());
+    EXPECT_EQ(HEIGHT, decoder.height());
+    unsigned expectedDuration = 0, duration = 0;
+    for (unsigned delay: delays)
+        expectedDuration += delay;
+    for (const GifDecoder::Frame &frame: decoded)
+        duration += frame.delay;
+    EXPECT_EQ(expectedDuration, duration);
+}
+
+TEST(AnimationEncoder, ChangedRect)
+{
+    std::vector<unsigned> delays;
+    std::vector<Frame>    frames = makeFrames(delays);
+
+    // Where the square was and is, or nothing at all for a repeated frame; a little more
+    // than that for the rest
+    std::vector<FrameRect> exact, loose;
+    unsigned last = 0;
+    for (unsigned n = 0; n < frames.size(); n++) {
+        unsigned position = (n < 4) ? n * 5 : (n < 8) ? 15 : (n - 4) * 5;
+        if (n == 0) {
+            exact.push_back({0, 0, WIDTH, HEIGHT});
+            loose.push_back(exact.back());
+        } else {
+            unsigned left = std::min(last, position);
+            unsigned width = std::max(last, position) + 15 - left;
+            exact.push_back({left, 10, (position == last) ? 0 : width, 15});
+            loose.push_back({left / 2, 5, std::min(WIDTH, left + width + 5) - left / 2, 25});
+        }
+        last = position;
+    }
+
+    for (AnimationFormat format: {AnimationFormat::Gif, AnimationFormat::Apng}) {
+        std::vector<uint8_t> expected = encode(format, frames, delays);
+        EXPECT_EQ(expected, encode(format, frames, delays, &exact)) << getAnimationFormatName(format);
+        EXPECT_EQ(expected, encode(format, frames, delays, &loose)) << getAnimationFormatName(format);
+    }
+}
+
+TEST(AnimationEncoder, Formats)
+{
+    EXPECT_TRUE(isAnimationFormatSupported(AnimationFormat::Gif));
+    EXPECT_TRUE(isAnimationFormatSupported(AnimationFormat::Apng));
+#ifdef NoWebpAnimation
+    EXPECT_FALSE(isAnimationFormatSupported(AnimationFormat::Webp));
+    EXPECT_FALSE(createAnimationEncoder(AnimationFormat::Webp, WIDTH, HEIGHT));
+#else
+    std::vector<unsigned> delays;
+    std::vector<Frame>    frames = makeFrames(delays);
+    std::vector<uint8_t>  webp = encode(AnimationFormat::Webp, frames, delays);
+    ASSERT_GT(webp.size(), 12u);
+    EXPECT_TRUE(!memcmp(webp.data(), "RIFF", 4));
+    EXPECT_TRUE(!memcmp(webp.data() + 8, "WEBP", 4));
+#endif
+
+    // No frames
+    std::vector<uint8_t> output;
+    std::string          errorMessage;
+    EXPECT_FALSE(createAnimationEncoder(AnimationFormat::Apng, WIDTH, HEIGHT)->finish(output, errorMessage));
+}
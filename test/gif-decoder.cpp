@@ -0,0 +1,146 @@
+#include "gif-decoder.h"
+#include <string.h>
+
+bool GifDecoder::readPalette(unsigned size, std::vector<uint8_t> &palette)
+{
+    if (!have(size * 3)) return false;
+    palette.assign(m_data.begin() + m_pos, m_data.begin() + m_pos + size * 3);
+    m_pos += size * 3;
+    return true;
+}
+
+bool GifDecoder::readSubBlocks(std::vector<uint8_t> &data)
+{
+    while (true) {
+        if (!have(1)) return false;
+        unsigned length = get();
+        if (length == 0) return true;
+        if (!have(length)) return false;
+        data.insert(data.end(), m_data.begin() + m_pos, m_data.begin() + m_pos + length);
+        m_pos += length;
+    }
+}
+
+bool GifDecoder::lzwDecode(const std::vector<uint8_t> &data, unsigned minCodeSize, size_t expectedCount,
+                           std::vector<uint8_t> &indices)
+{
+    const unsigned clearCode = 1 << minCodeSize;
+    const unsigned endCode   = clearCode + 1;
+    std::vector<std::vector<uint8_t>> dict;
+    unsigned codeSize = minCodeSize + 1;
+    size_t   bitPos   = 0;
+    int      prev     = -1;
+
+    auto reset = [&]() {
+        dict.clear();
+        for (unsigned i = 0; i < clearCode + 2; i++)
+            dict.push_back(std::vector<uint8_t>(1, i));
+        codeSize = minCodeSize + 1;
+        prev = -1;
+    };
+    reset();
+
+    while (bitPos + codeSize <= data.size() * 8) {
+        unsigned code = 0;
+        for (unsigned i = 0; i < codeSize; i++, bitPos++)
+            code |= ((data[bitPos / 8] >> (bitPos % 8)) & 1) << i;
+
+        if (code == clearCode) {
+            reset();
+            continue;
+        }
+        if (code == endCode)
+            return indices.size() == expectedCount;
+
+        std::vector<uint8_t> entry;
+        if (code < dict.size()) {
+            entry = dict[code];
+            if (prev >= 0) {
+                dict.push_back(dict[prev]);
+                dict.back().push_back(entry[0]);
+            }
+        } else if ((code == dict.size()) && (prev >= 0)) {
+            entry = dict[prev];
+            entry.push_back(entry[0]);
+            dict.push_back(entry);
+        } else
+            return false;
+
+        indices.insert(indices.end(), entry.begin(), entry.end());
+        prev = code;
+        if ((dict.size() == (1u << codeSize)) && (codeSize < 12))
+            codeSize++;
+    }
+
+    return false;
+}
+
+bool GifDecoder::decode(std::vector<Frame> &frames)
+{
+    if (!have(13) || memcmp(m_data.data(), "GIF89a", 6)) return false;
+    m_pos = 6;
+    m_width  = get16();
+    m_height = get16();
+    uint8_t flags = get();
+    m_pos += 2;
+
+    std::vector<uint8_t> globalPalette;
+    if ((flags & 0x80) && !readPalette(2 << (flags & 7), globalPalette))
+        return false;
+
+    std::vector<uint8_t> canvas(m_width * m_height * 4, 0);
+    unsigned delay = 0;
+    int      transparentIndex = -1;
+
+    while (have(1)) {
+        uint8_t blockType = get();
+        if (blockType == 0x3b)
+            return !have(1);
+
+        if (blockType == 0x21) {
+            if (!have(1)) return false;
+            uint8_t label = get();
+            std::vector<uint8_t> data;
+            if (!readSubBlocks(data)) return false;
+            if (label == 0xf9) {
+                if (data.size() != 4) return false;
+                delay = data[1] | (data[2] << 8);
+                transparentIndex = (data[0] & 1) ? data[3] : -1;
+            }
+            continue;
+        }
+
+        if ((blockType != 0x2c) || !have(9)) return false;
+        unsigned left = get16(), top = get16(), w = get16(), h = get16();
+        uint8_t  imageFlags = get();
+        if ((left + w > m_width) || (top + h > m_height)) return false;
+
+        std::vector<uint8_t>  localPalette;
+        std::vector<uint8_t> *palette = &globalPalette;
+        if (imageFlags & 0x80) {
+            if (!readPalette(2 << (imageFlags & 7), localPalette)) return false;
+            palette = &localPalette;
+        }
+
+        if (!have(1)) return false;
+        unsigned minCodeSize = get();
+        std::vector<uint8_t> data, indices;
+        if (!readSubBlocks(data) || !lzwDecode(data, minCodeSize, w * h, indices))
+            return false;
+
+        for (unsigned y = 0; y < h; y++)
+            for (unsigned x = 0; x < w; x++) {
+                int index = indices[y * w + x];
+                if (index == transparentIndex) continue;
+                if (index * 3u + 2 >= palette->size()) return false;
+                uint8_t *pixel = &canvas[((top + y) * m_width + left + x) * 4];
+                pixel[0] = (*palette)[index * 3];
+                pixel[1] = (*palette)[index * 3 + 1];
+                pixel[2] = (*palette)[index * 3 + 2];
+            }
+
+        frames.push_back({canvas, delay});
+    }
+
+    return false;
+}
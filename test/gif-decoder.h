@@ -0,0 +1,36 @@
+#ifndef _GIF_DECODER_H
+#define _GIF_DECODER_H
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+// Minimal GIF decoder for checking encoder output. Composites all images onto the canvas, the
+// way viewers do for "leave in place" disposal, and returns canvas as shown after each image.
+class GifDecoder {
+public:
+    struct Frame {
+        std::vector<uint8_t> rgba; // whole canvas, alpha is always 0
+        unsigned             delay;
+    };
+
+    explicit GifDecoder(const std::vector<uint8_t> &data) : m_data(data) {}
+    bool decode(std::vector<Frame> &frames);
+    unsigned width() const { return m_width; }
+    unsigned height() const { return m_height; }
+private:
+    const std::vector<uint8_t> &m_data;
+    size_t                      m_pos = 0;
+    unsigned                    m_width = 0;
+    unsigned                    m_height = 0;
+
+    bool     have(size_t n) const { return m_pos + n <= m_data.size(); }
+    uint8_t  get() { return m_data[m_pos++]; }
+    uint32_t get16() { uint32_t v = m_data[m_pos] | (m_data[m_pos+1] << 8); m_pos += 2; return v; }
+    bool     readPalette(unsigned size, std::vector<uint8_t> &palette);
+    bool     readSubBlocks(std::vector<uint8_t> &data);
+    static bool lzwDecode(const std::vector<uint8_t> &data, unsigned minCodeSize, size_t expectedCount,
+                          std::vector<uint8_t> &indices);
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "gif.h"
+#include "gif-decoder.h"
+#include <gtest/gtest.h>
+#include <random>
+
+namespace {
+
+constexpr unsigned WIDTH  = 64;
+constexpr unsigned HEIGHT = 48;
+constexpr unsigned DELAY  = 2;
+
+using Frame = std::vector<uint8_t>; // RGBA
+
+// Canvas as shown for each unit of delay
+bool decode(const GifBuffer &gif, std::vector<Frame> &shownFrames, unsigned &imageCount)
+{
+    std::vector<GifDecoder::Frame> frames;
+    GifDecoder decoder(gif);
+    if (!decoder.decode(frames))
+        return false;
+    imageCount = frames.size();
+    for (const GifDecoder::Frame &frame: frames)
+        for (unsigned i = 0; i < frame.delay / DELAY; i++)
+            shownFrames.push_back(frame.rgba);
+    return true;
+}
+
+GifBuffer encode(const std::vector<Frame> &frames)
+{
+    GifWriter writer;
+    EXPECT_TRUE(GifBegin(&writer, -1, WIDTH, HEIGHT, DELAY));
+    for (const Frame &frame: frames)
+        EXPECT_TRUE(GifWriteFrame(&writer, frame.data(), WIDTH, HEIGHT, DELAY, false));
+    EXPECT_TRUE(GifEnd(&writer));
+    return std::move(writer.out);
+}
+
+void checkSameColors(const std::vector<Frame> &expected, const std::vector<Frame> &actual)
+{
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t frame = 0; frame < expected.size(); frame++)
+        for (size_t i = 0; i < expected[frame].size(); i += 4)
+            ASSERT_TRUE(!memcmp(&expected[frame][i], &actual[frame][i], 3))
+                << "frame " << frame << " pixel " << i / 4;
+}
+
+const uint8_t COLORS[][3] = {
+    {255, 255, 255}, {0, 0, 0}, {200, 30, 40}, {30, 200, 40}, {40, 30, 200}, {250, 220, 10},
+    {120, 120, 120}, {10, 200, 220}, {90, 60, 30}, {255, 128, 0}, {128, 0, 255}, {0, 128, 64},
+    {220, 180, 200}, {60, 60, 160}, {160, 200, 120}, {30, 30, 30}
+};
+
+void setPixel(Frame &frame, unsigned x, unsigned y, const uint8_t *color)
+{
+    uint8_t *pixel = &frame[(y * WIDTH + x) * 4];
+    pixel[0] = color[0];
+    pixel[1] = color[1];
+    pixel[2] = color[2];
+    pixel[3] = 255;
+}
+
+// Few flat colors, so that the palette represents them exactly
+std::vector<Frame> makeMovingBoxes(unsigned frameCount)
+{
+    std::vector<Frame> frames;
+    for (unsigned n = 0; n < frameCount; n++) {
+        Frame frame(WIDTH * HEIGHT * 4);
+        for (unsigned y = 0; y < HEIGHT; y++)
+            for (unsigned x = 0; x < WIDTH; x++) {
+                const uint8_t *color = COLORS[0];
+                if ((x >= n) && (x < n + 10) && (y >= 5) && (y < 20))
+                    color = COLORS[2];
+                else if ((y >= n / 2 + 20) && (y < n / 2 + 28) && (x >= 30) && (x < 40))
+                    color = COLORS[4];
+                else if ((x + y) % 16 == 0)
+                    color = COLORS[1];
+                setPixel(frame, x, y, color);
+            }
+        frames.push_back(std::move(frame));
+    }
+    return frames;
+}
+
+}
+
+TEST(GifWriter, MovingBoxesRoundTrip)
+{
+    std::vector<Frame> frames = makeMovingBoxes(20);
+    GifBuffer gif = encode(frames);
+
+    std::vector<Frame> decoded;
+    unsigned imageCount;
+    ASSERT_TRUE(decode(gif, decoded, imageCount));
+    checkSameColors(frames, decoded);
+    EXPECT_EQ(20u, imageCount);
+}
+
+TEST(GifWriter, IdenticalFramesMerged)
+{
+    std::vector<Frame> boxes = makeMovingBoxes(5);
+    std::vector<Frame> frames;
+    for (const Frame &frame: boxes)
+        for (int i = 0; i < 3; i++)
+            frames.push_back(frame);
+    GifBuffer gif = encode(frames);
+
+    std::vector<Frame> decoded;
+    unsigned imageCount;
+    ASSERT_TRUE(decode(gif, decoded, imageCount));
+    checkSameColors(frames, decoded);
+    EXPECT_EQ(5u, imageCount);
+}
+
+TEST(GifWriter, NoiseRoundTrip)
+{
+    // Poorly compressible: dictionary fills up and gets cleared many times within each frame
+    std::mt19937 random(7);
+    std::vector<Frame> frames;
+    for (unsigned n = 0; n < 4; n++) {
+        Frame frame(WIDTH * HEIGHT * 4);
+        for (unsigned y = 0; y < HEIGHT; y++)
+            for (unsigned x = 0; x < WIDTH; x++)
+                setPixel(frame, x, y, COLORS[random() % (sizeof(COLORS) / sizeof(COLORS[0]))]);
+        frames.push_back(std::move(frame));
+    }
+    GifBuffer gif = encode(frames);
+
+    std::vector<Frame> decoded;
+    unsigned imageCount;
+    ASSERT_TRUE(decode(gif, decoded, imageCount));
+    checkSameColors(frames, decoded);
+}
+
+TEST(GifWriter, NoFrames)
+{
+    GifBuffer gif = encode({});
+    std::vector<Frame> decoded;
+    unsigned imageCount;
+    ASSERT_TRUE(decode(gif, decoded, imageCount));
+    EXPECT_EQ(0u, imageCount);
+}
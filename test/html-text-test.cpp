@@ -0,0 +1,384 @@
+#include "html-text.h"
+#include <gtest/gtest.h>
+#include <glib.h>
+#include <random>
+#include <string>
+#include <string.h>
+#include <limits.h>
+
+namespace {
+
+// purple_markup_escape_text from libpurple's util.c, which is what incoming messages used to go
+// through. It is an old copy of g_markup_escape_text: apostrophes and control characters are left
+// alone. Only the output buffer has been changed to std::string.
+std::string referenceEscape(const std::string &text)
+{
+    const char  *p;
+    const char  *end;
+    std::string  str;
+
+    p   = text.c_str();
+    end = p + text.size();
+
+    while (p != end) {
+        const char *next;
+        next = g_utf8_next_char(p);
+
+        switch (*p) {
+        case '&':
+            str += "&amp;";
+            break;
+        case '<':
+            str += "&lt;";
+            break;
+        case '>':
+            str += "&gt;";
+            break;
+        case '"':
+            str += "&quot;";
+            break;
+        default:
+            str.append(p, next - p);
+            break;
+        }
+
+        p = next;
+    }
+
+    return str;
+}
+
+// Valid UTF-8 with markup characters, control characters and multibyte characters, in runs of
+// varying length
+std::string makeText(std::mt19937 &random, size_t length)
+{
+    static const char *pieces[] = {
+        "&", "<", ">", "\"", "'", "\n", "\t", "\r", "\x01", "\x0b", "\x1f", "\x7f",
+        "\xc2\x80", "\xc2\x85", "\xc2\x9f", "\xc2\xa0", "\xc2\xbf", "\xc3\xa9", "\xd0\x96",
+        "\xe2\x82\xac", "\xf0\x9f\x98\x80"
+    };
+    std::string text;
+    while (text.size() < length) {
+        if (random() % 3)
+            text.append(random() % 40, 'a' + random() % 26);
+        else
+            text += pieces[random() % (sizeof(pieces) / sizeof(pieces[0]))];
+    }
+    return text;
+}
+
+// The rest of this namespace is purple_markup_unescape_entity, purple_unescape_html and
+// purple_markup_strip_html from libpurple's util.c, to check isPlainHtml against what incoming
+// messages used to go through. Only the output buffer has been changed to std::string.
+const char *referenceUnescapeEntity(const char *text, int *length)
+{
+    const char *pln;
+    int         len;
+
+    if (!text || *text != '&')
+        return NULL;
+
+#define IS_ENTITY(s)  (!g_ascii_strncasecmp(text, s, (len = sizeof(s) - 1)))
+
+    if (IS_ENTITY("&amp;"))
+        pln = "&";
+    else if (IS_ENTITY("&lt;"))
+        pln = "<";
+    else if (IS_ENTITY("&gt;"))
+        pln = ">";
+    else if (IS_ENTITY("&nbsp;"))
+        pln = " ";
+    else if (IS_ENTITY("&copy;"))
+        pln = "\302\251";
+    else if (IS_ENTITY("&quot;"))
+        pln = "\"";
+    else if (IS_ENTITY("&reg;"))
+        pln = "\302\256";
+    else if (IS_ENTITY("&apos;"))
+        pln = "\'";
+    else if (text[1] == '#' && (g_ascii_isxdigit(text[2]) || text[2] == 'x')) {
+        static char  buf[7];
+        const char  *start = text + 2;
+        char        *end;
+        guint64      pound;
+        int          base = 10;
+        int          buflen;
+
+        if (*start == 'x') {
+            base = 16;
+            start++;
+        }
+
+        pound = g_ascii_strtoull(start, &end, base);
+        if (pound == 0 || pound > INT_MAX || *end != ';')
+            return NULL;
+
+        len = (end - text) + 1;
+
+        buflen = g_unichar_to_utf8((gunichar)pound, buf);
+        buf[buflen] = '\0';
+        pln = buf;
+    } else
+        return NULL;
+
+#undef IS_ENTITY
+
+    if (length)
+        *length = len;
+    return pln;
+}
+
+std::string referenceUnescapeHtml(const std::string &html)
+{
+    std::string ret;
+    const char *c = html.c_str();
+
+    while (*c) {
+        int         len;
+        const char *ent;
+
+        if ((ent = referenceUnescapeEntity(c, &len)) != NULL) {
+            ret += ent;
+            c += len;
+        } else if (!strncmp(c, "<br>", 4)) {
+            ret += '\n';
+            c += 4;
+        } else {
+            ret += *c;
+            c++;
+        }
+    }
+
+    return ret;
+}
+
+std::string referenceStripHtml(const std::string &str)
+{
+    int          i, j, k, entlen;
+    bool         visible = true;
+    bool         closing_td_p = false;
+    const char  *cdata_close_tag = NULL, *ent;
+    std::string  href;
+    bool         haveHref = false;
+    int          href_st = 0;
+    std::string  str2(str.c_str());
+
+    for (i = 0, j = 0; str2[i]; i++) {
+        if (str2[i] == '<') {
+            if (cdata_close_tag) {
+                // Note: Don't even assume any other tag is a tag in CDATA
+                if (g_ascii_strncasecmp(&str2[i], cdata_close_tag, strlen(cdata_close_tag)) == 0) {
+                    i += strlen(cdata_close_tag) - 1;
+                    cdata_close_tag = NULL;
+                }
+                continue;
+            } else if (g_ascii_strncasecmp(&str2[i], "<td", 3) == 0 && closing_td_p) {
+                str2[j++] = '\t';
+                visible = true;
+            } else if (g_ascii_strncasecmp(&str2[i], "</td>", 5) == 0) {
+                closing_td_p = true;
+                visible = false;
+            } else {
+                closing_td_p = false;
+                visible = true;
+            }
+
+            k = i + 1;
+
+            if (g_ascii_isspace(str2[k]))
+                visible = true;
+            else if (str2[k]) {
+                // Scan until we end the tag either implicitly (closed start tag) or explicitly,
+                // using a crude approximation of the HTML grammar
+                while (str2[k] && str2[k] != '<' && str2[k] != '>')
+                    k++;
+
+                // If we've got an <a> tag with an href, save the address to print later
+                if (g_ascii_strncasecmp(&str2[i], "<a", 2) == 0 && g_ascii_isspace(str2[i+2])) {
+                    int  st;
+                    int  end;
+                    char delim = ' ';
+                    // Find start of href
+                    for (st = i + 3; st < k; st++) {
+                        if (g_ascii_strncasecmp(&str2[st], "href=", 5) == 0) {
+                            st += 5;
+                            if (str2[st] == '"' || str2[st] == '\'') {
+                                delim = str2[st];
+                                st++;
+                            }
+                            break;
+                        }
+                    }
+                    // Find end of address
+                    for (end = st; end < k && str2[end] != delim; end++)
+                        ;
+
+                    // If there's an address, save it. If there was already one saved, kill it.
+                    if (st < k) {
+                        href = referenceUnescapeHtml(str2.substr(st, end - st));
+                        haveHref = true;
+                        href_st = j;
+                    }
+                }
+                // Replace </a> with an ascii representation of the address the link was pointing to
+                else if (haveHref && g_ascii_strncasecmp(&str2[i], "</a>", 4) == 0) {
+                    size_t hrlen = href.size();
+
+                    // Only insert the href if it's different from the CDATA
+                    if ((hrlen != (size_t)(j - href_st) ||
+                         strncmp(&str2[href_st], href.c_str(), hrlen)) &&
+                        (hrlen != (size_t)(j - href_st) + 7 || // 7 == strlen("http://")
+                         strncmp(&str2[href_st], href.c_str() + 7, hrlen - 7)))
+                    {
+                        str2[j++] = ' ';
+                        str2[j++] = '(';
+                        memmove(&str2[j], href.c_str(), hrlen);
+                        j += hrlen;
+                        str2[j++] = ')';
+                        haveHref = false;
+                    }
+                }
+                // Check for tags which should be mapped to newline (but ignore some of the tags
+                // at the beginning of the text)
+                else if ((j && (g_ascii_strncasecmp(&str2[i], "<p>", 3) == 0
+                              || g_ascii_strncasecmp(&str2[i], "<tr", 3) == 0
+                              || g_ascii_strncasecmp(&str2[i], "<hr", 3) == 0
+                              || g_ascii_strncasecmp(&str2[i], "<li", 3) == 0
+                              || g_ascii_strncasecmp(&str2[i], "<div", 4) == 0))
+                         || g_ascii_strncasecmp(&str2[i], "<br", 3) == 0
+                         || g_ascii_strncasecmp(&str2[i], "</table>", 8) == 0)
+                {
+                    str2[j++] = '\n';
+                }
+                // Check for tags which begin CDATA and need to be closed
+                else if (g_ascii_strncasecmp(&str2[i], "<script", 7) == 0)
+                    cdata_close_tag = "</script>";
+                else if (g_ascii_strncasecmp(&str2[i], "<style", 6) == 0)
+                    cdata_close_tag = "</style>";
+                // Update the index and continue checking after the tag
+                i = (str2[k] == '<' || str2[k] == '\0') ? k - 1 : k;
+                continue;
+            }
+        } else if (cdata_close_tag)
+            continue;
+        else if (!g_ascii_isspace(str2[i]))
+            visible = true;
+
+        if (str2[i] == '&' && (ent = referenceUnescapeEntity(&str2[i], &entlen)) != NULL) {
+            while (*ent)
+                str2[j++] = *ent++;
+            i += entlen - 1;
+            continue;
+        }
+
+        if (visible)
+            str2[j++] = g_ascii_isspace(str2[i]) ? ' ' : str2[i];
+    }
+
+    str2.resize(j);
+    return str2;
+}
+
+// Message text made of plain runs, markup, entities and their fragments, whitespace and other
+// characters below 0x20
+std::string makeMarkup(std::mt19937 &random, size_t length)
+{
+    static const char *pieces[] = {
+        "<", ">", "&", ";", "#", "x", "\"", "'", " ", "\n", "\t", "\r", "\x0b", "\x0c", "\x01",
+        "\x7f", "\xc2\xa0", "\xd0\x96", "\xf0\x9f\x98\x80", "amp;", "lt;", "#39;", "#x41;",
+        "&amp;", "&lt;", "&gt;", "&quot;", "&nbsp;", "&#65;", "&#x1f600;", "&bogus;",
+        "<br>", "<b>", "</b>", "</td>", "<td>", "<a href=\"http://x\">", "</a>", "<script>",
+        "</script>", "< ", "<p>", "br>"
+    };
+    std::string text;
+    while (text.size() < length) {
+        if (random() % 2)
+            text.append(random() % 20, 'a' + random() % 26);
+        else
+            text += pieces[random() % (sizeof(pieces) / sizeof(pieces[0]))];
+    }
+    return text;
+}
+
+}
+
+TEST(HtmlText, Escape)
+{
+    EXPECT_EQ("", escapeHtml("", 0));
+    std::string text = "1<2 & 3>2, \"quoted\" 'single'";
+    EXPECT_EQ("1&lt;2 &amp; 3&gt;2, &quot;quoted&quot; 'single'", escapeHtml(text.data(), text.size()));
+    // Control characters are left alone, like libpurple does
+    text = "line\nline\ttab\x01\x7f\xc2\x80\xc2\x85\xc2\x9f\xc2\xa0";
+    EXPECT_EQ(text, escapeHtml(text.data(), text.size()));
+    // Only part of it
+    EXPECT_EQ("&lt;b", escapeHtml("<b>", 2));
+
+    // Nothing but characters that grow the most
+    std::string quotes(1000, '"');
+    std::string expected;
+    for (size_t i = 0; i < quotes.size(); i++)
+        expected += "&quot;";
+    EXPECT_EQ(expected, escapeHtml(quotes.data(), quotes.size()));
+}
+
+TEST(HtmlText, EscapeMatchesReference)
+{
+    std::mt19937 random(12345);
+    for (unsigned i = 0; i < 2000; i++) {
+        std::string text = makeText(random, random() % 300);
+        ASSERT_EQ(referenceEscape(text), escapeHtml(text.data(), text.size())) << text;
+    }
+
+    // Long messages, with something to escape at every offset within a vector
+    std::string text = makeText(random, 4096);
+    EXPECT_EQ(referenceEscape(text), escapeHtml(text.data(), text.size()));
+    for (size_t offset = 0; offset < 40; offset++) {
+        std::string plain(64, 'x');
+        plain[offset] = '<';
+        ASSERT_EQ(referenceEscape(plain), escapeHtml(plain.data(), plain.size())) << offset;
+    }
+}
+
+TEST(HtmlText, EscapeAppends)
+{
+    std::string output = "prefix: ";
+    appendEscapedHtml(output, "a&b", 3);
+    EXPECT_EQ("prefix: a&amp;b", output);
+}
+
+TEST(HtmlText, Plain)
+{
+    EXPECT_TRUE(isPlainHtml("", 0));
+    std::string text = "Just some text, with \"quotes\" > and 'apostrophes' \xd0\x96\xf0\x9f\x98\x80";
+    EXPECT_TRUE(isPlainHtml(text.data(), text.size()));
+    // Only part of it
+    EXPECT_TRUE(isPlainHtml("a<b", 1));
+
+    for (const char *special: {"<", "&", "\n", "\t", "\r", "\x01"}) {
+        for (size_t offset = 0; offset < 40; offset++) {
+            std::string text(64, 'x');
+            text.replace(offset, 1, special);
+            ASSERT_FALSE(isPlainHtml(text.data(), text.size())) << int(special[0]) << " at " << offset;
+            EXPECT_TRUE(isPlainHtml(text.data(), offset));
+        }
+    }
+}
+
+TEST(HtmlText, PlainMatchesReferenceStrip)
+{
+    std::string text = "1&lt;2 <b>&quot;x&quot;</b>\ty<br>&amp;lt;";
+    EXPECT_EQ("1<2 \"x\" y\n&lt;", referenceStripHtml(text));
+    EXPECT_EQ("1<2 \"x\" y\n<", referenceUnescapeHtml(referenceStripHtml(text)));
+
+    // Whatever isPlainHtml lets through must come out of strip and unescape unchanged
+    std::mt19937 random(54321);
+    unsigned     plainCount = 0;
+    for (unsigned i = 0; i < 20000; i++) {
+        text = makeMarkup(random, random() % 100);
+        if (isPlainHtml(text.data(), text.size())) {
+            plainCount++;
+            ASSERT_EQ(text, referenceUnescapeHtml(referenceStripHtml(text))) << text;
+        }
+    }
+    EXPECT_GT(plainCount, 1000u);
+}
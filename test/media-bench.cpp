@@ -0,0 +1,758 @@
+// Benchmark for sticker conversion routines.
+// Usage: media-bench [-n iterations] [-j threads] [-k] [-s] [-J] file-or-directory...
+// Directories are scanned (non-recursively) for .webp and .tgs files.
+// Animated stickers are converted with each quality profile into each supported output format,
+// sequentially and, if more than one, with given number of render threads (by default, same as
+// the plugin would use), checking that the outputs are identical.
+// -s breaks conversions down into stages instead, each measured on its own:
+//   .tgs:  gunzip, parse, render, render-partial (into the same buffer, repainting only what
+//          changed), argb->rgba, palette, lzw (mapping to palette included), png
+//   .webp: webp-decode, png
+// -k benchmarks pixel conversion kernels and animation encoders on synthetic frames.
+// Peak memory use of the process so far is printed after each animated sticker, and so are the
+// counters of rlottie's pool of matte bitmaps.
+//
+// Each result is printed as one line of name=value pairs, or with -J as a JSON object, so that
+// runs before and after a change can be compared by a script. Times are in microseconds per
+// unit. Where heap allocations can be counted (glibc), allocs and alloc_bytes are included too:
+// calls to malloc, calloc and realloc per unit, from this program and all libraries alike.
+
+#include "sticker-convert.h"
+#include "worker-pool.h"
+#include "pixel-convert.h"
+#include "animation-encoder.h"
+#include "buildopt.h"
+#include "gif.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <utility>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#ifndef NoWebp
+#include <webp/decode.h>
+#endif
+#ifndef NoLottie
+#include <rlottie.h>
+#endif
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__)
+
+// Interposed allocation functions, forwarding to glibc's own. Frees aren't interesting.
+#define COUNT_ALLOCATIONS
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+}
+
+static std::atomic<uint64_t> g_allocations{0};
+static std::atomic<uint64_t> g_allocatedBytes{0};
+
+static void countAllocation(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+extern "C" void *malloc(size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) noexcept
+{
+    countAllocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size) noexcept
+{
+    countAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+#endif
+
+static bool g_json = false;
+
+// One line of results
+class Record {
+public:
+    explicit Record(const char *name) { add("name", name); }
+    Record &add(const char *field, const std::string &value);
+    Record &add(const char *field, double value, unsigned decimals = 0);
+    Record &addFlag(const char *field, bool value);
+    void    print() const;
+private:
+    struct Field {
+        std::string name;
+        std::string value;
+        bool        quoted;
+    };
+    std::vector<Field> m_fields;
+};
+
+Record &Record::add(const char *field, const std::string &value)
+{
+    m_fields.push_back({field, value, true});
+    return *this;
+}
+
+Record &Record::add(const char *field, double value, unsigned decimals)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.*f", int(decimals), value);
+    m_fields.push_back({field, buf, false});
+    return *this;
+}
+
+Record &Record::addFlag(const char *field, bool value)
+{
+    m_fields.push_back({field, value ? "true" : "false", false});
+    return *this;
+}
+
+static std::string jsonString(const std::string &s)
+{
+    std::string result = "\"";
+    for (char c: s) {
+        if ((c == '"') || (c == '\\')) {
+            result += '\\';
+            result += c;
+        } else if ((unsigned char)c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            result += buf;
+        } else
+            result += c;
+    }
+    return result + '"';
+}
+
+void Record::print() const
+{
+    std::string line;
+    if (g_json) {
+        for (const Field &field: m_fields) {
+            line += line.empty() ? "{" : ", ";
+            line += jsonString(field.name) + ": " + (field.quoted ? jsonString(field.value) : field.value);
+        }
+        line += "}";
+    } else {
+        line = m_fields.front().value;
+        for (size_t i = 1; i < m_fields.size(); i++)
+            line += " " + m_fields[i].name + "=" + m_fields[i].value;
+    }
+    puts(line.c_str());
+    fflush(stdout);
+}
+
+using Clock = std::chrono::steady_clock;
+
+// Accumulates time and heap allocations over the measured parts of a benchmark
+class Meter {
+public:
+    void start();
+    void stop();
+    // Adds totals divided by number of units processed, e.g. stickers or frames
+    void report(Record &record, const char *unit, size_t units) const;
+private:
+    Clock::time_point m_start;
+    Clock::duration   m_elapsed = Clock::duration::zero();
+    uint64_t          m_startAllocations = 0;
+    uint64_t          m_startAllocatedBytes = 0;
+    uint64_t          m_allocations = 0;
+    uint64_t          m_allocatedBytes = 0;
+};
+
+void Meter::start()
+{
+#ifdef COUNT_ALLOCATIONS
+    m_startAllocations    = g_allocations.load(std::memory_order_relaxed);
+    m_startAllocatedBytes = g_allocatedBytes.load(std::memory_order_relaxed);
+#endif
+    m_start = Clock::now();
+}
+
+void Meter::stop()
+{
+    m_elapsed += Clock::now() - m_start;
+#ifdef COUNT_ALLOCATIONS
+    m_allocations    += g_allocations.load(std::memory_order_relaxed) - m_startAllocations;
+    m_allocatedBytes += g_allocatedBytes.load(std::memory_order_relaxed) - m_startAllocatedBytes;
+#endif
+}
+
+void Meter::report(Record &record, const char *unit, size_t units) const
+{
+    units = std::max<size_t>(units, 1);
+    record.add("unit", unit);
+    record.add("us", std::chrono::duration<double, std::micro>(m_elapsed).count() / units, 2);
+#ifdef COUNT_ALLOCATIONS
+    record.add("allocs", double(m_allocations) / units, 1);
+    record.add("alloc_bytes", double(m_allocatedBytes) / units);
+#endif
+}
+
+static bool hasSuffix(const std::string &s, const char *suffix)
+{
+    size_t len = strlen(suffix);
+    return (s.size() >= len) && !strcmp(s.c_str() + s.size() - len, suffix);
+}
+
+static void collectFiles(const char *path, std::vector<std::string> &files)
+{
+    if (!g_file_test(path, G_FILE_TEST_IS_DIR)) {
+        files.push_back(path);
+        return;
+    }
+
+    GDir *dir = g_dir_open(path, 0, NULL);
+    if (!dir) return;
+    while (const char *name = g_dir_read_name(dir))
+        if (hasSuffix(name, ".webp") || hasSuffix(name, ".tgs")) {
+            char *fullPath = g_build_filename(path, name, NULL);
+            files.push_back(fullPath);
+            g_free(fullPath);
+        }
+    g_dir_close(dir);
+}
+
+static bool readFile(const std::string &fileName, std::string &contents)
+{
+    gchar *data = NULL;
+    gsize  len  = 0;
+    bool   success = g_file_get_contents(fileName.c_str(), &data, &len, NULL);
+    if (success)
+        contents.assign(data, len);
+    g_free(data);
+    return success;
+}
+
+static bool readAndRemove(const std::string &fileName, std::string &contents)
+{
+    bool success = readFile(fileName, contents);
+    remove(fileName.c_str());
+    return success;
+}
+
+static void printPeakMemory(const std::string &fileName)
+{
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        Record("peak-rss").add("file", fileName).add("kb", usage.ru_maxrss).print();
+#endif
+}
+
+// Counters are since the start, so hit rate and peak cover every sticker so far
+static void printBitmapPool(const std::string &fileName)
+{
+#ifndef NoLottie
+    rlottie::BitmapPoolStats stats = rlottie::bitmapPoolStats();
+    uint64_t                 uses  = stats.hits + stats.misses;
+    Record("bitmap-pool").add("file", fileName)
+        .add("hits", stats.hits).add("misses", stats.misses)
+        .add("hit_percent", uses ? 100.0 * stats.hits / uses : 0, 1)
+        .add("peak_kb", stats.peakBytes / 1024).add("kept_kb", stats.bytes / 1024).print();
+#endif
+}
+
+static void benchWebp(const std::string &fileName, unsigned iterations)
+{
+    size_t      outputSize = 0;
+    std::string errorMessage;
+    Meter       meter;
+
+    for (unsigned i = 0; i < iterations; i++) {
+        meter.start();
+        GByteArray *png = convertWebpToPng(fileName.c_str(), ConversionLimits(), errorMessage);
+        meter.stop();
+        if (!png) {
+            fprintf(stderr, "%s: %s\n", fileName.c_str(), errorMessage.c_str());
+            return;
+        }
+        outputSize = png->len;
+        g_byte_array_free(png, TRUE);
+    }
+
+    Record record("webp->png");
+    record.add("file", fileName);
+    meter.report(record, "sticker", iterations);
+    record.add("output_bytes", outputSize).print();
+}
+
+// Encodes each image as PNG, reporting per image
+static void benchPngStage(const std::string &fileName, const std::vector<std::vector<uint8_t>> &images,
+                          unsigned width, unsigned height, unsigned iterations)
+{
+    std::string errorMessage;
+    size_t      outputSize = 0;
+    Meter       meter;
+
+    for (unsigned i = 0; i < iterations; i++)
+        for (const std::vector<uint8_t> &image: images) {
+            meter.start();
+            GByteArray *png = encodePng(image.data(), width, height, errorMessage);
+            meter.stop();
+            if (!png) {
+                fprintf(stderr, "%s: %s\n", fileName.c_str(), errorMessage.c_str());
+                return;
+            }
+            outputSize += png->len;
+            g_byte_array_free(png, TRUE);
+        }
+
+    Record record("png");
+    record.add("file", fileName);
+    meter.report(record, "image", iterations * images.size());
+    record.add("output_bytes", double(outputSize) / (iterations * images.size())).print();
+}
+
+static void benchWebpStages(const std::string &fileName, unsigned iterations)
+{
+#ifndef NoWebp
+    std::string data;
+    if (!readFile(fileName, data)) {
+        fprintf(stderr, "%s: cannot read file\n", fileName.c_str());
+        return;
+    }
+    const uint8_t *input = reinterpret_cast<const uint8_t *>(data.data());
+
+    // Same downscaling as convertWebpToPng
+    WebPDecoderConfig config;
+    WebPInitDecoderConfig(&config);
+    if (WebPGetFeatures(input, data.size(), &config.input) != VP8_STATUS_OK) {
+        fprintf(stderr, "%s: error reading webp bitstream\n", fileName.c_str());
+        return;
+    }
+    double scale = std::min(1.0, std::min(double(STICKER_MAX_WIDTH) / config.input.width,
+                                          double(STICKER_MAX_HEIGHT) / config.input.height));
+    unsigned width  = std::max(1, int(config.input.width * scale));
+    unsigned height = std::max(1, int(config.input.height * scale));
+    config.options.use_scaling   = (scale < 1);
+    config.options.scaled_width  = width;
+    config.options.scaled_height = height;
+    config.output.colorspace     = MODE_RGBA;
+
+    std::vector<std::vector<uint8_t>> images(1);
+    Meter meter;
+    for (unsigned i = 0; i < iterations; i++) {
+        meter.start();
+        bool success = (WebPDecode(input, data.size(), &config) == VP8_STATUS_OK);
+        meter.stop();
+        if (!success) {
+            fprintf(stderr, "%s: error decoding webp\n", fileName.c_str());
+            return;
+        }
+        images[0].assign(config.output.u.RGBA.rgba, config.output.u.RGBA.rgba + width * height * 4);
+        WebPFreeDecBuffer(&config.output);
+    }
+
+    Record record("webp-decode");
+    record.add("file", fileName);
+    meter.report(record, "image", iterations);
+    record.add("width", width).add("height", height).print();
+
+    benchPngStage(fileName, images, width, height, iterations);
+#endif
+}
+
+// Returns false on error
+static bool benchTgsOnce(const std::string &fileName, const AnimationProfile &profile,
+                         unsigned iterations, unsigned renderThreads, Meter &meter,
+                         std::string &output)
+{
+    std::string errorMessage;
+    std::string outputFileName;
+
+    for (unsigned i = 0; i < iterations; i++) {
+        meter.start();
+        bool success = convertTgsToAnimation(fileName.c_str(), outputFileName, profile,
+                                             ConversionLimits(), renderThreads, nullptr, errorMessage);
+        meter.stop();
+        if (!success) {
+            fprintf(stderr, "%s: %s\n", fileName.c_str(), errorMessage.c_str());
+            return false;
+        }
+        if (i + 1 < iterations)
+            remove(outputFileName.c_str());
+    }
+
+    if (!readAndRemove(outputFileName, output)) {
+        fprintf(stderr, "%s: cannot read output\n", fileName.c_str());
+        return false;
+    }
+    return true;
+}
+
+// Image size from file header
+static void getImageSize(AnimationFormat format, const std::string &data, unsigned &width,
+                         unsigned &height)
+{
+    const uint8_t *header = reinterpret_cast<const uint8_t *>(data.data());
+    width = height = 0;
+    switch (format) {
+    case AnimationFormat::Gif:
+        // Logical screen size
+        if (data.size() >= 10) {
+            width  = header[6] | (header[7] << 8);
+            height = header[8] | (header[9] << 8);
+        }
+        break;
+    case AnimationFormat::Apng:
+        // IHDR
+        if (data.size() >= 24) {
+            width  = (header[16] << 24) | (header[17] << 16) | (header[18] << 8) | header[19];
+            height = (header[20] << 24) | (header[21] << 16) | (header[22] << 8) | header[23];
+        }
+        break;
+    case AnimationFormat::Webp:
+        // Canvas size from VP8X chunk, which animated files always have
+        if ((data.size() >= 30) && !memcmp(header + 12, "VP8X", 4)) {
+            width  = 1 + (header[24] | (header[25] << 8) | (header[26] << 16));
+            height = 1 + (header[27] | (header[28] << 8) | (header[29] << 16));
+        }
+        break;
+    }
+}
+
+static void benchTgs(const std::string &fileName, unsigned iterations, unsigned renderThreads)
+{
+    for (AnimationFormat format: {AnimationFormat::Gif, AnimationFormat::Webp, AnimationFormat::Apng}) {
+        if (!isAnimationFormatSupported(format))
+            continue;
+        for (AnimationQuality quality: {AnimationQuality::High, AnimationQuality::Medium, AnimationQuality::Low}) {
+            AnimationProfile profile = getAnimationProfile(quality);
+            profile.format = format;
+            std::string name = std::string("tgs->") + getAnimationFormatName(format);
+            std::string sequentialOutput, parallelOutput;
+            Meter       sequential, parallel;
+            if (!benchTgsOnce(fileName, profile, iterations, 1, sequential, sequentialOutput))
+                return;
+            if ((renderThreads > 1) &&
+                !benchTgsOnce(fileName, profile, iterations, renderThreads, parallel, parallelOutput))
+            {
+                return;
+            }
+
+            unsigned width, height;
+            getImageSize(format, sequentialOutput, width, height);
+            auto report = [&](unsigned threads, const Meter &meter, const std::string &output) {
+                Record record(name.c_str());
+                record.add("file", fileName).add("quality", getAnimationQualityName(quality));
+                record.add("threads", threads);
+                meter.report(record, "sticker", iterations);
+                record.add("width", width).add("height", height).add("output_bytes", output.size());
+                if (threads > 1)
+                    record.addFlag("identical", output == sequentialOutput);
+                record.print();
+            };
+            report(1, sequential, sequentialOutput);
+            if (renderThreads > 1)
+                report(renderThreads, parallel, parallelOutput);
+        }
+    }
+
+    printPeakMemory(fileName);
+    printBitmapPool(fileName);
+}
+
+static void benchTgsStages(const std::string &fileName, unsigned iterations)
+{
+#ifndef NoLottie
+    std::string compressed, json, errorMessage;
+    if (!readFile(fileName, compressed)) {
+        fprintf(stderr, "%s: cannot read file\n", fileName.c_str());
+        return;
+    }
+
+    Meter meter;
+    for (unsigned i = 0; i < iterations; i++) {
+        // Fresh output buffer each time, as in the plugin
+        std::string().swap(json);
+        meter.start();
+        bool success = gunzip(reinterpret_cast<const uint8_t *>(compressed.data()), compressed.size(),
+                              0, json, errorMessage);
+        meter.stop();
+        if (!success) {
+            fprintf(stderr, "%s: %s\n", fileName.c_str(), errorMessage.c_str());
+            return;
+        }
+    }
+    Record gunzipRecord("gunzip");
+    gunzipRecord.add("file", fileName);
+    meter.report(gunzipRecord, "sticker", iterations);
+    gunzipRecord.add("output_bytes", json.size()).print();
+
+    // Model cache is bypassed, otherwise only the first run would parse anything
+    std::unique_ptr<rlottie::Animation> animation;
+    meter = Meter();
+    for (unsigned i = 0; i < iterations; i++) {
+        animation.reset();
+        std::string data = json;
+        meter.start();
+        animation = rlottie::Animation::loadFromData(std::move(data), fileName, "", false);
+        meter.stop();
+        if (!animation) {
+            fprintf(stderr, "%s: cannot parse animation\n", fileName.c_str());
+            return;
+        }
+    }
+    Record parseRecord("parse");
+    parseRecord.add("file", fileName);
+    meter.report(parseRecord, "sticker", iterations);
+    parseRecord.print();
+
+    // Every frame at full animated sticker size, regardless of quality profiles
+    const unsigned width      = ANIMATED_WIDTH;
+    const unsigned height     = ANIMATED_HEIGHT;
+    const size_t   frameCount = animation->totalFrame();
+    std::vector<std::vector<uint32_t>> frames(frameCount, std::vector<uint32_t>(width * height));
+    meter = Meter();
+    for (unsigned i = 0; i < iterations; i++)
+        for (size_t n = 0; n < frameCount; n++) {
+            rlottie::Surface surface(frames[n].data(), width, height, width * 4);
+            meter.start();
+            animation->renderSync(n, surface);
+            meter.stop();
+        }
+    Record renderRecord("render");
+    renderRecord.add("file", fileName);
+    meter.report(renderRecord, "frame", iterations * frameCount);
+    renderRecord.add("frames", frameCount).add("width", width).add("height", height).print();
+
+    // Same frames in order into one buffer, repainting only what changed, like conversion does
+    {
+        std::unique_ptr<rlottie::Animation> player = animation->clone();
+        std::vector<uint32_t> buffer(width * height);
+        double repainted = 0;
+        player->setPartialRender(true);
+        meter = Meter();
+        for (unsigned i = 0; i < iterations; i++)
+            for (size_t n = 0; n < frameCount; n++) {
+                rlottie::Surface surface(buffer.data(), width, height, width * 4);
+                meter.start();
+                player->renderSync(n, surface);
+                meter.stop();
+                size_t x, y, w, h;
+                player->damageRect(x, y, w, h);
+                repainted += double(w * h) / (width * height);
+            }
+        Record partialRecord("render-partial");
+        partialRecord.add("file", fileName);
+        meter.report(partialRecord, "frame", iterations * frameCount);
+        partialRecord.add("repainted_percent", 100 * repainted / (iterations * frameCount), 1).print();
+    }
+
+    std::vector<uint32_t> buffer;
+    meter = Meter();
+    for (unsigned i = 0; i < iterations; i++)
+        for (const std::vector<uint32_t> &frame: frames) {
+            buffer = frame;
+            meter.start();
+            argbToRgba(buffer.data(), buffer.size(), {0xff, 0xff, 0xff}, false);
+            meter.stop();
+        }
+    Record rgbaRecord("argb->rgba");
+    rgbaRecord.add("file", fileName);
+    meter.report(rgbaRecord, "frame", iterations * frameCount);
+    rgbaRecord.print();
+
+    std::vector<std::vector<uint8_t>> images(frameCount);
+    for (size_t n = 0; n < frameCount; n++) {
+        argbToRgba(frames[n].data(), frames[n].size(), {0xff, 0xff, 0xff}, false);
+        const uint8_t *rgba = reinterpret_cast<const uint8_t *>(frames[n].data());
+        images[n].assign(rgba, rgba + width * height * 4);
+    }
+    frames.clear();
+
+    // Whole frames, each with its own palette, as if every one was the first frame of a GIF
+    std::vector<GifPalette> palettes(frameCount);
+    meter = Meter();
+    for (unsigned i = 0; i < iterations; i++)
+        for (size_t n = 0; n < frameCount; n++) {
+            meter.start();
+            GifMakePalette(NULL, images[n].data(), width, height, 8, false, false, &palettes[n]);
+            meter.stop();
+        }
+    Record paletteRecord("palette");
+    paletteRecord.add("file", fileName);
+    meter.report(paletteRecord, "frame", iterations * frameCount);
+    paletteRecord.print();
+
+    std::unique_ptr<GifLzwDict>    dict(new GifLzwDict);
+    std::unique_ptr<GifColorCache> cache(new GifColorCache);
+    memset(dict.get(), 0, sizeof(GifLzwDict));
+    memset(cache.get(), 0, sizeof(GifColorCache));
+    GifBuffer out;
+    out.reserve(width * height * 2);
+    const GifRect rect = {0, 0, width, height};
+    size_t        delayPos, outputSize = 0;
+    meter = Meter();
+    for (unsigned i = 0; i < iterations; i++)
+        for (size_t n = 0; n < frameCount; n++) {
+            out.clear();
+            GifColorCacheReset(*cache);
+            meter.start();
+            GifThresholdImageAndWrite(out, *dict, NULL, images[n].data(), width, rect, 2, false,
+                                      &palettes[n], cache.get(), true, &delayPos);
+            meter.stop();
+            outputSize += out.size();
+        }
+    Record lzwRecord("lzw");
+    lzwRecord.add("file", fileName);
+    meter.report(lzwRecord, "frame", iterations * frameCount);
+    lzwRecord.add("output_bytes", double(outputSize) / (iterations * frameCount)).print();
+
+    benchPngStage(fileName, images, width, height, iterations);
+    printPeakMemory(fileName);
+    printBitmapPool(fileName);
+#endif
+}
+
+static void benchPixelKernels(unsigned iterations)
+{
+    const unsigned pixelCount = ANIMATED_WIDTH * ANIMATED_HEIGHT;
+
+    // Typical sticker frame: mostly fully transparent or opaque, with antialiased edges in between
+    std::mt19937 random(1);
+    std::vector<uint32_t> frame(pixelCount);
+    for (uint32_t &pixel: frame) {
+        unsigned kind = random() % 20;
+        uint32_t alpha = (kind < 9) ? 0 : (kind < 18) ? 255 : random() % 256;
+        uint32_t c = alpha ? random() % (alpha+1) : 0;
+        pixel = (alpha << 24) | (c << 16) | (c << 8) | c;
+    }
+
+    std::vector<uint32_t> buffer(pixelCount);
+    for (PixelKernel kernel: {PixelKernel::Scalar, PixelKernel::Sse2, PixelKernel::Avx2}) {
+        if (!isPixelKernelSupported(kernel))
+            continue;
+        for (bool transparent: {false, true}) {
+            Meter meter;
+            // Many more runs than for whole stickers, a frame takes microseconds
+            for (unsigned i = 0; i < iterations * 100; i++) {
+                buffer = frame;
+                meter.start();
+                argbToRgba(kernel, buffer.data(), buffer.size(), {0xff, 0xff, 0xff}, transparent);
+                meter.stop();
+            }
+            Record record("argb->rgba-kernel");
+            record.add("kernel", getPixelKernelName(kernel)).addFlag("transparent", transparent);
+            meter.report(record, "frame", iterations * 100);
+            record.print();
+        }
+    }
+}
+
+static void benchAnimationEncoders(unsigned iterations)
+{
+    const unsigned frameCount = 60;
+
+    // Flat colored ball with antialiased edge bouncing over a gradient, sticker-like in that
+    // only part of each frame changes
+    std::vector<std::vector<uint8_t>> frames(frameCount);
+    for (unsigned n = 0; n < frameCount; n++) {
+        frames[n].resize(ANIMATED_WIDTH * ANIMATED_HEIGHT * 4);
+        float cx = 40 + n * 2, cy = 100 + 50 * ((n % 30) / 15.0f - 1), radius = 30;
+        for (unsigned y = 0; y < ANIMATED_HEIGHT; y++)
+            for (unsigned x = 0; x < ANIMATED_WIDTH; x++) {
+                uint8_t *pixel = &frames[n][(y * ANIMATED_WIDTH + x) * 4];
+                float d = sqrtf((x - cx) * (x - cx) + (y - cy) * (y - cy));
+                float cover = std::min(1.0f, std::max(0.0f, radius + 0.5f - d));
+                pixel[0] = 200 * cover + (255 - y) * (1 - cover);
+                pixel[1] = 40 * cover + 255 * (1 - cover);
+                pixel[2] = 60 * cover + x * (1 - cover);
+                pixel[3] = 255;
+            }
+    }
+
+    for (AnimationFormat format: {AnimationFormat::Gif, AnimationFormat::Webp, AnimationFormat::Apng}) {
+        if (!isAnimationFormatSupported(format))
+            continue;
+        Meter                meter;
+        std::vector<uint8_t> output;
+        std::string          errorMessage;
+        for (unsigned i = 0; i < iterations; i++) {
+            meter.start();
+            std::unique_ptr<AnimationEncoder> encoder = createAnimationEncoder(format, ANIMATED_WIDTH,
+                                                                               ANIMATED_HEIGHT);
+            for (const std::vector<uint8_t> &frame: frames)
+                encoder->writeFrame(frame.data(), 2);
+            bool success = encoder->finish(output, errorMessage);
+            meter.stop();
+            if (!success) {
+                fprintf(stderr, "%s encoder: %s\n", getAnimationFormatName(format), errorMessage.c_str());
+                break;
+            }
+        }
+        Record record("encoder");
+        record.add("format", getAnimationFormatName(format)).add("frames", frameCount);
+        meter.report(record, "animation", iterations);
+        record.add("output_bytes", output.size()).print();
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned iterations = 20;
+    unsigned threads    = 0;
+    bool     kernels    = false;
+    bool     stages     = false;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && (i+1 < argc))
+            iterations = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-j") && (i+1 < argc))
+            threads = std::max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "-k"))
+            kernels = true;
+        else if (!strcmp(argv[i], "-s"))
+            stages = true;
+        else if (!strcmp(argv[i], "-J"))
+            g_json = true;
+        else
+            collectFiles(argv[i], files);
+    }
+    if (files.empty() && !kernels) {
+        fprintf(stderr, "Usage: %s [-n iterations] [-j threads] [-k] [-s] [-J] file-or-directory...\n", argv[0]);
+        return 1;
+    }
+
+    if (kernels) {
+        benchPixelKernels(iterations);
+        benchAnimationEncoders(iterations);
+    }
+
+    WorkerPool::instance().setThreadCount(threads);
+    unsigned renderThreads = WorkerPool::instance().getStats().threadCount;
+
+    for (const std::string &fileName: files) {
+        if (hasSuffix(fileName, ".tgs")) {
+            if (stages)
+                benchTgsStages(fileName, iterations);
+            else
+                benchTgs(fileName, iterations, renderThreads);
+        } else {
+            if (stages)
+                benchWebpStages(fileName, iterations);
+            else
+                benchWebp(fileName, iterations);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "pixel-convert.h"
+#include <gtest/gtest.h>
+#include <vector>
+#include <random>
+
+namespace {
+
+std::vector<uint32_t> makePixels(size_t count)
+{
+    std::mt19937 random(12345);
+    std::vector<uint32_t> pixels(count);
+    for (size_t i = 0; i < count; i++) {
+        // Plenty of fully transparent, fully opaque and in-between pixels, premultiplied or not
+        uint32_t color = random();
+        switch (i % 4) {
+            case 0: color &= 0x00ffffff; break;
+            case 1: color |= 0xff000000; break;
+            default: break;
+        }
+        pixels[i] = color;
+    }
+    return pixels;
+}
+
+void checkKernel(PixelKernel kernel, RgbColor background, bool transparent)
+{
+    // Odd length so that scalar tail gets used too
+    const std::vector<uint32_t> input = makePixels(4099);
+
+    for (size_t offset = 0; offset < 3; offset++) {
+        std::vector<uint32_t> expected(input.begin() + offset, input.end());
+        std::vector<uint32_t> actual = expected;
+        argbToRgba(PixelKernel::Scalar, expected.data(), expected.size(), background, transparent);
+        argbToRgba(kernel, actual.data(), actual.size(), background, transparent);
+
+        for (size_t i = 0; i < expected.size(); i++)
+            ASSERT_EQ(expected[i], actual[i]) << getPixelKernelName(kernel) << ": pixel " << i
+                                              << " of " << std::hex << input[offset + i];
+    }
+}
+
+void checkAllAlphas(PixelKernel kernel, RgbColor background, bool transparent)
+{
+    // Every alpha with premultiplied color components at their limits
+    std::vector<uint32_t> expected;
+    for (uint32_t a = 0; a < 256; a++)
+        for (uint32_t c: {0u, a / 2, a})
+            expected.push_back((a << 24) | (c << 16) | (c << 8) | (a - c));
+    std::vector<uint32_t> actual = expected;
+
+    argbToRgba(PixelKernel::Scalar, expected.data(), expected.size(), background, transparent);
+    argbToRgba(kernel, actual.data(), actual.size(), background, transparent);
+    ASSERT_EQ(expected, actual) << getPixelKernelName(kernel);
+}
+
+}
+
+TEST(PixelConvert, ScalarConversion)
+{
+    uint32_t pixels[] = {
+        0x00123456, // transparent
+        0xff102030, // opaque
+        0x80402010  // half-transparent
+    };
+    argbToRgba(PixelKernel::Scalar, pixels, 3, {0xff, 0xff, 0xff}, false);
+
+    EXPECT_EQ(0x00ffffffu, pixels[0]);
+    EXPECT_EQ(0xff302010u, pixels[1]);
+    // 255 * (127 / 255.0) = 127 added to each component
+    EXPECT_EQ(0x808f9fbfu, pixels[2]);
+}
+
+TEST(PixelConvert, VectorKernelsMatchScalar)
+{
+    const RgbColor backgrounds[] = {{0xff, 0xff, 0xff}, {0, 0, 0}, {0x12, 0x9a, 0xfe}};
+
+    for (PixelKernel kernel: {PixelKernel::Sse2, PixelKernel::Avx2}) {
+        if (!isPixelKernelSupported(kernel))
+            continue;
+        for (const RgbColor &background: backgrounds)
+            for (bool transparent: {false, true}) {
+                checkKernel(kernel, background, transparent);
+                checkAllAlphas(kernel, background, transparent);
+            }
+    }
+}
@@ -0,0 +1,371 @@
+#include "sticker-convert.h"
+#include "worker-pool.h"
+#include "gif-decoder.h"
+#include "buildopt.h"
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <thread>
+
+#ifndef NoLottie
+
+namespace {
+
+// test.tgs is 1.5 seconds at 60 fps, 512x512
+constexpr unsigned TEST_DURATION = 150;
+
+void convert(const AnimationProfile &profile, unsigned renderThreads, std::vector<uint8_t> &gif)
+{
+    std::string outputFileName, errorMessage;
+    ASSERT_TRUE(convertTgsToAnimation(TEST_SOURCE_DIR "/test.tgs", outputFileName, profile,
+                                      ConversionLimits(), renderThreads, nullptr, errorMessage))
+        << errorMessage;
+
+    gchar *data = NULL;
+    gsize  size = 0;
+    bool   success = g_file_get_contents(outputFileName.c_str(), &data, &size, NULL);
+    remove(outputFileName.c_str());
+    ASSERT_TRUE(success);
+    gif.assign(data, data + size);
+    g_free(data);
+}
+
+void checkFrames(const std::vector<uint8_t> &gif, unsigned width, unsigned height,
+                 unsigned minDelay, unsigned maxDelay)
+{
+    std::vector<GifDecoder::Frame> frames;
+    GifDecoder decoder(gif);
+    ASSERT_TRUE(decoder.decode(frames));
+    EXPECT_EQ(width, decoder.width());
+    EXPECT_EQ(height, decoder.height());
+
+    unsigned duration = 0;
+    for (size_t i = 0; i < frames.size(); i++) {
+        // Last frame gets whatever is left
+        if (i + 1 < frames.size()) {
+            EXPECT_GE(frames[i].delay, minDelay) << "frame " << i;
+            EXPECT_LE(frames[i].delay, maxDelay) << "frame " << i;
+        }
+        duration += frames[i].delay;
+    }
+    EXPECT_EQ(TEST_DURATION, duration);
+}
+
+}
+
+TEST(StickerConvert, Profiles)
+{
+    std::vector<uint8_t> high, medium, low;
+
+    convert(getAnimationProfile(AnimationQuality::High), 1, high);
+    // 50 fps is the most GIF can do
+    checkFrames(high, 200, 200, 2, 2);
+
+    convert(getAnimationProfile(AnimationQuality::Medium), 1, medium);
+    checkFrames(medium, 200, 200, 4, 4);
+    EXPECT_LE(medium.size(), getAnimationProfile(AnimationQuality::Medium).maxBytes);
+
+    convert(getAnimationProfile(AnimationQuality::Low), 1, low);
+    checkFrames(low, 128, 128, 6, 7);
+    EXPECT_LE(low.size(), getAnimationProfile(AnimationQuality::Low).maxBytes);
+
+    EXPECT_LT(medium.size(), high.size());
+    EXPECT_LT(low.size(), medium.size());
+}
+
+TEST(StickerConvert, SizeLimit)
+{
+    AnimationProfile profile = {50, 200, 200, 100000};
+    std::vector<uint8_t> sequential, parallel;
+
+    // Frame rate gets reduced first
+    convert(profile, 1, sequential);
+    EXPECT_LE(sequential.size(), profile.maxBytes);
+    checkFrames(sequential, 200, 200, 5, 10);
+
+    // Encoding is abandoned while frames are still being rendered in the background
+    WorkerPool::instance().setThreadCount(2);
+    convert(profile, 3, parallel);
+    EXPECT_EQ(sequential, parallel);
+
+    // Then size
+    profile.maxBytes = 40000;
+    convert(profile, 1, sequential);
+    std::vector<GifDecoder::Frame> frames;
+    GifDecoder decoder(sequential);
+    ASSERT_TRUE(decoder.decode(frames));
+    EXPECT_LT(decoder.width(), 200u);
+    EXPECT_EQ(decoder.width(), decoder.height());
+    checkFrames(sequential, decoder.width(), decoder.height(), 10, 10);
+}
+
+TEST(StickerConvert, GzipTrailer)
+{
+    gchar *data = NULL;
+    gsize  size = 0;
+    ASSERT_TRUE(g_file_get_contents(TEST_SOURCE_DIR "/test.tgs", &data, &size, NULL));
+    std::vector<uint8_t> tgs(data, data + size);
+    g_free(data);
+
+    std::string inputFileName = std::string(g_get_tmp_dir()) + "/tdlib_test_sticker.tgs";
+    AnimationProfile profile = getAnimationProfile(AnimationQuality::Low);
+    std::string outputFileName, errorMessage;
+
+    // Output buffer is sized from the trailer before zlib gets to check it
+    for (uint32_t bogusSize: {0u, 1000u, 0xffffffffu}) {
+        std::vector<uint8_t> damaged = tgs;
+        for (unsigned i = 0; i < 4; i++)
+            damaged[damaged.size() - 4 + i] = bogusSize >> (8 * i);
+        ASSERT_TRUE(g_file_set_contents(inputFileName.c_str(), (const char *)damaged.data(),
+                                        damaged.size(), NULL));
+        EXPECT_FALSE(convertTgsToAnimation(inputFileName.c_str(), outputFileName, profile,
+                                           ConversionLimits(), 1, nullptr, errorMessage));
+    }
+
+    ASSERT_TRUE(g_file_set_contents(inputFileName.c_str(), (const char *)tgs.data(), tgs.size(), NULL));
+    EXPECT_TRUE(convertTgsToAnimation(inputFileName.c_str(), outputFileName, profile,
+                                      ConversionLimits(), 1, nullptr, errorMessage))
+        << errorMessage;
+    remove(outputFileName.c_str());
+
+    // Truncated stream
+    ASSERT_TRUE(g_file_set_contents(inputFileName.c_str(), (const char *)tgs.data(),
+                                    tgs.size() / 2, NULL));
+    EXPECT_FALSE(convertTgsToAnimation(inputFileName.c_str(), outputFileName, profile,
+                                       ConversionLimits(), 1, nullptr, errorMessage));
+    remove(inputFileName.c_str());
+}
+
+TEST(StickerConvert, AnimationCache)
+{
+    gchar *data = NULL;
+    gsize  size = 0;
+    ASSERT_TRUE(g_file_get_contents(TEST_SOURCE_DIR "/test.tgs", &data, &size, NULL));
+    // Same sticker under a different file name
+    std::string inputFileName = std::string(g_get_tmp_dir()) + "/tdlib_test_sticker_copy.tgs";
+    bool        written = g_file_set_contents(inputFileName.c_str(), data, size, NULL);
+    g_free(data);
+    ASSERT_TRUE(written);
+
+    AnimationProfile profile = getAnimationProfile(AnimationQuality::Low);
+    std::string outputFileName, errorMessage;
+    configureAnimationCache(ANIMATION_CACHE_MAX_ENTRIES, 0);
+    ASSERT_TRUE(convertTgsToAnimation(TEST_SOURCE_DIR "/test.tgs", outputFileName, profile,
+                                      ConversionLimits(), 1, nullptr, errorMessage));
+    remove(outputFileName.c_str());
+
+    AnimationCacheStats before = getAnimationCacheStats();
+    EXPECT_GE(before.entries, 1u);
+    ASSERT_TRUE(convertTgsToAnimation(inputFileName.c_str(), outputFileName, profile,
+                                      ConversionLimits(), 1, nullptr, errorMessage));
+    remove(outputFileName.c_str());
+    AnimationCacheStats after = getAnimationCacheStats();
+    EXPECT_EQ(before.hits + 1, after.hits);
+    EXPECT_EQ(before.misses, after.misses);
+
+    // Too big to be cached
+    configureAnimationCache(ANIMATION_CACHE_MAX_ENTRIES, 1000);
+    after = getAnimationCacheStats();
+    EXPECT_EQ(0u, after.entries);
+    EXPECT_EQ(0u, after.bytes);
+    EXPECT_GE(after.evictions, before.evictions + 1);
+    ASSERT_TRUE(convertTgsToAnimation(inputFileName.c_str(), outputFileName, profile,
+                                      ConversionLimits(), 1, nullptr, errorMessage));
+    remove(outputFileName.c_str());
+    before = after;
+    after = getAnimationCacheStats();
+    EXPECT_EQ(before.misses + 1, after.misses);
+    EXPECT_EQ(0u, after.entries);
+
+    configureAnimationCache(ANIMATION_CACHE_MAX_ENTRIES, 0);
+    remove(inputFileName.c_str());
+}
+
+TEST(StickerConvert, OutputCache)
+{
+    gchar *data = NULL;
+    gsize  size = 0;
+    ASSERT_TRUE(g_file_get_contents(TEST_SOURCE_DIR "/test.tgs", &data, &size, NULL));
+    std::string inputFileName = std::string(g_get_tmp_dir()) + "/tdlib_test_sticker_copy.tgs";
+    bool        written = g_file_set_contents(inputFileName.c_str(), data, size, NULL);
+    g_free(data);
+    ASSERT_TRUE(written);
+
+    AnimationProfile     low = getAnimationProfile(AnimationQuality::Low);
+    AnimationProfile     medium = getAnimationProfile(AnimationQuality::Medium);
+    std::vector<uint8_t> first, again;
+    configureAnimationOutputCache(1024 * 1024);
+    AnimationOutputCacheStats before = getAnimationOutputCacheStats();
+    convert(low, 1, first);
+    AnimationOutputCacheStats after = getAnimationOutputCacheStats();
+    EXPECT_EQ(before.misses + 1, after.misses);
+    EXPECT_EQ(1u, after.entries);
+    EXPECT_EQ(first.size(), after.bytes);
+
+    // Same sticker under a different file name
+    std::string outputFileName, errorMessage;
+    ASSERT_TRUE(convertTgsToAnimation(inputFileName.c_str(), outputFileName, low,
+                                      ConversionLimits(), 1, nullptr, errorMessage));
+    gchar *output = NULL;
+    ASSERT_TRUE(g_file_get_contents(outputFileName.c_str(), &output, &size, NULL));
+    remove(outputFileName.c_str());
+    again.assign(output, output + size);
+    g_free(output);
+    EXPECT_EQ(first, again);
+    before = after;
+    after = getAnimationOutputCacheStats();
+    EXPECT_EQ(before.hits + 1, after.hits);
+    EXPECT_EQ(before.misses, after.misses);
+
+    // Another profile is another conversion
+    convert(medium, 1, again);
+    EXPECT_NE(first, again);
+    before = after;
+    after = getAnimationOutputCacheStats();
+    EXPECT_EQ(before.misses + 1, after.misses);
+    EXPECT_EQ(2u, after.entries);
+    EXPECT_EQ(first.size() + again.size(), after.bytes);
+    medium.format = AnimationFormat::Apng;
+    convert(medium, 1, again);
+    EXPECT_EQ(before.misses + 2, getAnimationOutputCacheStats().misses);
+
+    // Only room for the last one
+    configureAnimationOutputCache(again.size());
+    after = getAnimationOutputCacheStats();
+    EXPECT_EQ(1u, after.entries);
+    EXPECT_EQ(again.size(), after.bytes);
+    EXPECT_EQ(before.evictions + 2, after.evictions);
+
+    configureAnimationOutputCache(0);
+    after = getAnimationOutputCacheStats();
+    EXPECT_EQ(0u, after.entries);
+    EXPECT_EQ(0u, after.bytes);
+    remove(inputFileName.c_str());
+}
+
+TEST(StickerConvert, OutputCacheSharedConversion)
+{
+    // Nothing is kept, so every thread either converts the animation itself or waits for
+    // a conversion already in progress
+    configureAnimationOutputCache(0);
+    AnimationProfile profile = getAnimationProfile(AnimationQuality::Medium);
+    std::vector<uint8_t> expected;
+    convert(profile, 1, expected);
+
+    constexpr unsigned                THREAD_COUNT = 4;
+    std::vector<std::vector<uint8_t>> outputs(THREAD_COUNT);
+    std::vector<std::thread>          threads;
+    AnimationOutputCacheStats         before = getAnimationOutputCacheStats();
+    for (unsigned i = 0; i < THREAD_COUNT; i++)
+        threads.emplace_back([&profile, &outputs, i]() { convert(profile, 1, outputs[i]); });
+    for (std::thread &thread: threads)
+        thread.join();
+
+    AnimationOutputCacheStats after = getAnimationOutputCacheStats();
+    EXPECT_EQ(THREAD_COUNT, after.misses + after.joined - before.misses - before.joined);
+    EXPECT_EQ(before.hits, after.hits);
+    EXPECT_EQ(0u, after.entries);
+    for (const std::vector<uint8_t> &output: outputs)
+        EXPECT_EQ(expected, output);
+}
+
+TEST(StickerConvert, HelperJobsOwned)
+{
+    // With every worker thread busy, frames meant for helper jobs get rendered by the conversion
+    // itself, and the jobs are left queued under the conversion's owner
+    WorkerPool &pool = WorkerPool::instance();
+    pool.setThreadCount(2);
+    unsigned                threadCount = pool.getStats().threadCount;
+    std::mutex              mutex;
+    std::condition_variable cond;
+    unsigned                started  = 0;
+    unsigned                finished = 0;
+    bool                    released = false;
+    for (unsigned i = 0; i < threadCount; i++) {
+        WorkerPool::Job job;
+        job.run = [&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+            started++;
+            cond.notify_all();
+            cond.wait(lock, [&released]() { return released; });
+            finished++;
+            cond.notify_all();
+        };
+        ASSERT_TRUE(pool.submit(std::move(job)));
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]() { return started == threadCount; });
+    }
+
+    std::string outputFileName, errorMessage;
+    EXPECT_TRUE(convertTgsToAnimation(TEST_SOURCE_DIR "/test.tgs", outputFileName,
+                                      getAnimationProfile(AnimationQuality::Low), ConversionLimits(),
+                                      3, nullptr, errorMessage, "sticker-test")) << errorMessage;
+    remove(outputFileName.c_str());
+    EXPECT_GT(pool.cancel("sticker-test"), 0u);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    released = true;
+    cond.notify_all();
+    cond.wait(lock, [&]() { return finished == threadCount; });
+}
+
+TEST(StickerConvert, Limits)
+{
+    AnimationProfile profile = getAnimationProfile(AnimationQuality::Low);
+    std::string      outputFileName, errorMessage;
+    ConversionLimits limits;
+
+    // Uncompressed size is 83081 bytes. Animation mustn't come from cache, or it won't be
+    // decompressed at all.
+    configureAnimationCache(0, 0);
+    limits.maxDataSize = 83080;
+    EXPECT_FALSE(convertTgsToAnimation(TEST_SOURCE_DIR "/test.tgs", outputFileName, profile, limits,
+                                       1, nullptr, errorMessage));
+    limits.maxDataSize = 83081;
+    EXPECT_TRUE(convertTgsToAnimation(TEST_SOURCE_DIR "/test.tgs", outputFileName, profile, limits,
+                                      1, nullptr, errorMessage)) << errorMessage;
+    remove(outputFileName.c_str());
+    configureAnimationCache(ANIMATION_CACHE_MAX_ENTRIES, 0);
+
+    limits = ConversionLimits();
+    limits.maxFrames = 89;
+    EXPECT_FALSE(convertTgsToAnimation(TEST_SOURCE_DIR "/test.tgs", outputFileName, profile, limits,
+                                       1, nullptr, errorMessage));
+
+    limits = ConversionLimits();
+    limits.maxWidth = 511;
+    EXPECT_FALSE(convertTgsToAnimation(TEST_SOURCE_DIR "/test.tgs", outputFileName, profile, limits,
+                                       1, nullptr, errorMessage));
+
+    // Rendering 75 frames takes longer than that even on a fast machine
+    limits = ConversionLimits();
+    limits.maxTimeMs = 1;
+    EXPECT_FALSE(convertTgsToAnimation(TEST_SOURCE_DIR "/test.tgs", outputFileName,
+                                       getAnimationProfile(AnimationQuality::High), limits, 1,
+                                       nullptr, errorMessage));
+
+    CancellationToken cancellation;
+    cancellation.cancel();
+    outputFileName.clear();
+    EXPECT_FALSE(convertTgsToAnimation(TEST_SOURCE_DIR "/test.tgs", outputFileName, profile,
+                                       ConversionLimits(), 1, &cancellation, errorMessage));
+    EXPECT_TRUE(outputFileName.empty());
+}
+
+TEST(StickerConvert, Apng)
+{
+    AnimationProfile profile = getAnimationProfile(AnimationQuality::Medium);
+    profile.format = AnimationFormat::Apng;
+    std::vector<uint8_t> png;
+    convert(profile, 1, png);
+
+    // Frame-by-frame contents are checked by encoder tests
+    static const uint8_t header[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n', 0, 0, 0, 13,
+                                     'I', 'H', 'D', 'R', 0, 0, 0, 200, 0, 0, 0, 200};
+    ASSERT_GT(png.size(), sizeof(header));
+    EXPECT_TRUE(std::equal(header, header + sizeof(header), png.begin()));
+    EXPECT_LE(png.size(), profile.maxBytes);
+}
+
+#endif
@@ -0,0 +1,98 @@
+// Benchmark for message text conversion.
+// Usage: text-bench [-n iterations]
+// Incoming text is escaped with escapeHtml and, for comparison, with g_markup_escape_text copied
+// into std::string, which is what getMessageText did through purple_markup_escape_text (an older
+// copy of g_markup_escape_text that leaves control characters and apostrophes alone).
+// Outgoing text is checked with isPlainHtml. Inputs are a short chat line, and messages at
+// Telegram's 4096 character limit: prose, and a pasted log full of markup characters and line
+// breaks, plus a longer log that gets split into several messages.
+//
+// Each result is printed as one line of name=value pairs, times in nanoseconds per message.
+
+#include "html-text.h"
+#include <glib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+struct Input {
+    const char *name;
+    std::string text;
+};
+
+std::string repeat(const std::string &piece, size_t length)
+{
+    std::string text;
+    while (text.size() < length)
+        text += piece;
+    text.resize(length);
+    return text;
+}
+
+std::vector<Input> makeInputs()
+{
+    const std::string prose = "The quick brown fox jumps over the lazy dog, \xd0\xb0 \xd0\xb4\xd0\xb0\xd0\xbb\xd1\x8c\xd1\x88\xd0\xb5 "
+                              "\xe2\x80\x94 \xd1\x82\xd0\xb8\xd1\x88\xd0\xb8\xd0\xbd\xd0\xb0. ";
+    const std::string log   = "2021-03-04 12:34:56 <worker-3> request \"GET /api?a=1&b=2\" -> 200 (12 ms)\n";
+    return {
+        {"short",    "See you at 5, bring the \"usual\" stuff"},
+        {"prose",    repeat(prose, 4096)},
+        {"log",      repeat(log, 4096)},
+        {"log-64k",  repeat(log, 65536)}
+    };
+}
+
+template<typename Fn>
+double measure(unsigned iterations, Fn &&fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < iterations; i++)
+        fn();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+void report(const char *name, const Input &input, double ns)
+{
+    printf("name=%s input=%s bytes=%zu ns=%.0f mb_per_s=%.0f\n", name, input.name,
+           input.text.size(), ns, input.text.size() / ns * 1e3);
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    unsigned iterations = 2000;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-n") && (i + 1 < argc))
+            iterations = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "Usage: %s [-n iterations]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (iterations == 0)
+        iterations = 1;
+
+    size_t sink = 0;
+    for (const Input &input: makeInputs()) {
+        report("escape", input, measure(iterations, [&]() {
+            sink += escapeHtml(input.text.data(), input.text.size()).size();
+        }));
+        report("escape-glib", input, measure(iterations, [&]() {
+            gchar *escaped = g_markup_escape_text(input.text.data(), input.text.size());
+            sink += std::string(escaped).size();
+            g_free(escaped);
+        }));
+        report("is-plain", input, measure(iterations, [&]() {
+            sink += isPlainHtml(input.text.data(), input.text.size());
+        }));
+    }
+
+    return (sink == 0);
+}
@@ -0,0 +1,154 @@
+#include "worker-pool.h"
+#include <gtest/gtest.h>
+#include <atomic>
+
+namespace {
+
+// Occupies every worker thread until released, so that further jobs stay queued
+class PoolBlocker {
+public:
+    PoolBlocker()
+    {
+        WorkerPool &pool = WorkerPool::instance();
+        pool.setThreadCount(2);
+        m_threadCount = pool.getStats().threadCount;
+        for (unsigned i = 0; i < m_threadCount; i++) {
+            WorkerPool::Job job;
+            job.owner = "blocker";
+            job.run = [this]() {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_started++;
+                m_cond.notify_all();
+                m_cond.wait(lock, [this]() { return m_released; });
+                m_finished++;
+                m_cond.notify_all();
+            };
+            EXPECT_TRUE(pool.submit(std::move(job)));
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]() { return m_started == m_threadCount; });
+    }
+
+    ~PoolBlocker()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_released = true;
+        m_cond.notify_all();
+        m_cond.wait(lock, [this]() { return m_finished == m_threadCount; });
+    }
+private:
+    std::mutex              m_mutex;
+    std::condition_variable m_cond;
+    unsigned                m_threadCount = 0;
+    unsigned                m_started     = 0;
+    unsigned                m_finished    = 0;
+    bool                    m_released    = false;
+};
+
+WorkerPool::Job makeJob(const char *owner, std::atomic<int> &ran, std::atomic<int> &discarded)
+{
+    WorkerPool::Job job;
+    job.owner   = owner;
+    job.run     = [&ran]() { ran++; };
+    job.discard = [&discarded]() { discarded++; };
+    return job;
+}
+
+}
+
+TEST(WorkerPool, CancelByOwner)
+{
+    std::atomic<int> ran{0}, discarded{0};
+    {
+        PoolBlocker blocker;
+        WorkerPool &pool = WorkerPool::instance();
+        for (int i = 0; i < 3; i++)
+            ASSERT_TRUE(pool.submit(makeJob("account1", ran, discarded)));
+        ASSERT_TRUE(pool.submit(makeJob("account2", ran, discarded)));
+
+        EXPECT_EQ(3u, pool.cancel("account1"));
+        EXPECT_EQ(3, discarded);
+        EXPECT_EQ(0u, pool.cancel("account1"));
+    }
+    // The remaining job may have been dequeued but not finished yet
+    while (ran != 1)
+        std::this_thread::yield();
+    EXPECT_EQ(3, discarded);
+}
+
+TEST(WorkerPool, QueueLimit)
+{
+    std::atomic<int> ran{0}, discarded{0};
+    WorkerPool &pool = WorkerPool::instance();
+    {
+        PoolBlocker blocker;
+        uint64_t rejected = pool.getStats().rejected;
+        pool.setMaxQueueLength(2);
+        EXPECT_TRUE(pool.submit(makeJob("account1", ran, discarded)));
+        EXPECT_TRUE(pool.submit(makeJob("account1", ran, discarded)));
+        EXPECT_FALSE(pool.submit(makeJob("account1", ran, discarded)));
+        EXPECT_EQ(rejected + 1, pool.getStats().rejected);
+        pool.setMaxQueueLength(WorkerPool::DefaultMaxQueueLength);
+    }
+    while (ran != 2)
+        std::this_thread::yield();
+    EXPECT_EQ(0, discarded);
+}
+
+TEST(WorkerPool, CancelRunning)
+{
+    WorkerPool &pool = WorkerPool::instance();
+    std::atomic<bool> started{false}, stopped{false};
+    auto token = std::make_shared<CancellationToken>();
+
+    WorkerPool::Job job;
+    job.owner        = "account1";
+    job.cancellation = token;
+    job.run = [&started, &stopped, token]() {
+        started = true;
+        while (!token->isCancelled())
+            std::this_thread::yield();
+        stopped = true;
+    };
+    ASSERT_TRUE(pool.submit(std::move(job)));
+    while (!started)
+        std::this_thread::yield();
+
+    // Someone else's cancellation doesn't count
+    EXPECT_EQ(0u, pool.cancel("account2"));
+    EXPECT_FALSE(token->isCancelled());
+
+    EXPECT_EQ(0u, pool.cancel("account1"));
+    while (!stopped)
+        std::this_thread::yield();
+}
+
+TEST(WorkerPool, Shrink)
+{
+    WorkerPool &pool = WorkerPool::instance();
+    pool.setThreadCount(4);
+    pool.setThreadCount(1);
+    EXPECT_EQ(1u, pool.getStats().threadCount);
+
+    // With one thread left, a job waiting for another one to start never gets to finish
+    std::atomic<bool> firstStarted{false}, secondStarted{false}, release{false};
+    WorkerPool::Job first, second;
+    first.run = [&]() {
+        firstStarted = true;
+        while (!release)
+            std::this_thread::yield();
+    };
+    second.run = [&]() { secondStarted = true; };
+    ASSERT_TRUE(pool.submit(std::move(first)));
+    ASSERT_TRUE(pool.submit(std::move(second)));
+    while (!firstStarted)
+        std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(secondStarted);
+
+    release = true;
+    while (!secondStarted)
+        std::this_thread::yield();
+    pool.setThreadCount(2);
+    EXPECT_EQ(2u, pool.getStats().threadCount);
+}
@@ -0,0 +1,170 @@
+#include "worker-pool.h"
+#include <algorithm>
+
+constexpr unsigned WorkerPool::DefaultMaxQueueLength;
+
+WorkerPool &WorkerPool::instance()
+{
+    static WorkerPool pool;
+    return pool;
+}
+
+WorkerPool::~WorkerPool()
+{
+    std::deque<QueuedJob> leftovers;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+        leftovers.swap(m_queue);
+    }
+    m_ready.notify_all();
+    for (std::thread &thread: m_threads)
+        thread.join();
+    joinRetired();
+    for (QueuedJob &queued: leftovers)
+        if (queued.job.discard)
+            queued.job.discard();
+}
+
+unsigned WorkerPool::getDefaultThreadCount()
+{
+    return std::max(1u, std::thread::hardware_concurrency() / 2);
+}
+
+void WorkerPool::startThreads(unsigned threadCount)
+{
+    if (threadCount == 0)
+        threadCount = getDefaultThreadCount();
+
+    m_threadCount = threadCount;
+    while (m_threads.size() < threadCount)
+        m_threads.emplace_back(&WorkerPool::threadFunc, this);
+    m_stats.threadCount = threadCount;
+}
+
+void WorkerPool::setThreadCount(unsigned threadCount)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        startThreads(threadCount);
+    }
+    // Wakes up idle threads, so that any surplus ones exit
+    m_ready.notify_all();
+    joinRetired();
+}
+
+void WorkerPool::joinRetired()
+{
+    std::vector<std::thread> retired;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        retired.swap(m_retired);
+    }
+    for (std::thread &thread: retired)
+        thread.join();
+}
+
+void WorkerPool::setMaxQueueLength(unsigned maxLength)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_maxQueueLength = std::max(1u, maxLength);
+}
+
+bool WorkerPool::submit(Job &&job, Priority priority)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_threads.empty())
+            startThreads(0);
+        if (priority == Priority::Helper)
+            m_queue.push_front(QueuedJob{std::move(job), Clock::now()});
+        else if (m_queue.size() >= m_maxQueueLength) {
+            m_stats.rejected++;
+            return false;
+        } else
+            m_queue.push_back(QueuedJob{std::move(job), Clock::now()});
+        m_stats.queueDepth = m_queue.size();
+        m_stats.maxQueueDepth = std::max(m_stats.maxQueueDepth, m_stats.queueDepth);
+    }
+    m_ready.notify_one();
+    return true;
+}
+
+unsigned WorkerPool::cancel(const std::string &owner)
+{
+    std::vector<Job> cancelled;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto it = std::stable_partition(m_queue.begin(), m_queue.end(),
+                                        [&owner](const QueuedJob &queued) { return queued.job.owner != owner; });
+        for (auto pJob = it; pJob != m_queue.end(); ++pJob)
+            cancelled.push_back(std::move(pJob->job));
+        m_queue.erase(it, m_queue.end());
+        m_stats.queueDepth = m_queue.size();
+        m_stats.cancelled += cancelled.size();
+
+        for (const Job *job: m_running)
+            if ((job->owner == owner) && job->cancellation)
+                job->cancellation->cancel();
+    }
+
+    // Outside the lock: discarding may well submit or cancel something else
+    for (Job &job: cancelled)
+        if (job.discard)
+            job.discard();
+
+    return cancelled.size();
+}
+
+WorkerPool::Stats WorkerPool::getStats()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Stats stats = m_stats;
+    if (stats.completed) {
+        stats.averageWaitMs = m_totalWaitMs / stats.completed;
+        stats.averageRunMs = m_totalRunMs / stats.completed;
+    }
+    return stats;
+}
+
+void WorkerPool::threadFunc()
+{
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+
+    while (true) {
+        QueuedJob queued;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_ready.wait(lock, [this]() {
+                return m_stop || !m_queue.empty() || (m_threads.size() > m_threadCount);
+            });
+            if (m_stop)
+                break;
+            if (m_threads.size() > m_threadCount) {
+                // Thread can't join itself, whoever changes thread count next or the destructor will
+                auto self = std::find_if(m_threads.begin(), m_threads.end(), [](const std::thread &thread) {
+                    return thread.get_id() == std::this_thread::get_id();
+                });
+                m_retired.push_back(std::move(*self));
+                m_threads.erase(self);
+                break;
+            }
+            queued = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_stats.queueDepth = m_queue.size();
+            m_running.push_back(&queued.job);
+        }
+
+        Clock::time_point started = Clock::now();
+        queued.job.run();
+        Clock::time_point finished = Clock::now();
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_running.erase(std::find(m_running.begin(), m_running.end(), &queued.job));
+        double waitMs = Milliseconds(started - queued.queuedAt).count();
+        m_stats.completed++;
+        m_stats.maxWaitMs = std::max(m_stats.maxWaitMs, waitMs);
+        m_totalWaitMs += waitMs;
+        m_totalRunMs += Milliseconds(finished - started).count();
+    }
+}
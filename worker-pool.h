@@ -0,0 +1,105 @@
+#ifndef _WORKER_POOL_H
+#define _WORKER_POOL_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <stdint.h>
+
+// Lets the owner of a job ask it to stop once it has started. Jobs check it at convenient points
+// and give up early; nothing is interrupted forcibly.
+class CancellationToken {
+public:
+    void cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+private:
+    std::atomic<bool> m_cancelled{false};
+};
+
+// Set of worker threads shared by all accounts in the process, fed from one bounded queue. When
+// thread count is lowered, surplus threads exit as soon as they are idle.
+class WorkerPool {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Job {
+        // Queued jobs can be cancelled by owner, e.g. when account disconnects
+        std::string           owner;
+        // Called on a worker thread
+        std::function<void()> run;
+        // Called instead of run() on the thread that cancelled the job
+        std::function<void()> discard;
+        // Optional; signalled if the job is cancelled while running
+        std::shared_ptr<CancellationToken> cancellation;
+    };
+
+    struct Stats {
+        unsigned threadCount;
+        unsigned queueDepth;
+        unsigned maxQueueDepth;
+        uint64_t completed;
+        uint64_t rejected;
+        uint64_t cancelled;
+        double   averageWaitMs;
+        double   maxWaitMs;
+        double   averageRunMs;
+    };
+
+    enum class Priority {
+        Normal,
+        // For helper jobs splitting up a job that is already running: they go to the head of the
+        // queue and are not subject to queue length limit, since they only help finish started work
+        Helper
+    };
+
+    static constexpr unsigned DefaultMaxQueueLength = 64;
+
+    static WorkerPool &instance();
+    ~WorkerPool();
+
+    // 0 means getDefaultThreadCount()
+    void     setThreadCount(unsigned threadCount);
+    // Number of CPU cores divided by two, but at least one thread
+    static unsigned getDefaultThreadCount();
+    void     setMaxQueueLength(unsigned maxLength);
+    // Returns false if the queue is full, in which case the job is not taken
+    bool     submit(Job &&job, Priority priority = Priority::Normal);
+    // Discards all jobs of given owner which have not started yet, and signals cancellation tokens
+    // of those already running. Returns number of jobs discarded.
+    unsigned cancel(const std::string &owner);
+    Stats    getStats();
+private:
+    struct QueuedJob {
+        Job               job;
+        Clock::time_point queuedAt;
+    };
+
+    std::vector<std::thread> m_threads;
+    // Threads that have exited after thread count was lowered, still to be joined
+    std::vector<std::thread> m_retired;
+    unsigned                 m_threadCount = 0;
+    std::deque<QueuedJob>    m_queue;
+    // Jobs being run by worker threads, which own them
+    std::vector<const Job *> m_running;
+    std::mutex               m_mutex;
+    std::condition_variable  m_ready;
+    unsigned                 m_maxQueueLength = DefaultMaxQueueLength;
+    bool                     m_stop = false;
+    Stats                    m_stats = {};
+    double                   m_totalWaitMs = 0;
+    double                   m_totalRunMs = 0;
+
+    WorkerPool() = default;
+    void startThreads(unsigned threadCount);
+    void joinRetired();
+    void threadFunc();
+};
+
+#endif